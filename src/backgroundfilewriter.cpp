@@ -0,0 +1,81 @@
+#include "backgroundfilewriter.h"
+#include "thread_utils.h"
+#include "shared/util.h"
+#include <log.h>
+#include <QSaveFile>
+
+using namespace MOBase;
+
+BackgroundFileWriter::BackgroundFileWriter()
+  : m_busy(false), m_stop(false)
+{
+  m_thread = MOShared::startSafeThread([&]{ run(); });
+}
+
+BackgroundFileWriter::~BackgroundFileWriter()
+{
+  {
+    std::scoped_lock lock(m_mutex);
+    m_stop = true;
+  }
+
+  m_wakeup.notify_one();
+  m_thread.join();
+}
+
+void BackgroundFileWriter::write(const QString& path, QByteArray content)
+{
+  {
+    std::scoped_lock lock(m_mutex);
+    m_pending[path] = std::move(content);
+  }
+
+  m_wakeup.notify_one();
+}
+
+void BackgroundFileWriter::flush()
+{
+  std::unique_lock lock(m_mutex);
+  m_done.wait(lock, [&]{ return m_pending.empty() && !m_busy; });
+}
+
+void BackgroundFileWriter::run()
+{
+  MOShared::SetThisThreadName("BackgroundFileWriter");
+
+  std::unique_lock lock(m_mutex);
+
+  for (;;) {
+    m_wakeup.wait(lock, [&]{ return m_stop || !m_pending.empty(); });
+
+    if (m_pending.empty()) {
+      // stopping, everything has been written
+      break;
+    }
+
+    auto node = m_pending.extract(m_pending.begin());
+    m_busy = true;
+
+    lock.unlock();
+
+    QSaveFile file(node.key());
+
+    if (!file.open(QIODevice::WriteOnly)) {
+      log::error("failed to open '{}': {}", node.key(), file.errorString());
+    } else {
+      file.write(node.mapped());
+
+      if (!file.commit()) {
+        log::error("failed to write '{}': {}", node.key(), file.errorString());
+      }
+    }
+
+    lock.lock();
+
+    m_busy = false;
+
+    if (m_pending.empty()) {
+      m_done.notify_all();
+    }
+  }
+}
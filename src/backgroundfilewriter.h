@@ -0,0 +1,57 @@
+#ifndef MODORGANIZER_BACKGROUNDFILEWRITER_INCLUDED
+#define MODORGANIZER_BACKGROUNDFILEWRITER_INCLUDED
+
+#include <QByteArray>
+#include <QString>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+// writes files on a thread so the caller never waits on the disk; files are
+// written atomically to a temporary file that replaces the target
+//
+// when a file is queued again before the thread got to it, only the last
+// content is written
+//
+class BackgroundFileWriter
+{
+public:
+  BackgroundFileWriter();
+
+  // writes everything that's still queued
+  //
+  ~BackgroundFileWriter();
+
+  // noncopyable
+  BackgroundFileWriter(const BackgroundFileWriter&) = delete;
+  BackgroundFileWriter& operator=(const BackgroundFileWriter&) = delete;
+
+  // queues the given content for the given file, replacing whatever was
+  // queued for it
+  //
+  void write(const QString& path, QByteArray content);
+
+  // blocks until everything that was queued has been written, must be called
+  // before reading a file that might have been queued
+  //
+  void flush();
+
+private:
+  std::mutex m_mutex;
+  std::condition_variable m_wakeup;
+  std::condition_variable m_done;
+
+  // keyed by path
+  std::map<QString, QByteArray> m_pending;
+
+  // whether the thread is writing a file that's not in m_pending anymore
+  bool m_busy;
+
+  bool m_stop;
+  std::thread m_thread;
+
+  void run();
+};
+
+#endif // MODORGANIZER_BACKGROUNDFILEWRITER_INCLUDED
@@ -6,6 +6,7 @@
 #include "loglist.h"
 #include "shared/util.h"
 #include "shared/appconfig.h"
+#include "shared/fileregisterfwd.h"
 #include <log.h>
 #include <report.h>
 
@@ -237,6 +238,11 @@ std::optional<int> CommandLine::runEarly()
     logToStdout(true);
   }
 
+  if (m_vm.count("refresh-stats")) {
+    // timings of every full refresh are written to the log directory
+    MOShared::DirectoryStats::setEnabled(true);
+  }
+
   if (m_command) {
     return m_command->runEarly();
   }
@@ -349,6 +355,9 @@ void CommandLine::createOptions()
     ("logs",
       "duplicates the logs to stdout")
 
+    ("refresh-stats",
+      "writes timings of every directory refresh to logs/refresh_stats.json")
+
     ("instance,i",
       po::value<std::string>()->implicit_value(""),
       "use the given instance (defaults to last used)")
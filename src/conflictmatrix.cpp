@@ -0,0 +1,423 @@
+#include "conflictmatrix.h"
+#include "modinfo.h"
+#include "thread_utils.h"
+#include "shared/directoryentry.h"
+#include "shared/fileentry.h"
+#include "shared/filesorigin.h"
+#include "shared/fileregister.h"
+#include "shared/originconnection.h"
+#include <log.h>
+#include <utility.h>
+#include <filesystem>
+
+using namespace MOBase;
+using namespace MOShared;
+namespace fs = std::filesystem;
+
+// number of files given to a thread at a time
+constexpr std::size_t FilesPerBlock = 4096;
+
+
+// adds or removes the contribution of files to the counts of their origins;
+// the build uses one per thread, updates use one on the counts of the matrix
+//
+class ConflictMatrix::Walker
+{
+public:
+  Walker(const Tables& tables, std::vector<Counts>& counts)
+    : m_tables(tables), m_counts(counts)
+  {
+  }
+
+  // `sign` is 1 to add the file, -1 to remove it; removing a file must be done
+  // with the same origins, order and tables as when it was added
+  //
+  void process(FileEntry& file, int sign)
+  {
+    const auto& alternatives = file.getAlternatives();
+    const OriginID primary = file.getOrigin();
+
+    // every origin of this file, once, with the archive the file is in for
+    // that origin; the primary origin is first
+    m_fileOrigins.clear();
+    m_fileOrigins.push_back({primary, &file.getArchive()});
+
+    for (const auto& alt : alternatives) {
+      const bool seen = std::any_of(
+        m_fileOrigins.begin(), m_fileOrigins.end(),
+        [&](auto&& p) { return p.first == alt.originID(); });
+
+      if (!seen) {
+        m_fileOrigins.push_back({alt.originID(), &alt.archive()});
+      }
+    }
+
+    const bool hidden = isHidden(file);
+
+    for (const auto& [id, archive] : m_fileOrigins) {
+      auto& c = m_counts[id];
+      add(c.files, sign);
+
+      if (hidden) {
+        add(c.hidden, sign);
+      }
+    }
+
+    if (alternatives.empty() || alternatives.back().originID() == m_tables.dataID) {
+      // no alternatives -> no conflict
+      for (const auto& [id, archive] : m_fileOrigins) {
+        add(m_counts[id].provides, sign);
+      }
+
+      return;
+    }
+
+    const bool primaryFromArchive = file.getArchive().isValid();
+
+    for (const auto& [id, archive] : m_fileOrigins) {
+      auto& c = m_counts[id];
+      const bool fromArchive = archive->isValid();
+
+      if (id != primary) {
+        const auto primaryIndex = m_tables.modIndices[primary];
+
+        if (!primaryFromArchive) {
+          if (!fromArchive) {
+            add(c, Overwritten, primaryIndex, sign);
+          } else {
+            add(c, ArchiveLooseOverwritten, primaryIndex, sign);
+          }
+        } else {
+          add(c, ArchiveOverwritten, primaryIndex, sign);
+        }
+      } else {
+        add(c.provides, sign);
+      }
+
+      for (const auto& alt : alternatives) {
+        const auto altID = alt.originID();
+
+        if (altID == m_tables.dataID || altID == id) {
+          continue;
+        }
+
+        const auto altIndex = m_tables.modIndices[altID];
+
+        if (!alt.isFromArchive()) {
+          if (!fromArchive) {
+            if (m_tables.priorities[id] > m_tables.priorities[altID]) {
+              add(c, Overwrite, altIndex, sign);
+            } else {
+              add(c, Overwritten, altIndex, sign);
+            }
+          } else {
+            add(c, ArchiveLooseOverwritten, altIndex, sign);
+          }
+        } else {
+          if (!fromArchive) {
+            add(c, ArchiveLooseOverwrite, altIndex, sign);
+          } else {
+            if (archive->order() > alt.archive().order()) {
+              add(c, ArchiveOverwrite, altIndex, sign);
+            } else if (archive->order() < alt.archive().order()) {
+              add(c, ArchiveOverwritten, altIndex, sign);
+            }
+          }
+        }
+      }
+    }
+  }
+
+  // calls `f` with every origin of the given file
+  //
+  template <class F>
+  static void forEachOrigin(FileEntry& file, F&& f)
+  {
+    f(file.getOrigin());
+
+    for (const auto& alt : file.getAlternatives()) {
+      f(alt.originID());
+    }
+  }
+
+private:
+  const Tables& m_tables;
+  std::vector<Counts>& m_counts;
+
+  // whether a directory or one of its parents is hidden
+  std::unordered_map<const DirectoryEntry*, bool> m_hiddenDirs;
+
+  std::vector<std::pair<OriginID, const DataArchiveOrigin*>> m_fileOrigins;
+
+  static void add(std::size_t& count, int sign)
+  {
+    count += static_cast<std::size_t>(sign);
+  }
+
+  static void add(Counts& c, Relation r, unsigned int modIndex, int sign)
+  {
+    auto& relation = c.relations[r];
+
+    if (sign > 0) {
+      ++relation[modIndex];
+    } else {
+      auto itor = relation.find(modIndex);
+      if (itor == relation.end()) {
+        log::error("conflict matrix: removing unknown relation to mod {}", modIndex);
+        return;
+      }
+
+      if (--itor->second == 0) {
+        relation.erase(itor);
+      }
+    }
+  }
+
+  bool hasHiddenExt(std::wstring_view name) const
+  {
+    return (fs::path(name).extension().native() == m_tables.hiddenExt);
+  }
+
+  bool isHidden(FileEntry& file)
+  {
+    return hasHiddenExt(file.getName()) || isHidden(file.getParent());
+  }
+
+  bool isHidden(const DirectoryEntry* d)
+  {
+    if (!d) {
+      return false;
+    }
+
+    auto itor = m_hiddenDirs.find(d);
+    if (itor != m_hiddenDirs.end()) {
+      return itor->second;
+    }
+
+    const bool hidden = hasHiddenExt(d->getName()) || isHidden(d->getParent());
+    m_hiddenDirs.emplace(d, hidden);
+
+    return hidden;
+  }
+};
+
+
+ConflictMatrix::Tables ConflictMatrix::makeTables(DirectoryEntry& root)
+{
+  // mod index and priority of every origin, so the walk never has to look up
+  // names
+  Tables t;
+
+  t.modIndicesTable = root.getOriginConnection()->modIndices();
+  t.modIndices = *t.modIndicesTable;
+
+  root.getOriginConnection()->forEachOrigin([&](const FilesOrigin& o) {
+    const auto id = static_cast<std::size_t>(o.getID());
+
+    if (id >= t.priorities.size()) {
+      t.priorities.resize(id + 1, 0);
+    }
+
+    t.priorities[id] = o.getPriority();
+  });
+
+  // both tables must cover every origin
+  const auto originCount = std::max(t.modIndices.size(), t.priorities.size());
+  t.modIndices.resize(originCount, UINT_MAX);
+  t.priorities.resize(originCount, 0);
+
+  if (root.originExists(L"data")) {
+    t.dataID = root.getOriginByName(L"data").getID();
+  }
+
+  t.hiddenExt = ModInfo::s_HiddenExt.toStdWString();
+
+  return t;
+}
+
+std::shared_ptr<ConflictMatrix> ConflictMatrix::build(
+  DirectoryEntry& root, std::size_t threadCount,
+  const std::atomic<bool>* cancel)
+{
+  TimeThis tt("ConflictMatrix::build()");
+
+  auto m = std::make_shared<ConflictMatrix>();
+  m->m_tables = makeTables(root);
+
+  const auto originCount = m->m_tables.modIndices.size();
+  const auto& reg = *root.getFileRegister();
+  const std::size_t fileCount = reg.highestCount();
+
+  threadCount = std::max<std::size_t>(1, std::min(
+    threadCount, (fileCount + FilesPerBlock - 1) / FilesPerBlock));
+
+  // the first thread works on the counts of the matrix directly
+  std::vector<std::vector<Counts>> counts(threadCount - 1);
+  std::vector<std::unique_ptr<Walker>> walkers;
+
+  m->m_counts.resize(originCount);
+  walkers.push_back(std::make_unique<Walker>(m->m_tables, m->m_counts));
+
+  for (auto& c : counts) {
+    c.resize(originCount);
+    walkers.push_back(std::make_unique<Walker>(m->m_tables, c));
+  }
+
+  std::atomic<std::size_t> next = 0;
+  std::vector<std::thread> threads;
+
+  for (auto& w : walkers) {
+    threads.push_back(startSafeThread([&, w=w.get()] {
+      for (;;) {
+        if (cancel && *cancel) {
+          break;
+        }
+
+        const auto begin = next.fetch_add(FilesPerBlock);
+        if (begin >= fileCount) {
+          break;
+        }
+
+        const auto end = std::min(begin + FilesPerBlock, fileCount);
+
+        for (auto i=begin; i<end; ++i) {
+          if (auto* f=reg.getFile(static_cast<FileIndex>(i))) {
+            w->process(*f, 1);
+          }
+        }
+      }
+    }));
+  }
+
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  if (cancel && *cancel) {
+    return {};
+  }
+
+  for (const auto& from : counts) {
+    for (std::size_t id=0; id<originCount; ++id) {
+      auto& to = m->m_counts[id];
+
+      to.files += from[id].files;
+      to.provides += from[id].provides;
+      to.hidden += from[id].hidden;
+
+      for (std::size_t r=0; r<RelationCount; ++r) {
+        for (const auto& [modIndex, n] : from[id].relations[r]) {
+          to.relations[r][modIndex] += n;
+        }
+      }
+    }
+  }
+
+  m->m_origins.resize(originCount);
+  for (std::size_t id=0; id<originCount; ++id) {
+    m->updateOrigin(static_cast<OriginID>(id));
+  }
+
+  return m;
+}
+
+std::shared_ptr<const ConflictMatrix::OriginConflicts> ConflictMatrix::get(
+  OriginID id) const
+{
+  static const auto empty = std::make_shared<const OriginConflicts>();
+
+  std::scoped_lock lock(m_mutex);
+
+  if (id < 0 || static_cast<std::size_t>(id) >= m_origins.size()) {
+    return empty;
+  }
+
+  const auto& c = m_origins[static_cast<std::size_t>(id)];
+  return (c ? c : empty);
+}
+
+bool ConflictMatrix::updatePriorities(
+  DirectoryEntry& root, const std::vector<OriginID>& moved,
+  std::set<OriginID>& changed)
+{
+  std::scoped_lock lock(m_mutex);
+
+  Tables newTables = makeTables(root);
+
+  if (newTables.modIndicesTable != m_tables.modIndicesTable ||
+      newTables.priorities.size() != m_tables.priorities.size() ||
+      newTables.dataID != m_tables.dataID)
+  {
+    return false;
+  }
+
+  // only the files of the moved origins can have alternatives in a different
+  // order
+  std::set<FileIndex> indices;
+  for (const auto id : moved) {
+    for (const auto& f : root.getOriginConnection()->getByID(id).getFiles()) {
+      indices.insert(f->getIndex());
+    }
+  }
+
+  const auto& reg = root.getFileRegister();
+  std::vector<FileEntryPtr> files;
+  files.reserve(indices.size());
+
+  for (const auto i : indices) {
+    if (auto f=reg->getFile(i)) {
+      files.push_back(f);
+    }
+  }
+
+  Walker w(m_tables, m_counts);
+
+  for (auto& f : files) {
+    w.process(*f, -1);
+    Walker::forEachOrigin(*f, [&](OriginID id){ changed.insert(id); });
+  }
+
+  reg->sortOrigins({indices.begin(), indices.end()});
+  m_tables.priorities = std::move(newTables.priorities);
+
+  for (auto& f : files) {
+    w.process(*f, 1);
+  }
+
+  for (const auto id : changed) {
+    updateOrigin(id);
+  }
+
+  return true;
+}
+
+void ConflictMatrix::updateOrigin(OriginID id)
+{
+  const auto& c = m_counts[static_cast<std::size_t>(id)];
+
+  if (c.files == 0) {
+    m_origins[static_cast<std::size_t>(id)].reset();
+    return;
+  }
+
+  auto o = std::make_shared<OriginConflicts>();
+
+  o->hasFiles = true;
+  o->providesAnything = (c.provides > 0);
+  o->hasHiddenFiles = (c.hidden > 0);
+
+  const auto keys = [&](Relation r, std::set<unsigned int>& to) {
+    for (const auto& [modIndex, n] : c.relations[r]) {
+      to.insert(to.end(), modIndex);
+    }
+  };
+
+  keys(Overwrite, o->overwrite);
+  keys(Overwritten, o->overwritten);
+  keys(ArchiveOverwrite, o->archiveOverwrite);
+  keys(ArchiveOverwritten, o->archiveOverwritten);
+  keys(ArchiveLooseOverwrite, o->archiveLooseOverwrite);
+  keys(ArchiveLooseOverwritten, o->archiveLooseOverwritten);
+
+  m_origins[static_cast<std::size_t>(id)] = std::move(o);
+}
@@ -0,0 +1,129 @@
+#ifndef MODORGANIZER_CONFLICTMATRIX_INCLUDED
+#define MODORGANIZER_CONFLICTMATRIX_INCLUDED
+
+#include "shared/fileregisterfwd.h"
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+// conflicts between all the origins of a directory structure, computed in a
+// single pass over its file register
+//
+// the lists contain mod indices; each origin gets the mods it overwrites and
+// the ones overwriting it, for loose files, archives, and loose files against
+// archives
+//
+// the matrix counts how many files give each relation so it can be updated
+// when only some files change: their contribution is removed, they change,
+// and it's added back; see updatePriorities()
+//
+class ConflictMatrix
+{
+public:
+  struct OriginConflicts
+  {
+    // whether the origin has any file in the structure
+    bool hasFiles = false;
+
+    // whether at least one file of the origin is not overwritten by another
+    // origin
+    bool providesAnything = false;
+
+    // whether the origin has a file that's hidden or in a hidden directory
+    bool hasHiddenFiles = false;
+
+    std::set<unsigned int> overwrite;                // mods overwritten by this origin
+    std::set<unsigned int> overwritten;              // mods overwriting this origin
+    std::set<unsigned int> archiveOverwrite;         // mods with archive files overwritten by this origin's archives
+    std::set<unsigned int> archiveOverwritten;       // mods with archive files overwriting this origin's archives
+    std::set<unsigned int> archiveLooseOverwrite;    // mods with archives overwritten by this origin's loose files
+    std::set<unsigned int> archiveLooseOverwritten;  // mods with loose files overwriting this origin's archives
+  };
+
+  // walks all the files of the given structure using `threadCount` threads
+  //
+  // returns null if `cancel` was set before the walk was done
+  //
+  static std::shared_ptr<ConflictMatrix> build(
+    MOShared::DirectoryEntry& root, std::size_t threadCount,
+    const std::atomic<bool>* cancel=nullptr);
+
+  // conflicts of the given origin, never null; an origin that's not in the
+  // matrix has no conflicts
+  //
+  // the returned object is never modified, updates replace it
+  //
+  std::shared_ptr<const OriginConflicts> get(MOShared::OriginID id) const;
+
+  // to be called after the priorities of the given origins have been changed
+  // in the structure; `moved` must include at least one origin of every pair
+  // whose relative order has changed
+  //
+  // sorts again the origins of the files that belong to a moved origin and
+  // updates the conflicts of every origin that has one of these files; the
+  // ids of these origins are added to `changed`
+  //
+  // returns false if the matrix can't be updated because origins or mod
+  // indices have changed since it was built, nothing is done in that case
+  //
+  bool updatePriorities(
+    MOShared::DirectoryEntry& root,
+    const std::vector<MOShared::OriginID>& moved,
+    std::set<MOShared::OriginID>& changed);
+
+private:
+  class Walker;
+
+  enum Relation
+  {
+    Overwrite = 0,
+    Overwritten,
+    ArchiveOverwrite,
+    ArchiveOverwritten,
+    ArchiveLooseOverwrite,
+    ArchiveLooseOverwritten,
+
+    RelationCount
+  };
+
+  // number of files giving each relation
+  struct Counts
+  {
+    std::size_t files = 0;
+    std::size_t provides = 0;
+    std::size_t hidden = 0;
+
+    // mod index to number of files
+    std::array<std::map<unsigned int, std::size_t>, RelationCount> relations;
+  };
+
+  // what the walkers need to know about the origins, indexed by origin id
+  struct Tables
+  {
+    std::shared_ptr<const std::vector<unsigned int>> modIndicesTable;
+    std::vector<unsigned int> modIndices;
+    std::vector<int> priorities;
+    MOShared::OriginID dataID = 0;
+    std::wstring hiddenExt;
+  };
+
+  mutable std::mutex m_mutex;
+  Tables m_tables;
+
+  // indexed by origin id
+  std::vector<Counts> m_counts;
+
+  // indexed by origin id, can be null for origins that don't have any files
+  std::vector<std::shared_ptr<const OriginConflicts>> m_origins;
+
+  static Tables makeTables(MOShared::DirectoryEntry& root);
+
+  // builds the conflicts of the given origin from its counts
+  void updateOrigin(MOShared::OriginID id);
+};
+
+#endif // MODORGANIZER_CONFLICTMATRIX_INCLUDED
@@ -18,6 +18,7 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "directoryrefresher.h"
+#include "directorysnapshot.h"
 #include "shared/fileentry.h"
 #include "shared/filesorigin.h"
 #include "shared/directoryentry.h"
@@ -30,16 +31,20 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 #include "envfs.h"
 #include "modinfodialogfwd.h"
 #include "shared/util.h"
+#include "shared/appconfig.h"
 
 #include <gameplugins.h>
 
 #include <QApplication>
+#include <QDateTime>
 #include <QDir>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
 #include <QString>
 #include <QTextCodec>
 
-#include <fstream>
-
 
 using namespace MOBase;
 using namespace MOShared;
@@ -52,6 +57,10 @@ DirectoryStats::DirectoryStats()
 
 DirectoryStats& DirectoryStats::operator+=(const DirectoryStats& o)
 {
+  walkTimes += o.walkTimes;
+  archiveTimes += o.archiveTimes;
+  mergeTimes += o.mergeTimes;
+
   dirTimes += o.dirTimes;
   fileTimes += o.fileTimes;
   sortTimes += o.sortTimes;
@@ -80,99 +89,192 @@ DirectoryStats& DirectoryStats::operator+=(const DirectoryStats& o)
   return *this;
 }
 
-std::string DirectoryStats::csvHeader()
-{
-  QStringList sl = {
-    "dirTimes",
-    "fileTimes",
-    "sortTimes",
-    "subdirLookupTimes",
-    "addDirectoryTimes",
-    "filesLookupTimes",
-    "addFileTimes",
-    "addOriginToFileTimes",
-    "addFileToOriginTimes",
-    "addFileToRegisterTimes",
-    "originExists",
-    "originCreate",
-    "originsNeededEnabled",
-    "subdirExists",
-    "subdirCreate",
-    "fileExists",
-    "fileCreate",
-    "filesInsertedInRegister",
-    "filesAssignedInRegister"};
-
-  return sl.join(",").toStdString();
+std::chrono::nanoseconds DirectoryStats::totalTimes() const
+{
+  return walkTimes + archiveTimes + mergeTimes;
 }
 
-std::string DirectoryStats::toCsv() const
+double seconds(std::chrono::nanoseconds ns)
 {
-  QStringList oss;
+  return std::chrono::duration<double>(ns).count();
+}
 
-  auto s = [](auto ns) {
-    return ns.count() / 1000.0 / 1000.0 / 1000.0;
+QJsonObject DirectoryStats::toJson() const
+{
+  return {
+    {"name", QString::fromStdString(mod)},
+
+    {"total", seconds(totalTimes())},
+    {"walk", seconds(walkTimes)},
+    {"archives", seconds(archiveTimes)},
+    {"insert", seconds(mergeTimes)},
+
+    {"dirTimes", seconds(dirTimes)},
+    {"fileTimes", seconds(fileTimes)},
+    {"sortTimes", seconds(sortTimes)},
+    {"subdirLookupTimes", seconds(subdirLookupTimes)},
+    {"addDirectoryTimes", seconds(addDirectoryTimes)},
+    {"filesLookupTimes", seconds(filesLookupTimes)},
+    {"addFileTimes", seconds(addFileTimes)},
+    {"addOriginToFileTimes", seconds(addOriginToFileTimes)},
+    {"addFileToOriginTimes", seconds(addFileToOriginTimes)},
+    {"addFileToRegisterTimes", seconds(addFileToRegisterTimes)},
+
+    {"originExists", originExists},
+    {"originCreate", originCreate},
+    {"originsNeededEnabled", originsNeededEnabled},
+    {"subdirExists", subdirExists},
+    {"subdirCreate", subdirCreate},
+    {"fileExists", fileExists},
+    {"fileCreate", fileCreate},
+    {"filesInsertedInRegister", filesInsertedInRegister},
+    {"filesAssignedInRegister", filesAssignedInRegister}
   };
+}
 
-  oss
-    << QString::number(s(dirTimes))
-    << QString::number(s(fileTimes))
-    << QString::number(s(sortTimes))
 
-    << QString::number(s(subdirLookupTimes))
-    << QString::number(s(addDirectoryTimes))
+// adds the time between construction and stop() or destruction to `out` if
+// instrumentation is enabled
+//
+class PhaseTimer
+{
+public:
+  explicit PhaseTimer(std::chrono::nanoseconds& out)
+    : m_out(DirectoryStats::enabled() ? &out : nullptr)
+  {
+    if (m_out) {
+      m_start = std::chrono::high_resolution_clock::now();
+    }
+  }
 
-    << QString::number(s(filesLookupTimes))
-    << QString::number(s(addFileTimes))
-    << QString::number(s(addOriginToFileTimes))
-    << QString::number(s(addFileToOriginTimes))
-    << QString::number(s(addFileToRegisterTimes))
+  ~PhaseTimer()
+  {
+    stop();
+  }
 
-    << QString::number(originExists)
-    << QString::number(originCreate)
-    << QString::number(originsNeededEnabled)
+  void stop()
+  {
+    if (m_out) {
+      *m_out += std::chrono::high_resolution_clock::now() - m_start;
+      m_out = nullptr;
+    }
+  }
 
-    << QString::number(subdirExists)
-    << QString::number(subdirCreate)
+  PhaseTimer(const PhaseTimer&) = delete;
+  PhaseTimer& operator=(const PhaseTimer&) = delete;
 
-    << QString::number(fileExists)
-    << QString::number(fileCreate)
-    << QString::number(filesInsertedInRegister)
-    << QString::number(filesAssignedInRegister);
+private:
+  std::chrono::nanoseconds* m_out;
+  std::chrono::high_resolution_clock::time_point m_start;
+};
 
-  return oss.join(",").toStdString();
-}
 
-void dumpStats(std::vector<DirectoryStats>& stats)
+// wall times of the phases of a full refresh and the stats of every origin,
+// only filled when instrumentation is enabled
+//
+struct DirectoryRefresher::RefreshReport
 {
-  static int run = 0;
-  static const std::string file("c:\\tmp\\data.csv");
+  // walking and parsing archives, all origins in parallel
+  std::chrono::nanoseconds scan{};
+
+  // merging into the structure
+  std::chrono::nanoseconds insert{};
+
+  // moving the files of mods that steal files from other origins
+  std::chrono::nanoseconds steal{};
+
+  // cleanStructure()
+  std::chrono::nanoseconds cleanup{};
+
+  std::chrono::nanoseconds total{};
+
+  std::size_t threads = 0;
+  std::size_t files = 0;
+
+  // the data directory first, then the mods by priority
+  std::vector<DirectoryStats> origins;
 
-  if (run == 0) {
-    std::ofstream out(file, std::ios::out|std::ios::trunc);
-    out << fmt::format("what,run,{}", DirectoryStats::csvHeader()) << "\n";
+  // path to the report in the log directory of the current instance
+  //
+  static QString path()
+  {
+    return
+      qApp->property("dataPath").toString() + "/" +
+      QString::fromStdWString(AppConfig::logPath()) + "/" +
+      QString::fromStdWString(AppConfig::refreshStatsFileName());
   }
 
-  std::sort(stats.begin(), stats.end(), [](auto&& a, auto&& b){
-    return (naturalCompare(QString::fromStdString(a.mod), QString::fromStdString(b.mod)) < 0);
+  QJsonDocument toJson() const
+  {
+    // sums of the per-origin times, which are larger than the wall times
+    // because the tasks run in parallel
+    DirectoryStats sums;
+    for (const auto& o : origins) {
+      sums += o;
+    }
+
+    QJsonObject phases = {
+      {"scan", seconds(scan)},
+      {"walk", seconds(sums.walkTimes)},
+      {"archives", seconds(sums.archiveTimes)},
+      {"insert", seconds(insert)},
+      {"steal", seconds(steal)},
+      {"cleanup", seconds(cleanup)},
+      {"total", seconds(total)}
+    };
+
+    // slowest first
+    std::vector<const DirectoryStats*> sorted;
+    for (const auto& o : origins) {
+      sorted.push_back(&o);
+    }
+
+    std::stable_sort(sorted.begin(), sorted.end(), [](auto* a, auto* b) {
+      return a->totalTimes() > b->totalTimes();
     });
 
-  std::ofstream out(file, std::ios::app);
+    QJsonArray array;
+    for (const auto* o : sorted) {
+      array.append(o->toJson());
+    }
 
-  DirectoryStats total;
-  for (const auto& s : stats) {
-    out << fmt::format("{},{},{}", s.mod, run, s.toCsv()) << "\n";
-    total += s;
+    return QJsonDocument(QJsonObject{
+      {"date", QDateTime::currentDateTime().toString(Qt::ISODate)},
+      {"threads", static_cast<qint64>(threads)},
+      {"files", static_cast<qint64>(files)},
+      {"phases", phases},
+      {"origins", array}
+    });
   }
 
-  out << fmt::format("total,{},{}", run, total.toCsv()) << "\n";
+  void save() const
+  {
+    const auto p = path();
+    QDir().mkpath(QFileInfo(p).absolutePath());
+
+    QSaveFile f(p);
 
-  ++run;
-}
+    if (!f.open(QIODevice::WriteOnly)) {
+      log::error("can't write refresh stats to '{}': {}", p, f.errorString());
+      return;
+    }
+
+    f.write(toJson().toJson(QJsonDocument::Indented));
+
+    if (!f.commit()) {
+      log::error("can't write refresh stats to '{}': {}", p, f.errorString());
+      return;
+    }
+
+    log::debug("refresh stats written to '{}'", p);
+  }
+};
 
 
 DirectoryRefresher::DirectoryRefresher(std::size_t threadCount)
-  : m_threadCount(threadCount), m_lastFileCount(0)
+  : m_threadCount(threadCount), m_lastFileCount(0),
+    m_HasFullRefresh(false), m_IncrementalPending(false),
+    m_SnapshotPending(false)
 {
 }
 
@@ -197,37 +299,79 @@ void DirectoryRefresher::setMods(const std::vector<std::tuple<QString, QString,
   m_EnabledArchives = managedArchives;
 }
 
+// files and directories at the root of origins that are removed from the
+// structure by cleanStructure()
+static const wchar_t *IgnoredFiles[] = { L"meta.ini", L"readme.txt" };
+static const wchar_t *IgnoredDirectories[] = { L"fomod" };
+
 void DirectoryRefresher::cleanStructure(DirectoryEntry *structure)
 {
-  static const wchar_t *files[] = { L"meta.ini", L"readme.txt" };
-  for (int i = 0; i < sizeof(files) / sizeof(wchar_t*); ++i) {
-    structure->removeFile(files[i]);
+  for (const auto* file : IgnoredFiles) {
+    structure->removeFile(file);
   }
 
-  static const wchar_t *dirs[] = { L"fomod" };
-  for (int i = 0; i < sizeof(dirs) / sizeof(wchar_t*); ++i) {
-    structure->removeDir(std::wstring(dirs[i]));
+  for (const auto* dir : IgnoredDirectories) {
+    structure->removeDir(std::wstring(dir));
   }
+
+  // every refresh ends here, only the directories that changed are sorted
+  structure->freeze();
 }
 
-void DirectoryRefresher::addModBSAToStructure(
-  DirectoryEntry* root, const QString& modName,
-  int priority, const QString& directory, const QStringList& archives)
+bool DirectoryRefresher::isIgnoredPath(std::wstring_view relativePath)
 {
-  const IPluginGame *game = qApp->property("managed_game").value<IPluginGame*>();
+  const auto sep = relativePath.find_first_of(L"\\/");
+  const auto first = ToLowerCopy(relativePath.substr(0, sep));
 
-  QStringList loadOrder;
+  if (sep == std::wstring_view::npos) {
+    for (const auto* file : IgnoredFiles) {
+      if (first == file) {
+        return true;
+      }
+    }
+  }
 
-  GamePlugins* gamePlugins = game->feature<GamePlugins>();
-  if (gamePlugins) {
-    loadOrder = gamePlugins->getLoadOrder();
+  // the directory itself or anything inside it
+  for (const auto* dir : IgnoredDirectories) {
+    if (first == dir) {
+      return true;
+    }
   }
 
-  std::vector<std::wstring> lo;
-  for (auto&& s : loadOrder) {
-    lo.push_back(s.toStdWString());
+  return false;
+}
+
+// load order of the plugins of the managed game
+//
+std::vector<std::wstring> managedLoadOrderList()
+{
+  std::vector<std::wstring> loadOrder;
+
+  const IPluginGame *game = qApp->property("managed_game").value<IPluginGame*>();
+
+  if (auto* gamePlugins=game->feature<GamePlugins>()) {
+    for (auto&& s : gamePlugins->getLoadOrder()) {
+      loadOrder.push_back(s.toStdWString());
+    }
   }
 
+  return loadOrder;
+}
+
+// index of the load order of the plugins of the managed game, used to find
+// the order of archives
+//
+LoadOrderIndex managedLoadOrder()
+{
+  return LoadOrderIndex(managedLoadOrderList());
+}
+
+void DirectoryRefresher::addModBSAToStructure(
+  DirectoryEntry* root, const QString& modName,
+  int priority, const QString& directory, const QStringList& archives)
+{
+  const auto loadOrder = managedLoadOrder();
+
   std::vector<std::wstring> archivesW;
   for (auto&& a : archives) {
     archivesW.push_back(a.toStdWString());
@@ -246,7 +390,7 @@ void DirectoryRefresher::addModBSAToStructure(
     priority,
     archivesW,
     enabledArchives,
-    lo,
+    loadOrder,
     dummy);
 }
 
@@ -262,6 +406,8 @@ void DirectoryRefresher::stealModFilesIntoStructure(
   FilesOrigin &origin = directoryStructure->createOrigin(
     ToWString(modName), directoryW, priority, dummy);
 
+  const OriginPriorities priorities(*directoryStructure->getOriginConnection());
+
   for (const QString &filename : stealFiles) {
     if (filename.isEmpty()) {
       log::warn("Trying to find file with no name");
@@ -269,13 +415,13 @@ void DirectoryRefresher::stealModFilesIntoStructure(
     }
     QFileInfo fileInfo(filename);
     FileEntryPtr file = directoryStructure->findFile(ToWString(fileInfo.fileName()));
-    if (file.get() != nullptr) {
+    if (file != nullptr) {
       if (file->getOrigin() == 0) {
         // replace data as the origin on this bsa
-        file->removeOrigin(0);
+        file->removeOrigin(0, priorities);
       }
       origin.addFile(file->getIndex());
-      file->addOrigin(origin.getID(), file->getFileTime(), L"", -1);
+      file->addOrigin(origin.getID(), file->getFileTime(), {}, priorities);
     } else {
       QString warnStr = fileInfo.absolutePath();
       if (warnStr.isEmpty())
@@ -330,68 +476,154 @@ void DirectoryRefresher::addModToStructure(DirectoryEntry *directoryStructure
 }
 
 
-struct ModThread
+// state shared by all the tasks adding the same mod to the structure
+//
+struct ModScan
 {
+  FilesOrigin* origin = nullptr;
+  DirectoryStats* stats = nullptr;
   DirectoryRefreshProgress* progress = nullptr;
-  DirectoryEntry* ds = nullptr;
-  std::wstring modName;
-  std::wstring path;
-  int prio = -1;
-  std::vector<std::wstring> archives;
-  std::set<std::wstring> enabledArchives;
-  DirectoryStats* stats =  nullptr;
-  env::DirectoryWalker walker;
 
-  std::condition_variable cv;
+  // tasks for this mod that haven't finished yet
+  std::atomic<std::size_t> pending = 0;
+
   std::mutex mutex;
-  bool ready = false;
+  OriginFingerprint fingerprint;
 
-  void wakeup()
+  // called by every task when it's done, with what it has found
+  void finished(const OriginFingerprint& fp, const DirectoryStats& s)
   {
     {
       std::scoped_lock lock(mutex);
-      ready = true;
+      fingerprint += fp;
+
+      if (stats) {
+        *stats += s;
+      }
     }
 
-    cv.notify_one();
+    if (--pending == 0) {
+      origin->setFingerprint(fingerprint);
+
+      if (progress) {
+        progress->addDone();
+      }
+    }
   }
+};
 
-  void run()
-  {
-    std::unique_lock lock(mutex);
-    cv.wait(lock, [&]{ return ready; });
+MOShared::WorkStealingPool g_pool;
 
-    SetThisThreadName(QString::fromStdWString(modName + L" refresher"));
-    ds->addFromOrigin(walker, modName, path, prio, *stats);
+// adds the files directly inside the given directory and queues a task for
+// each subdirectory, so large mods are spread over all the threads
+//
+void scanDirectory(
+  ModScan& ms, DirectoryEntry* entry, const std::wstring& path,
+  std::size_t pathHash)
+{
+  thread_local env::DirectoryWalker walker;
 
-    if (Settings::instance().archiveParsing()) {
-      const IPluginGame *game = qApp->property("managed_game").value<IPluginGame*>();
+  OriginFingerprint::Builder fp(pathHash);
+  std::vector<DirectoryEntry::PendingDirectory> subdirs;
+  DirectoryStats stats;
 
-      QStringList loadOrder;
-      GamePlugins* gamePlugins = game->feature<GamePlugins>();
-      if (gamePlugins) {
-        loadOrder = gamePlugins->getLoadOrder();
-      }
+  entry->addFilesFromDirectory(walker, *ms.origin, path, fp, subdirs, stats);
+
+  // must be incremented before this task is marked as finished below
+  ms.pending += subdirs.size();
+
+  for (auto& sd : subdirs) {
+    g_pool.submit([&ms, sd=std::move(sd)] {
+      scanDirectory(ms, sd.entry, sd.path, sd.pathHash);
+    });
+  }
+
+  ms.finished(fp.result(), stats);
+}
+
+
+// first phase of buildStructure(), walks the given directory into a private
+// tree and queues a task for each subdirectory
+//
+void scanDirectoryInto(
+  ModScan& ms, env::Directory& d, const std::wstring& path,
+  std::size_t pathHash)
+{
+  thread_local env::DirectoryWalker walker;
+
+  struct Context
+  {
+    env::Directory& d;
+    OriginFingerprint::Builder fp;
+  };
+
+  Context cx = {d, OriginFingerprint::Builder(pathHash)};
+  DirectoryStats stats;
 
-      std::vector<std::wstring> lo;
-      for (auto&& s : loadOrder) {
-        lo.push_back(s.toStdWString());
+  {
+    PhaseTimer t(stats.walkTimes);
+
+    walker.forEachEntryInDirectory(path, &cx,
+      [](void* pcx, std::wstring_view name)
+      {
+        static_cast<Context*>(pcx)->d.dirs.emplace_back(name);
+      },
+
+      [](void* pcx, std::wstring_view name, FILETIME ft, uint64_t size)
+      {
+        auto* cx = static_cast<Context*>(pcx);
+        cx->d.files.emplace_back(name, ft, size);
+        cx->fp.addFile(name, ft, size);
       }
+    );
+  }
 
-      ds->addFromAllBSAs(
-        modName, path, prio, archives, enabledArchives, lo, *stats);
-    }
+  // the vector won't change anymore, the tasks can keep references to its
+  // elements
+  ms.pending += d.dirs.size();
 
-    if (progress) {
-      progress->addDone();
-    }
+  for (auto& sd : d.dirs) {
+    cx.fp.enterDirectory(sd.name);
+    const auto sdHash = cx.fp.pathHash();
+    cx.fp.leaveDirectory();
 
-    SetThisThreadName(QString::fromStdWString(L"idle refresher"));
-    ready = false;
+    std::wstring sdPath;
+    sdPath.reserve(path.size() + 1 + sd.name.size());
+    sdPath.append(path).append(L"\\").append(sd.name);
+
+    g_pool.submit([&ms, &sd, sdPath=std::move(sdPath), sdHash] {
+      scanDirectoryInto(ms, sd, sdPath, sdHash);
+    });
   }
+
+  ms.finished(cx.fp.result(), stats);
+}
+
+// an archive parsed by the first phase of buildStructure()
+//
+struct ScannedArchive
+{
+  FilesOrigin* origin = nullptr;
+  std::wstring name;
+  int order = -1;
+  FILETIME fileTime = {};
+  std::shared_ptr<const ArchiveIndex> index;
+
+  // stats of the origin, null if instrumentation is disabled
+  DirectoryStats* stats = nullptr;
 };
 
-env::ThreadPool<ModThread> g_threads;
+// what the first phase of buildStructure() found for one origin
+//
+struct ScannedOrigin
+{
+  ModScan scan;
+  env::Directory files;
+  std::vector<std::unique_ptr<ScannedArchive>> archives;
+
+  // scan.stats points here if instrumentation is enabled
+  DirectoryStats stats;
+};
 
 
 void DirectoryRefresher::updateProgress(const DirectoryRefreshProgress* p)
@@ -405,22 +637,33 @@ void DirectoryRefresher::addMultipleModsFilesToStructure(
   const std::vector<EntryInfo>& entries, DirectoryRefreshProgress* progress)
 {
   std::vector<DirectoryStats> stats(entries.size());
+  std::vector<ModScan> scans(entries.size());
 
   if (progress) {
     progress->start(entries.size());
   }
 
   log::debug("refresher: using {} threads", m_threadCount);
-  g_threads.setMax(m_threadCount);
+  g_pool.setThreadCount(m_threadCount);
+
+  const bool archiveParsing = Settings::instance().archiveParsing();
+
+  // same for all mods
+  LoadOrderIndex loadOrder;
+  std::set<std::wstring> enabledArchives;
+
+  if (archiveParsing) {
+    loadOrder = managedLoadOrder();
+
+    for (auto&& a : m_EnabledArchives) {
+      enabledArchives.insert(a.toStdWString());
+    }
+  }
 
   for (std::size_t i=0; i<entries.size(); ++i) {
     const auto& e = entries[i];
     const int prio = e.priority + 1;
 
-    if constexpr (DirectoryStats::EnableInstrumentation) {
-      stats[i].mod = entries[i].modName.toStdString();
-    }
-
     try
     {
       if (e.stealFiles.length() > 0) {
@@ -431,40 +674,395 @@ void DirectoryRefresher::addMultipleModsFilesToStructure(
           progress->addDone();
         }
       } else {
-        auto& mt = g_threads.request();
+        const auto modName = e.modName.toStdWString();
+        const auto path = QDir::toNativeSeparators(e.absolutePath).toStdWString();
+
+        auto& ms = scans[i];
+        ms.origin = &directoryStructure->createOrigin(modName, path, prio, stats[i]);
+        ms.stats = &stats[i];
+        ms.progress = progress;
+
+        std::vector<std::wstring> archives;
+        if (archiveParsing) {
+          for (auto&& a : e.archives) {
+            archives.push_back(a.toStdWString());
+          }
+        }
 
-        mt.progress = progress;
-        mt.ds = directoryStructure;
-        mt.modName = e.modName.toStdWString();
-        mt.path = QDir::toNativeSeparators(e.absolutePath).toStdWString();
-        mt.prio = prio;
+        // the root directory and the archives, all set before submitting
+        // anything so the mod can't be marked as done early
+        ms.pending = (path.empty() ? 0 : 1) + (archives.empty() ? 0 : 1);
 
-        mt.archives.clear();
-        for (auto&& a : e.archives) {
-          mt.archives.push_back(a.toStdWString());
+        if (ms.pending == 0) {
+          ms.pending = 1;
+          ms.finished({}, {});
+          continue;
         }
 
-        mt.enabledArchives.clear();
-        for (auto&& a : m_EnabledArchives) {
-          mt.enabledArchives.insert(a.toStdWString());
+        if (!path.empty()) {
+          g_pool.submit([&ms, directoryStructure, path] {
+            scanDirectory(ms, directoryStructure, path, 0);
+          });
         }
 
-        mt.stats = &stats[i];
+        if (!archives.empty()) {
+          g_pool.submit([&, directoryStructure, modName, path, prio,
+                         archives=std::move(archives)] {
+            DirectoryStats s;
+
+            directoryStructure->addFromAllBSAs(
+              modName, path, prio, archives, enabledArchives, loadOrder, s);
+
+            ms.finished({}, s);
+          });
+        }
+      }
+    } catch (const std::exception& ex) {
+      emit error(tr("failed to read mod (%1): %2").arg(e.modName, ex.what()));
+    }
+  }
 
-        mt.wakeup();
+  g_pool.waitForAll();
+}
+
+void DirectoryRefresher::buildStructure(
+  DirectoryEntry* root, const std::wstring& dataDirectory,
+  const std::vector<EntryInfo>& entries, DirectoryRefreshProgress* progress,
+  RefreshReport& report)
+{
+  const bool instrumented = DirectoryStats::enabled();
+
+  if (progress) {
+    progress->start(entries.size());
+  }
+
+  log::debug("refresher: using {} threads", m_threadCount);
+  g_pool.setThreadCount(m_threadCount);
+
+  const bool archiveParsing = Settings::instance().archiveParsing();
+
+  LoadOrderIndex loadOrder;
+  std::set<std::wstring> enabledArchives;
+
+  if (archiveParsing) {
+    loadOrder = managedLoadOrder();
+
+    for (auto&& a : m_EnabledArchives) {
+      enabledArchives.insert(a.toStdWString());
+    }
+  }
+
+  // first phase: every origin is walked into its own tree and its archives
+  // are parsed, nothing is added to the structure yet
+  //
+  // the origins are created here, in order, so their ids don't depend on the
+  // scheduling; the data directory must be the first one
+  std::vector<ScannedOrigin> scanned(entries.size() + 1);
+  DirectoryStats dummy;
+
+  PhaseTimer scanTimer(report.scan);
+
+  auto scan = [&](
+    ScannedOrigin& so, const std::wstring& path,
+    std::vector<std::wstring> archives)
+  {
+    // set before submitting anything so the origin can't be marked as done
+    // early
+    so.scan.pending = (path.empty() ? 0 : 1) + (archives.empty() ? 0 : 1);
+
+    if (so.scan.pending == 0) {
+      so.scan.pending = 1;
+      so.scan.finished({}, {});
+      return;
+    }
+
+    if (!path.empty()) {
+      g_pool.submit([&so, path] {
+        scanDirectoryInto(so.scan, so.files, path, 0);
+      });
+    }
+
+    if (!archives.empty()) {
+      g_pool.submit([&, archives=std::move(archives)] {
+        DirectoryStats stats;
+
+        for (const auto& a : archives) {
+          auto name = std::filesystem::path(a).filename().native();
+          if (!enabledArchives.contains(name)) {
+            continue;
+          }
+
+          auto sa = std::make_unique<ScannedArchive>();
+
+          {
+            PhaseTimer t(stats.archiveTimes);
+            sa->index = ArchiveCache::instance().get(a, sa->fileTime);
+          }
+
+          if (!sa->index) {
+            continue;
+          }
+
+          sa->origin = so.scan.origin;
+          sa->order = loadOrder.archiveOrder(name);
+          sa->name = std::move(name);
+          sa->stats = so.scan.stats;
+
+          so.archives.push_back(std::move(sa));
+        }
+
+        so.scan.finished({}, stats);
+      });
+    }
+  };
+
+  // the stats are only merged into the origins when instrumentation is
+  // enabled
+  auto setStats = [&](ScannedOrigin& so, const QString& name) {
+    if (instrumented) {
+      so.stats.mod = name.toStdString();
+      so.scan.stats = &so.stats;
+    }
+  };
+
+  scanned[0].scan.origin = &root->createOrigin(L"data", dataDirectory, 0, dummy);
+  setStats(scanned[0], "data");
+  scan(scanned[0], dataDirectory, {});
+
+  for (std::size_t i=0; i<entries.size(); ++i) {
+    const auto& e = entries[i];
+    auto& so = scanned[i + 1];
+
+    try
+    {
+      const auto path = QDir::toNativeSeparators(e.absolutePath).toStdWString();
+
+      so.scan.origin = &root->createOrigin(
+        e.modName.toStdWString(), path, e.priority + 1, dummy);
+
+      setStats(so, e.modName);
+
+      if (e.stealFiles.length() > 0) {
+        // handled once the structure is complete
+        if (progress) {
+          progress->addDone();
+        }
+
+        continue;
+      }
+
+      so.scan.progress = progress;
+
+      std::vector<std::wstring> archives;
+      if (archiveParsing) {
+        for (auto&& a : e.archives) {
+          archives.push_back(a.toStdWString());
+        }
       }
+
+      scan(so, path, std::move(archives));
     } catch (const std::exception& ex) {
       emit error(tr("failed to read mod (%1): %2").arg(e.modName, ex.what()));
     }
   }
 
-  g_threads.waitForAll();
+  g_pool.waitForAll();
+  scanTimer.stop();
+
+
+  // second phase: the trees are merged into the structure in the order
+  // sortOrigins() would put them in, archives by load order first, then loose
+  // files by priority; ties between archives go to the mod with the higher
+  // priority
+  std::vector<ScannedOrigin*> origins;
+  std::vector<ScannedArchive*> archives;
+
+  for (auto& so : scanned) {
+    if (!so.scan.origin) {
+      continue;
+    }
+
+    origins.push_back(&so);
+
+    for (auto& a : so.archives) {
+      archives.push_back(a.get());
+    }
+  }
+
+  std::stable_sort(origins.begin(), origins.end(), [](auto* a, auto* b) {
+    return a->scan.origin->getPriority() < b->scan.origin->getPriority();
+  });
+
+  std::stable_sort(archives.begin(), archives.end(), [](auto* a, auto* b) {
+    const int ao = (a->order < 0 ? INT_MAX : a->order);
+    const int bo = (b->order < 0 ? INT_MAX : b->order);
+
+    if (ao != bo) {
+      return ao < bo;
+    }
+
+    return a->origin->getPriority() < b->origin->getPriority();
+  });
+
+  {
+    // an archive with the same name in multiple mods is only added once, the
+    // one that would win is kept
+    std::set<std::wstring> seen;
+    std::vector<ScannedArchive*> unique;
+
+    for (auto itor=archives.rbegin(); itor!=archives.rend(); ++itor) {
+      if (seen.insert((*itor)->name).second) {
+        unique.push_back(*itor);
+      }
+    }
+
+    archives.assign(unique.rbegin(), unique.rend());
+  }
+
+  // everything under the same top-level directory is merged by the same
+  // task, in order; the empty name is for the files in the root directory
+  struct Shard
+  {
+    std::vector<std::pair<ScannedArchive*, const ArchiveIndex::Folder*>> archives;
+    std::vector<std::pair<ScannedOrigin*, env::Directory*>> dirs;
+  };
+
+  PhaseTimer insertTimer(report.insert);
+
+  std::map<std::wstring, Shard> shards;
+
+  auto topLevel = [](std::wstring_view path) {
+    return ToLowerCopy(std::wstring(path.substr(0, path.find_first_of(L"\\/"))));
+  };
+
+  for (auto* a : archives) {
+    const auto& folder = a->index->root;
+    shards[L""].archives.push_back({a, &folder});
+
+    for (const auto& sub : folder.folders) {
+      shards[topLevel(sub.name)].archives.push_back({a, &sub});
+    }
+  }
+
+  for (auto* so : origins) {
+    shards[L""].dirs.push_back({so, &so->files});
 
-  if constexpr (DirectoryStats::EnableInstrumentation) {
-    dumpStats(stats);
+    for (auto& d : so->files.dirs) {
+      shards[topLevel(d.name)].dirs.push_back({so, &d});
+    }
+  }
+
+  std::mutex statsMutex;
+
+  for (auto& [name, shard] : shards) {
+    g_pool.submit([root, &name, &shard, &statsMutex] {
+      DirectoryStats stats;
+
+      // stats for each origin merged by this task, added to the origins once
+      // the task is done so the mutex is only locked once
+      std::vector<std::pair<DirectoryStats*, DirectoryStats>> local;
+
+      auto merge = [&](DirectoryStats* target, auto&& f) {
+        if (!target) {
+          f(stats);
+          return;
+        }
+
+        DirectoryStats s;
+
+        {
+          PhaseTimer t(s.mergeTimes);
+          f(s);
+        }
+
+        local.push_back({target, std::move(s)});
+      };
+
+      for (auto& [a, folder] : shard.archives) {
+        merge(a->stats, [&](DirectoryStats& s) {
+          if (name.empty()) {
+            root->mergeArchiveFiles(
+              *a->origin, *folder, a->fileTime, a->name, a->order, s);
+          } else {
+            root->mergeArchiveFolder(
+              *a->origin, *folder, a->fileTime, a->name, a->order, s);
+          }
+        });
+      }
+
+      for (auto& [so, d] : shard.dirs) {
+        merge(so->scan.stats, [&](DirectoryStats& s) {
+          if (name.empty()) {
+            root->mergeFiles(*so->scan.origin, *d, s);
+          } else {
+            root->mergeDirectory(*so->scan.origin, *d, s);
+          }
+        });
+      }
+
+      if (!local.empty()) {
+        std::scoped_lock lock(statsMutex);
+
+        for (auto& [target, s] : local) {
+          *target += s;
+        }
+      }
+    });
+  }
+
+  g_pool.waitForAll();
+  insertTimer.stop();
+
+
+  // files stolen by mods are moved last, FileEntry::addOrigin() inserts the
+  // new origin in order so they don't need to be sorted
+  {
+    PhaseTimer t(report.steal);
+
+    for (const auto& e : entries) {
+      if (e.stealFiles.length() > 0) {
+        stealModFilesIntoStructure(
+          root, e.modName, e.priority + 1, e.absolutePath, e.stealFiles);
+      }
+    }
+  }
+
+  if (instrumented) {
+    report.threads = m_threadCount;
+
+    for (auto& so : scanned) {
+      if (so.scan.origin) {
+        report.origins.push_back(std::move(so.stats));
+      }
+    }
   }
 }
 
+OriginFingerprint fingerprintOrigin(
+  env::DirectoryWalker& walker, const std::wstring& path)
+{
+  OriginFingerprint::Builder b;
+
+  walker.forEachEntry(path, &b,
+    [](void* pcx, std::wstring_view path)
+    {
+      static_cast<OriginFingerprint::Builder*>(pcx)->enterDirectory(path);
+    },
+
+    [](void* pcx, std::wstring_view)
+    {
+      static_cast<OriginFingerprint::Builder*>(pcx)->leaveDirectory();
+    },
+
+    [](void* pcx, std::wstring_view path, FILETIME ft, uint64_t size)
+    {
+      static_cast<OriginFingerprint::Builder*>(pcx)->addFile(path, ft, size);
+    }
+  );
+
+  return b.result();
+}
+
 void DirectoryRefresher::refresh()
 {
   SetThisThreadName("DirectoryRefresher");
@@ -474,30 +1072,49 @@ void DirectoryRefresher::refresh()
   {
     QMutexLocker locker(&m_RefreshLock);
 
-    m_Root.reset(new DirectoryEntry(L"data", nullptr, 0));
-
     IPluginGame *game = qApp->property("managed_game").value<IPluginGame*>();
 
-    std::wstring dataDirectory =
+    const std::wstring dataDirectory =
       QDir::toNativeSeparators(game->dataDirectory().absolutePath()).toStdWString();
 
-    {
-      DirectoryStats dummy;
-      m_Root->addFromOrigin(L"data", dataDirectory, 0, dummy);
-    }
-
     std::sort(m_Mods.begin(), m_Mods.end(), [](auto lhs, auto rhs) {
       return lhs.priority < rhs.priority;
     });
 
-    addMultipleModsFilesToStructure(m_Root.get(), m_Mods, p);
+    const bool archiveParsing = Settings::instance().archiveParsing();
 
-    m_Root->getFileRegister()->sortOrigins();
+    if (archiveParsing) {
+      // only loaded once, does nothing on later refreshes
+      ArchiveCache::instance().load(ArchiveCache::path());
+    }
 
-    cleanStructure(m_Root.get());
+    if (!m_HasFullRefresh && Settings::instance().incrementalRefresh()) {
+      // first refresh since startup, try the structure saved by the last
+      // session instead of walking everything
+      loadSnapshot();
+    }
+
+    const auto loadOrder = managedLoadOrderList();
+
+    if (canRefreshIncrementally(dataDirectory, loadOrder)) {
+      refreshIncremental(dataDirectory, p);
+
+      if (m_Root) {
+        // the structure from the snapshot is not live yet, it can be patched
+        // here directly
+        applyChanges(m_Root.get());
+      }
+    } else {
+      refreshFull(dataDirectory, loadOrder, p);
 
-    m_lastFileCount = m_Root->getFileRegister()->highestCount();
-    log::debug("refresher saw {} files", m_lastFileCount);
+      // the snapshot is written on shutdown, see saveSnapshot()
+      m_SnapshotPending = Settings::instance().incrementalRefresh();
+    }
+
+    if (archiveParsing) {
+      // only saved if archives had to be parsed
+      ArchiveCache::instance().save(ArchiveCache::path());
+    }
   }
 
   p->finish();
@@ -505,3 +1122,236 @@ void DirectoryRefresher::refresh()
   emit progress(p);
   emit refreshed();
 }
+
+bool DirectoryRefresher::canRefreshIncrementally(
+  const std::wstring& dataDirectory,
+  const std::vector<std::wstring>& loadOrder) const
+{
+  if (!Settings::instance().incrementalRefresh()) {
+    return false;
+  }
+
+  if (!m_HasFullRefresh || m_IncrementalPending) {
+    return false;
+  }
+
+  // anything that changes the shape of the structure, such as mods being
+  // enabled, disabled or moved, needs a full refresh
+  return
+    m_LastDataDirectory == dataDirectory &&
+    m_LastMods == m_Mods &&
+    m_LastEnabledArchives == m_EnabledArchives &&
+    m_LastLoadOrder == loadOrder;
+}
+
+void DirectoryRefresher::refreshFull(
+  const std::wstring& dataDirectory,
+  const std::vector<std::wstring>& loadOrder, DirectoryRefreshProgress* p)
+{
+  RefreshReport report;
+  PhaseTimer totalTimer(report.total);
+
+  // changes from an incremental refresh that was never applied are obsolete,
+  // the new structure replaces the live one
+  m_IncrementalPending = false;
+  m_Changes.clear();
+
+  m_Root.reset(new DirectoryEntry(L"data", nullptr, 0));
+
+  buildStructure(m_Root.get(), dataDirectory, m_Mods, p, report);
+
+  {
+    PhaseTimer t(report.cleanup);
+    cleanStructure(m_Root.get());
+  }
+
+  totalTimer.stop();
+
+  m_lastFileCount = m_Root->getFileRegister()->highestCount();
+  log::debug("refresher saw {} files", m_lastFileCount);
+
+  if (DirectoryStats::enabled()) {
+    report.files = m_lastFileCount;
+    report.save();
+  }
+
+  // remember what this structure was built from for the next refresh
+  m_Fingerprints.clear();
+  m_Fingerprints[L"data"] = m_Root->getOriginByName(L"data").fingerprint();
+
+  for (const auto& e : m_Mods) {
+    const auto name = e.modName.toStdWString();
+
+    if (e.stealFiles.isEmpty() && m_Root->originExists(name)) {
+      m_Fingerprints[name] = m_Root->getOriginByName(name).fingerprint();
+    }
+  }
+
+  m_HasFullRefresh = true;
+  m_LastDataDirectory = dataDirectory;
+  m_LastMods = m_Mods;
+  m_LastEnabledArchives = m_EnabledArchives;
+  m_LastLoadOrder = loadOrder;
+}
+
+void DirectoryRefresher::refreshIncremental(
+  const std::wstring& dataDirectory, DirectoryRefreshProgress* p)
+{
+  // the data directory is handled like a mod with priority 0, mods are
+  // offset by 1 in the structure
+  std::vector<EntryInfo> entries;
+  entries.push_back({
+    "data", QString::fromStdWString(dataDirectory), {}, {}, -1});
+
+  for (const auto& e : m_Mods) {
+    // files stolen from other origins are never walked
+    if (e.stealFiles.isEmpty()) {
+      entries.push_back(e);
+    }
+  }
+
+  p->start(entries.size());
+
+  m_Changes.clear();
+  std::mutex changesMutex;
+
+  parallelMap(entries.begin(), entries.end(), [&](const EntryInfo& e) {
+    thread_local env::DirectoryWalker walker;
+
+    const auto name = e.modName.toStdWString();
+    const auto path = QDir::toNativeSeparators(e.absolutePath).toStdWString();
+    const auto fp = fingerprintOrigin(walker, path);
+
+    auto itor = m_Fingerprints.find(name);
+
+    if (itor == m_Fingerprints.end() || itor->second != fp) {
+      OriginChange c = {e, env::getFilesAndDirs(path), fp};
+
+      std::scoped_lock lock(changesMutex);
+      m_Changes.push_back(std::move(c));
+    }
+
+    p->addDone();
+  }, m_threadCount);
+
+  // origins are added back in priority order, like a full refresh would
+  std::sort(m_Changes.begin(), m_Changes.end(), [](auto&& a, auto&& b) {
+    return a.entry.priority < b.entry.priority;
+  });
+
+  log::debug(
+    "incremental refresh: {} of {} origins changed",
+    m_Changes.size(), entries.size());
+
+  m_IncrementalPending = true;
+}
+
+void DirectoryRefresher::loadSnapshot()
+{
+  DirectorySnapshot::State state;
+  auto root = DirectorySnapshot::load(DirectorySnapshot::path(), state);
+
+  if (!root) {
+    return;
+  }
+
+  log::debug("loaded directory snapshot");
+
+  m_Fingerprints.clear();
+
+  root->getOriginConnection()->forEachOrigin([&](const FilesOrigin& o) {
+    m_Fingerprints[o.getName()] = o.fingerprint();
+  });
+
+  // the snapshot is used as if it was the result of the last full refresh,
+  // it will be discarded if the list of mods doesn't match
+  m_Root = std::move(root);
+  m_HasFullRefresh = true;
+  m_SnapshotPending = false;
+  m_LastDataDirectory = std::move(state.dataDirectory);
+  m_LastMods = std::move(state.mods);
+  m_LastEnabledArchives = std::move(state.enabledArchives);
+  m_LastLoadOrder = std::move(state.loadOrder);
+}
+
+void DirectoryRefresher::saveSnapshot(const DirectoryEntry& structure)
+{
+  TimeThis tt("DirectoryRefresher::saveSnapshot()");
+  QMutexLocker locker(&m_RefreshLock);
+
+  if (!m_SnapshotPending) {
+    return;
+  }
+
+  if (m_Root || m_IncrementalPending) {
+    // the live structure is older than the state below
+    log::debug("not saving directory snapshot, last refresh was not applied");
+    return;
+  }
+
+  DirectorySnapshot::save(
+    DirectorySnapshot::path(), structure,
+    {m_LastDataDirectory, m_LastMods, m_LastEnabledArchives, m_LastLoadOrder});
+
+  m_SnapshotPending = false;
+}
+
+bool DirectoryRefresher::applyIncrementalChanges(DirectoryEntry* root)
+{
+  TimeThis tt("DirectoryRefresher::applyIncrementalChanges()");
+  QMutexLocker locker(&m_RefreshLock);
+
+  if (!m_IncrementalPending) {
+    return false;
+  }
+
+  applyChanges(root);
+  return true;
+}
+
+void DirectoryRefresher::applyChanges(DirectoryEntry* root)
+{
+  m_IncrementalPending = false;
+
+  if (m_Changes.empty()) {
+    return;
+  }
+
+  m_SnapshotPending = true;
+
+  for (auto& c : m_Changes) {
+    const auto name = c.entry.modName.toStdWString();
+    const auto path = QDir::toNativeSeparators(c.entry.absolutePath).toStdWString();
+    const int prio = c.entry.priority + 1;
+
+    log::debug("incremental refresh: rescanning '{}'", c.entry.modName);
+
+    // removes all the files of this origin from the structure, the origin
+    // itself is kept and enabled again below
+    if (root->originExists(name)) {
+      root->getOriginByName(name).enable(false);
+    }
+
+    DirectoryStats dummy;
+    root->addFromList(name, path, c.files, prio, dummy);
+
+    if (Settings::instance().archiveParsing() && !c.entry.archives.isEmpty()) {
+      addModBSAToStructure(
+        root, c.entry.modName, prio, c.entry.absolutePath, c.entry.archives);
+    }
+
+    FilesOrigin& origin = root->getOriginByName(name);
+    origin.setFingerprint(c.fingerprint);
+    m_Fingerprints[name] = c.fingerprint;
+  }
+
+  // origins added back are inserted in order in the alternatives of their
+  // files, nothing needs to be sorted
+
+  cleanStructure(root);
+  m_Changes.clear();
+
+  // the files removed above and since the last patch are not used anymore,
+  // the next patch can reuse their slots instead of growing the register
+  root->getFileRegister()->recycleRemoved();
+}
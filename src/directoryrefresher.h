@@ -22,6 +22,7 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 
 #include "shared/fileregisterfwd.h"
 #include "profile.h"
+#include "envfs.h"
 #include <QObject>
 #include <QMutex>
 #include <QStringList>
@@ -47,6 +48,14 @@ public:
     {
     }
 
+    bool operator==(const EntryInfo& o) const
+    {
+      return
+        modName == o.modName && absolutePath == o.absolutePath &&
+        stealFiles == o.stealFiles && archives == o.archives &&
+        priority == o.priority;
+    }
+
     QString modName;
     QString absolutePath;
     QStringList stealFiles;
@@ -70,6 +79,31 @@ public:
    **/
   MOShared::DirectoryEntry* stealDirectoryStructure();
 
+  /**
+   * @brief applies the changes found by the last incremental refresh
+   *
+   * when refresh() only had to rescan some origins, there is no new directory
+   * structure to steal; instead, the origins that changed on disk have been
+   * scanned and must be patched into the live structure by calling this from
+   * the thread that owns it
+   *
+   * @param structure the live directory structure
+   * @return false if the last refresh was not incremental
+   **/
+  bool applyIncrementalChanges(MOShared::DirectoryEntry* structure);
+
+  /**
+   * @brief saves a snapshot of the live structure for the next session
+   *
+   * refreshes only remember that the structure changed, the snapshot is
+   * written here on shutdown so a refresh never waits on it; does nothing if
+   * the structure hasn't changed since the snapshot was loaded or saved, or if
+   * the last refresh hasn't been delivered to the live structure yet
+   *
+   * @param structure the live directory structure
+   **/
+  void saveSnapshot(const MOShared::DirectoryEntry& structure);
+
   /**
    * @brief sets up the mods to be included in the directory structure
    *
@@ -90,6 +124,13 @@ public:
    */
   static void cleanStructure(MOShared::DirectoryEntry *structure);
 
+  /**
+   * @brief whether the given path is removed by cleanStructure(), changes to
+   *        it don't need to be reflected in the structure
+   * @param relativePath path relative to the origin directory
+   */
+  static bool isIgnoredPath(std::wstring_view relativePath);
+
   /**
    * @brief add files for a mod to the directory structure, including bsas
    * @param directoryStructure
@@ -144,6 +185,18 @@ signals:
   void refreshed();
 
 private:
+  struct RefreshReport;
+
+  // an origin that was found to be different on disk during an incremental
+  // refresh
+  //
+  struct OriginChange
+  {
+    EntryInfo entry;
+    env::Directory files;
+    MOShared::OriginFingerprint fingerprint;
+  };
+
   std::vector<EntryInfo> m_Mods;
   std::set<QString> m_EnabledArchives;
   std::unique_ptr<MOShared::DirectoryEntry> m_Root;
@@ -151,6 +204,61 @@ private:
   std::size_t m_threadCount;
   std::size_t m_lastFileCount;
 
+  // state of the last full refresh, used to decide whether the next one can
+  // be incremental
+  bool m_HasFullRefresh;
+  std::wstring m_LastDataDirectory;
+  std::vector<EntryInfo> m_LastMods;
+  std::set<QString> m_LastEnabledArchives;
+  std::vector<std::wstring> m_LastLoadOrder;
+  std::map<std::wstring, MOShared::OriginFingerprint> m_Fingerprints;
+
+  // origins that have to be patched by applyIncrementalChanges()
+  bool m_IncrementalPending;
+  std::vector<OriginChange> m_Changes;
+
+  // whether the structure changed since the snapshot was loaded or saved
+  bool m_SnapshotPending;
+
+  void refreshFull(
+    const std::wstring& dataDirectory,
+    const std::vector<std::wstring>& loadOrder,
+    DirectoryRefreshProgress* progress);
+
+  void refreshIncremental(
+    const std::wstring& dataDirectory, DirectoryRefreshProgress* progress);
+
+  // the load order decides the order of archives, so the conflicts between
+  // them change when plugins are moved
+  bool canRefreshIncrementally(
+    const std::wstring& dataDirectory,
+    const std::vector<std::wstring>& loadOrder) const;
+
+  // patches the origins in m_Changes into the given structure, the refresh
+  // lock must be held
+  void applyChanges(MOShared::DirectoryEntry* root);
+
+  // loads the structure saved by the last session in m_Root and sets up the
+  // state as if it had been built by a full refresh
+  void loadSnapshot();
+
+
+  // builds a new structure from scratch for the data directory and the given
+  // mods in two phases: every mod is first walked into its own private tree
+  // and its archives are parsed, all in parallel; the trees are then merged
+  // in priority order, one task per top-level directory
+  //
+  // since the origins are merged in order, the result doesn't depend on how
+  // the threads were scheduled and the origins don't need to be sorted
+  // afterwards
+  //
+  // timings are added to `report` if instrumentation is enabled, see
+  // DirectoryStats::setEnabled()
+  void buildStructure(
+    MOShared::DirectoryEntry* root, const std::wstring& dataDirectory,
+    const std::vector<EntryInfo>& entries, DirectoryRefreshProgress* progress,
+    RefreshReport& report);
+
   void stealModFilesIntoStructure(
     MOShared::DirectoryEntry *directoryStructure, const QString &modName,
     int priority, const QString &directory, const QStringList &stealFiles);
@@ -0,0 +1,365 @@
+#include "directorysnapshot.h"
+#include "shared/directoryentry.h"
+#include "shared/fileentry.h"
+#include "shared/filesorigin.h"
+#include "shared/originconnection.h"
+#include "shared/appconfig.h"
+#include "shared/snapshotio.h"
+#include <log.h>
+#include <utility.h>
+#include <QApplication>
+#include <QSaveFile>
+
+using namespace MOBase;
+using namespace MOShared;
+
+// "MODS"
+constexpr uint32_t SnapshotMagic = 0x53444f4d;
+
+// must be incremented every time the format changes, older snapshots are
+// ignored
+constexpr uint32_t SnapshotVersion = 3;
+
+
+void writeState(SnapshotWriter& w, const DirectorySnapshot::State& state)
+{
+  w.write(std::wstring_view(state.dataDirectory));
+
+  w.write(static_cast<uint32_t>(state.mods.size()));
+  for (const auto& m : state.mods) {
+    w.write(m.modName);
+    w.write(m.absolutePath);
+    w.write(m.stealFiles);
+    w.write(m.archives);
+    w.write(static_cast<int32_t>(m.priority));
+  }
+
+  w.write(static_cast<uint32_t>(state.enabledArchives.size()));
+  for (const auto& a : state.enabledArchives) {
+    w.write(a);
+  }
+
+  w.write(static_cast<uint32_t>(state.loadOrder.size()));
+  for (const auto& p : state.loadOrder) {
+    w.write(std::wstring_view(p));
+  }
+}
+
+void writeOrigins(SnapshotWriter& w, const DirectoryEntry& root)
+{
+  std::vector<const FilesOrigin*> origins;
+
+  root.getOriginConnection()->forEachOrigin([&](const FilesOrigin& o) {
+    origins.push_back(&o);
+  });
+
+  w.write(static_cast<uint32_t>(origins.size()));
+
+  for (const auto* o : origins) {
+    const auto& fp = o->fingerprint();
+
+    w.write(static_cast<int32_t>(o->getID()));
+    w.write(std::wstring_view(o->getName()));
+    w.write(std::wstring_view(o->getPath()));
+    w.write(static_cast<int32_t>(o->getPriority()));
+    w.write(static_cast<uint64_t>(fp.dirs));
+    w.write(static_cast<uint64_t>(fp.files));
+    w.write(static_cast<uint64_t>(fp.hash));
+  }
+}
+
+void writeArchive(
+  SnapshotWriter& w, const FileEntry& f, const DataArchiveOrigin& a)
+{
+  w.write(f.getArchiveName(a));
+  w.write(static_cast<int32_t>(a.order()));
+}
+
+void writeDirectory(SnapshotWriter& w, const DirectoryEntry& d)
+{
+  // origins that have something in this directory, used by anyOrigin()
+  const auto origins = d.getOrigins();
+  w.write(static_cast<uint32_t>(origins.size()));
+
+  for (const auto id : origins) {
+    w.write(static_cast<int32_t>(id));
+  }
+
+  std::vector<const FileEntry*> files;
+
+  d.forEachFile([&](const FileEntry& f) {
+    files.push_back(&f);
+    return true;
+  });
+
+  w.write(static_cast<uint32_t>(files.size()));
+
+  for (const auto* f : files) {
+    const auto ft = f->getFileTime();
+
+    w.write(std::wstring_view(f->getName()));
+    w.write(static_cast<int32_t>(f->getOrigin()));
+    writeArchive(w, *f, f->getArchive());
+    w.write(static_cast<uint32_t>(ft.dwLowDateTime));
+    w.write(static_cast<uint32_t>(ft.dwHighDateTime));
+    w.write(static_cast<uint64_t>(f->getFileSize()));
+    w.write(static_cast<uint64_t>(f->getCompressedFileSize()));
+
+    const auto& alts = f->getAlternatives();
+    w.write(static_cast<uint32_t>(alts.size()));
+
+    for (const auto& alt : alts) {
+      w.write(static_cast<int32_t>(alt.originID()));
+      writeArchive(w, *f, alt.archive());
+    }
+  }
+
+  const auto& dirs = d.getSubDirectories();
+  w.write(static_cast<uint32_t>(dirs.size()));
+
+  for (const auto* sd : dirs) {
+    w.write(std::wstring_view(sd->getName()));
+    writeDirectory(w, *sd);
+  }
+}
+
+
+void readState(SnapshotReader& r, DirectorySnapshot::State& state)
+{
+  state.dataDirectory = r.readString();
+
+  const auto modCount = r.read<uint32_t>();
+  for (uint32_t i=0; i<modCount; ++i) {
+    const auto name = r.readQString();
+    const auto path = r.readQString();
+    const auto stealFiles = r.readQStringList();
+    const auto archives = r.readQStringList();
+    const auto priority = r.read<int32_t>();
+
+    state.mods.push_back({name, path, stealFiles, archives, priority});
+  }
+
+  const auto archiveCount = r.read<uint32_t>();
+  for (uint32_t i=0; i<archiveCount; ++i) {
+    state.enabledArchives.insert(r.readQString());
+  }
+
+  const auto pluginCount = r.read<uint32_t>();
+  for (uint32_t i=0; i<pluginCount; ++i) {
+    state.loadOrder.push_back(r.readString());
+  }
+}
+
+// maps the origin IDs in the snapshot to the origins created in the new
+// structure
+//
+using OriginMap = std::vector<OriginID>;
+
+OriginMap readOrigins(SnapshotReader& r, DirectoryEntry& root)
+{
+  OriginMap map;
+
+  const auto count = r.read<uint32_t>();
+
+  for (uint32_t i=0; i<count; ++i) {
+    const auto id = r.read<int32_t>();
+    const auto name = r.readString();
+    const auto path = r.readString();
+    const auto priority = r.read<int32_t>();
+
+    OriginFingerprint fp;
+    fp.dirs = static_cast<std::size_t>(r.read<uint64_t>());
+    fp.files = static_cast<std::size_t>(r.read<uint64_t>());
+    fp.hash = static_cast<std::size_t>(r.read<uint64_t>());
+
+    // structures built by a full refresh have sequential origin IDs
+    if (id < 0 || static_cast<uint32_t>(id) >= count) {
+      throw SnapshotError(fmt::format("bad origin id {}", id));
+    }
+
+    DirectoryStats dummy;
+    FilesOrigin& o = root.createOrigin(name, path, priority, dummy);
+    o.setFingerprint(fp);
+
+    if (static_cast<std::size_t>(id) >= map.size()) {
+      map.resize(id + 1, InvalidOriginID);
+    }
+
+    map[id] = o.getID();
+  }
+
+  return map;
+}
+
+OriginID readOriginID(SnapshotReader& r, const OriginMap& map)
+{
+  const auto id = r.read<int32_t>();
+
+  if (id < 0 || static_cast<std::size_t>(id) >= map.size() ||
+      map[id] == InvalidOriginID) {
+    throw SnapshotError(fmt::format("bad origin id {}", id));
+  }
+
+  return map[id];
+}
+
+DataArchiveOrigin readArchive(SnapshotReader& r, ArchiveRegistry& archives)
+{
+  const auto name = r.readStringView();
+  const auto order = r.read<int32_t>();
+
+  return {archives.intern(name), order};
+}
+
+void readDirectory(SnapshotReader& r, DirectoryEntry& d, const OriginMap& map)
+{
+  auto& archives = d.getFileRegister()->archives();
+
+  const auto originCount = r.read<uint32_t>();
+  std::vector<OriginID> origins;
+  origins.reserve(originCount);
+
+  for (uint32_t i=0; i<originCount; ++i) {
+    origins.push_back(readOriginID(r, map));
+  }
+
+  d.addOrigins(origins);
+
+  const auto fileCount = r.read<uint32_t>();
+
+  for (uint32_t i=0; i<fileCount; ++i) {
+    const auto name = r.readStringView();
+    const auto origin = readOriginID(r, map);
+    const auto archive = readArchive(r, archives);
+
+    FILETIME ft;
+    ft.dwLowDateTime = r.read<uint32_t>();
+    ft.dwHighDateTime = r.read<uint32_t>();
+
+    const auto size = r.read<uint64_t>();
+    const auto compressedSize = r.read<uint64_t>();
+
+    AlternativesVector alts;
+    const auto altCount = r.read<uint32_t>();
+    alts.reserve(altCount);
+
+    for (uint32_t j=0; j<altCount; ++j) {
+      const auto altOrigin = readOriginID(r, map);
+      alts.push_back({altOrigin, readArchive(r, archives)});
+    }
+
+    auto f = d.addResolvedFile(name, origin, archive, std::move(alts), ft);
+
+    f->setFileSize(size, compressedSize);
+  }
+
+  const auto dirCount = r.read<uint32_t>();
+
+  for (uint32_t i=0; i<dirCount; ++i) {
+    const auto name = r.readStringView();
+    auto* sd = d.addSubDirectory(name, InvalidOriginID);
+    readDirectory(r, *sd, map);
+  }
+}
+
+
+QString DirectorySnapshot::path()
+{
+  return
+    qApp->property("dataPath").toString() + "/" +
+    QString::fromStdWString(AppConfig::directorySnapshotFileName());
+}
+
+bool DirectorySnapshot::save(
+  const QString& path, const DirectoryEntry& root, const State& state)
+{
+  TimeThis tt("DirectorySnapshot::save()");
+
+  try
+  {
+    QSaveFile f(path);
+
+    if (!f.open(QIODevice::WriteOnly)) {
+      throw SnapshotError(f.errorString().toStdString());
+    }
+
+    SnapshotWriter w(f);
+
+    w.write(SnapshotMagic);
+    w.write(SnapshotVersion);
+
+    writeState(w, state);
+    writeOrigins(w, root);
+    writeDirectory(w, root);
+
+    w.flush();
+
+    if (!f.commit()) {
+      throw SnapshotError(f.errorString().toStdString());
+    }
+
+    return true;
+  }
+  catch(std::exception& e)
+  {
+    log::error("failed to save directory snapshot to '{}': {}", path, e.what());
+    return false;
+  }
+}
+
+std::unique_ptr<DirectoryEntry> DirectorySnapshot::load(
+  const QString& path, State& state)
+{
+  TimeThis tt("DirectorySnapshot::load()");
+
+  QFile f(path);
+
+  if (!f.exists()) {
+    return {};
+  }
+
+  try
+  {
+    if (!f.open(QIODevice::ReadOnly)) {
+      throw SnapshotError(f.errorString().toStdString());
+    }
+
+    const auto size = f.size();
+    const uchar* p = f.map(0, size);
+
+    if (!p) {
+      throw SnapshotError(f.errorString().toStdString());
+    }
+
+    SnapshotReader r(p, p + size);
+
+    if (r.read<uint32_t>() != SnapshotMagic) {
+      throw SnapshotError("not a snapshot");
+    }
+
+    if (const auto v=r.read<uint32_t>(); v != SnapshotVersion) {
+      log::debug(
+        "ignoring directory snapshot '{}', version {} instead of {}",
+        path, v, SnapshotVersion);
+
+      return {};
+    }
+
+    std::unique_ptr<DirectoryEntry> root(new DirectoryEntry(L"data", nullptr, 0));
+
+    State s;
+    readState(r, s);
+
+    const auto map = readOrigins(r, *root);
+    readDirectory(r, *root, map);
+    root->freeze();
+
+    state = std::move(s);
+    return root;
+  }
+  catch(std::exception& e)
+  {
+    log::error("failed to load directory snapshot '{}': {}", path, e.what());
+    return {};
+  }
+}
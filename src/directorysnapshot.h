@@ -0,0 +1,45 @@
+#ifndef MODORGANIZER_DIRECTORYSNAPSHOT_INCLUDED
+#define MODORGANIZER_DIRECTORYSNAPSHOT_INCLUDED
+
+#include "directoryrefresher.h"
+#include "shared/fileregisterfwd.h"
+
+// saves a finished directory structure to a binary file in the instance
+// directory so it can be loaded on the next start instead of walking all the
+// mods and parsing all the archives again
+//
+// the snapshot also contains the list of mods the structure was built from
+// and the fingerprint of every origin; the refresher uses those to rescan only
+// the origins that have changed on disk since the snapshot was saved
+//
+class DirectorySnapshot
+{
+public:
+  // what the structure was built from
+  //
+  struct State
+  {
+    std::wstring dataDirectory;
+    std::vector<DirectoryRefresher::EntryInfo> mods;
+    std::set<QString> enabledArchives;
+    std::vector<std::wstring> loadOrder;
+  };
+
+  // path to the snapshot file for the current instance
+  //
+  static QString path();
+
+  // writes the given structure atomically, returns false on errors
+  //
+  static bool save(
+    const QString& path, const MOShared::DirectoryEntry& root,
+    const State& state);
+
+  // loads a snapshot, returns null if the file doesn't exist, is from a
+  // different version or is corrupted
+  //
+  static std::unique_ptr<MOShared::DirectoryEntry> load(
+    const QString& path, State& state);
+};
+
+#endif // MODORGANIZER_DIRECTORYSNAPSHOT_INCLUDED
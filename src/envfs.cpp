@@ -217,8 +217,8 @@ void setHandleCloserThreadCount(std::size_t n)
 }
 
 void forEachEntryImpl(
-  void* cx, HandleCloserThread& hc, std::vector<std::unique_ptr<unsigned char[]>>& buffers,
-  POBJECT_ATTRIBUTES poa, std::size_t depth,
+  void* cx, HandleCloserThread* hc, std::vector<std::unique_ptr<unsigned char[]>>& buffers,
+  POBJECT_ATTRIBUTES poa, std::size_t depth, bool recurse,
   DirStartF* dirStartF, DirEndF* dirEndF, FileF* fileF)
 {
   IO_STATUS_BLOCK iosb;
@@ -238,7 +238,10 @@ void forEachEntryImpl(
     return;
   }
 
-  hc.add(oa.RootDirectory);
+  if (hc) {
+    hc->add(oa.RootDirectory);
+  }
+
   unsigned char* buffer;
 
   if (depth >= buffers.size()) {
@@ -298,9 +301,13 @@ void forEachEntryImpl(
         ObjectName.MaximumLength = ObjectName.Length;
 
         if (DirInfo->FileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
-          if (dirStartF && dirEndF) {
+          if (!recurse) {
+            if (dirStartF) {
+              dirStartF(cx, toStringView(&oa));
+            }
+          } else if (dirStartF && dirEndF) {
             dirStartF(cx, toStringView(&oa));
-            forEachEntryImpl(cx, hc, buffers, &oa, depth+1, dirStartF, dirEndF, fileF);
+            forEachEntryImpl(cx, hc, buffers, &oa, depth+1, true, dirStartF, dirEndF, fileF);
             dirEndF(cx, toStringView(&oa));
           }
         } else {
@@ -319,6 +326,10 @@ void forEachEntryImpl(
       }
     }
   }
+
+  if (!hc) {
+    NtClose(oa.RootDirectory);
+  }
 }
 
 
@@ -326,8 +337,19 @@ void DirectoryWalker::forEachEntry(
   const std::wstring& path, void* cx,
   DirStartF* dirStartF, DirEndF* dirEndF, FileF* fileF)
 {
-  auto& hc = g_handleClosers.request();
+  walk(path, cx, true, dirStartF, dirEndF, fileF);
+}
+
+void DirectoryWalker::forEachEntryInDirectory(
+  const std::wstring& path, void* cx, DirStartF* dirF, FileF* fileF)
+{
+  walk(path, cx, false, dirF, nullptr, fileF);
+}
 
+void DirectoryWalker::walk(
+  const std::wstring& path, void* cx, bool recurse,
+  DirStartF* dirStartF, DirEndF* dirEndF, FileF* fileF)
+{
   if (!NtOpenFile) {
     LibraryPtr m(::LoadLibraryW(L"ntdll.dll"));
     NtOpenFile = (NtOpenFile_type)::GetProcAddress(m.get(), "NtOpenFile");
@@ -346,8 +368,15 @@ void DirectoryWalker::forEachEntry(
   oa.Length = sizeof(oa);
   oa.ObjectName = &ObjectName;
 
-  forEachEntryImpl(cx, hc, m_buffers, &oa, 0, dirStartF, dirEndF, fileF);
-  hc.wakeup();
+  if (recurse) {
+    // closing handles is slow, a full walk opens one per directory and hands
+    // them all to a closer thread at the end
+    auto& hc = g_handleClosers.request();
+    forEachEntryImpl(cx, &hc, m_buffers, &oa, 0, true, dirStartF, dirEndF, fileF);
+    hc.wakeup();
+  } else {
+    forEachEntryImpl(cx, nullptr, m_buffers, &oa, 0, false, dirStartF, dirEndF, fileF);
+  }
 }
 
 
@@ -394,9 +423,7 @@ Directory getFilesAndDirs(const std::wstring& path)
 }
 
 File::File(std::wstring_view n, FILETIME ft, uint64_t s) :
-  name(n.begin(), n.end()),
-  lcname(MOShared::ToLowerCopy(name)),
-  lastModified(ft), size(s)
+  name(n.begin(), n.end()), lastModified(ft), size(s)
 {
 }
 
@@ -405,7 +432,7 @@ Directory::Directory()
 }
 
 Directory::Directory(std::wstring_view n)
-  : name(n.begin(), n.end()), lcname(MOShared::ToLowerCopy(name))
+  : name(n.begin(), n.end())
 {
 }
 
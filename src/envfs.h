@@ -10,7 +10,6 @@ namespace env
 struct File
 {
   std::wstring name;
-  std::wstring lcname;
   FILETIME lastModified;
   uint64_t size;
 
@@ -20,7 +19,6 @@ struct File
 struct Directory
 {
   std::wstring name;
-  std::wstring lcname;
 
   std::vector<Directory> dirs;
   std::vector<File> files;
@@ -46,7 +44,13 @@ public:
 
   void setMax(std::size_t n)
   {
-    m_threads.resize(n);
+    while (m_threads.size() < n) {
+      m_threads.emplace_back(*this);
+    }
+
+    while (m_threads.size() > n) {
+      m_threads.pop_back();
+    }
   }
 
   void stopAndJoin()
@@ -65,22 +69,17 @@ public:
 
   void waitForAll()
   {
-    for (;;) {
-      bool done = true;
+    std::unique_lock lock(m_idleMutex);
 
+    m_idle.wait(lock, [&] {
       for (auto& ti : m_threads) {
         if (ti.busy) {
-          done = false;
-          break;
+          return false;
         }
       }
 
-      if (done) {
-        break;
-      }
-
-      std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    }
+      return true;
+    });
   }
 
   T& request()
@@ -99,7 +98,18 @@ public:
         }
       }
 
-      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      // all threads are busy, wait until one of them finishes
+      std::unique_lock lock(m_idleMutex);
+
+      m_idle.wait(lock, [&] {
+        for (auto& ti : m_threads) {
+          if (!ti.busy) {
+            return true;
+          }
+        }
+
+        return false;
+      });
     }
   }
 
@@ -114,6 +124,7 @@ public:
 private:
   struct ThreadInfo
   {
+    ThreadPool& pool;
     std::thread thread;
     std::atomic<bool> busy;
     T o;
@@ -124,8 +135,8 @@ private:
 
     std::atomic<bool> stop;
 
-    ThreadInfo()
-      : busy(true), ready(false), stop(false)
+    ThreadInfo(ThreadPool& p)
+      : pool(p), busy(true), ready(false), stop(false)
     {
       thread = MOShared::startSafeThread([&]{ run(); });
     }
@@ -151,7 +162,7 @@ private:
 
     void run()
     {
-      busy = false;
+      setIdle();
 
       while (!stop) {
         std::unique_lock lock(mutex);
@@ -164,11 +175,27 @@ private:
         o.run();
 
         ready = false;
+        setIdle();
+      }
+    }
+
+    void setIdle()
+    {
+      {
+        // the lock makes sure a thread in request() or waitForAll() is either
+        // already waiting or will see the new value
+        std::scoped_lock lock(pool.m_idleMutex);
         busy = false;
       }
+
+      pool.m_idle.notify_all();
     }
   };
 
+  // notified every time a thread becomes idle
+  std::mutex m_idleMutex;
+  std::condition_variable m_idle;
+
   std::list<ThreadInfo> m_threads;
 };
 
@@ -187,8 +214,18 @@ public:
     const std::wstring& path, void* cx,
     DirStartF* dirStartF, DirEndF* dirEndF, FileF* fileF);
 
+  // only lists the entries directly inside the given directory, dirF is
+  // called for each subdirectory
+  //
+  void forEachEntryInDirectory(
+    const std::wstring& path, void* cx, DirStartF* dirF, FileF* fileF);
+
 private:
   std::vector<std::unique_ptr<unsigned char[]>> m_buffers;
+
+  void walk(
+    const std::wstring& path, void* cx, bool recurse,
+    DirStartF* dirStartF, DirEndF* dirEndF, FileF* fileF);
 };
 
 
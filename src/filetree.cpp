@@ -6,6 +6,7 @@
 #include "shared/fileentry.h"
 #include "shared/directoryentry.h"
 #include "shared/filesorigin.h"
+#include "shared/util.h"
 #include <log.h>
 #include <widgetutility.h>
 
@@ -16,22 +17,22 @@ using namespace MOBase;
 bool canPreviewFile(const PluginContainer& pc, const FileEntry& file)
 {
   return canPreviewFile(
-    pc, file.isFromArchive(), QString::fromStdWString(file.getName()));
+    pc, file.isFromArchive(), ToQString(file.getName()));
 }
 
 bool canRunFile(const FileEntry& file)
 {
-  return canRunFile(file.isFromArchive(), QString::fromStdWString(file.getName()));
+  return canRunFile(file.isFromArchive(), ToQString(file.getName()));
 }
 
 bool canOpenFile(const FileEntry& file)
 {
-  return canOpenFile(file.isFromArchive(), QString::fromStdWString(file.getName()));
+  return canOpenFile(file.isFromArchive(), ToQString(file.getName()));
 }
 
 bool isHidden(const FileEntry& file)
 {
-  return (QString::fromStdWString(file.getName()).endsWith(ModInfo::s_HiddenExt, Qt::CaseInsensitive));
+  return (ToQString(file.getName()).endsWith(ModInfo::s_HiddenExt, Qt::CaseInsensitive));
 }
 
 bool canExploreFile(const FileEntry& file);
@@ -715,14 +715,14 @@ bool FileTreeModel::addNewDirectories(
     } else {
       if (!shouldShowFolder(*d, nullptr)) {
         // this is a new directory, but it doesn't contain anything interesting
-        trace(log::debug("new dir {}, empty and pruned", QString::fromStdWString(d->getName())));
+        trace(log::debug("new dir {}, empty and pruned", ToQString(d->getName())));
 
         // act as if this directory doesn't exist at all
         continue;
       }
 
       // this is a new directory
-      trace(log::debug("new dir {}", QString::fromStdWString(d->getName())));
+      trace(log::debug("new dir {}", ToQString(d->getName())));
 
       toAdd.push_back(createDirectoryItem(parentItem, parentPath, *d));
       added = true;
@@ -847,7 +847,7 @@ bool FileTreeModel::addNewFiles(
 
       if (shouldShowFile(*file)) {
         // this is a new file
-        trace(log::debug("new file {}", QString::fromStdWString(file->getName())));
+        trace(log::debug("new file {}", ToQString(file->getName())));
 
         toAdd.push_back(createFileItem(parentItem, parentPath, *file));
         added = true;
@@ -855,7 +855,7 @@ bool FileTreeModel::addNewFiles(
         range.includeCurrent();
       } else {
         // this is a new file, but it shouldn't be shown
-        trace(log::debug("new file {}, not shown", QString::fromStdWString(file->getName())));
+        trace(log::debug("new file {}, not shown", ToQString(file->getName())));
         return true;
       }
     }
@@ -929,7 +929,7 @@ FileTreeItem::Ptr FileTreeModel::createDirectoryItem(
   const DirectoryEntry& d)
 {
   auto item = FileTreeItem::createDirectory(
-    this, &parentItem, parentPath, d.getName());
+    this, &parentItem, parentPath, std::wstring(d.getName()));
 
   if (d.isEmpty()) {
     // if this directory is empty, mark the item as loaded so the expand
@@ -945,7 +945,7 @@ FileTreeItem::Ptr FileTreeModel::createFileItem(
   const FileEntry& file)
 {
   auto item = FileTreeItem::createFile(
-    this, &parentItem, parentPath, file.getName());
+    this, &parentItem, parentPath, std::wstring(file.getName()));
 
   updateFileItem(*item, file);
 
@@ -1128,9 +1128,9 @@ std::wstring FileTreeModel::makeModName(
 
   std::wstring name = origin.getName();
 
-  const auto& archive = file.getArchive();
-  if (!archive.name().empty()) {
-    name += L" (" + archive.name() + L")";
+  const auto archive = file.getArchiveName();
+  if (!archive.empty()) {
+    name += L" (" + std::wstring(archive) + L")";
   }
 
   return name;
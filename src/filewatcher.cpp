@@ -0,0 +1,368 @@
+#include "filewatcher.h"
+#include "envmodule.h"
+#include "thread_utils.h"
+#include "shared/util.h"
+#include <log.h>
+#include <utility.h>
+#include <QDir>
+
+using namespace MOBase;
+
+// how long to wait for more changes before reporting them
+constexpr std::chrono::milliseconds CoalesceDelay(250);
+
+// longest time changes are kept before reporting them, even if more keep
+// coming
+constexpr std::chrono::milliseconds MaxCoalesceDelay(2000);
+
+// size of the buffer given to ReadDirectoryChangesW() for each root
+constexpr std::size_t ChangesBufferSize = 64 * 1024;
+
+
+struct ReadDirectoryChangesBackend::Root
+{
+  std::wstring path;
+  env::HandlePtr dir;
+  env::HandlePtr event;
+  OVERLAPPED ov = {};
+  bool pending = false;
+
+  // must be DWORD-aligned
+  std::vector<DWORD> buffer;
+};
+
+
+ReadDirectoryChangesBackend::ReadDirectoryChangesBackend()
+  : m_stop(::CreateEventW(nullptr, TRUE, FALSE, nullptr))
+{
+}
+
+ReadDirectoryChangesBackend::~ReadDirectoryChangesBackend()
+{
+  stop();
+  ::CloseHandle(m_stop);
+}
+
+void ReadDirectoryChangesBackend::start(
+  const std::vector<std::wstring>& roots,
+  ChangeCallback change, OverflowCallback overflow)
+{
+  stop();
+
+  m_change = std::move(change);
+  m_overflow = std::move(overflow);
+
+  for (const auto& path : roots) {
+    auto r = std::make_unique<Root>();
+    r->path = path;
+
+    // roots that can't be opened are kept so the indices stay the same
+    const HANDLE h = ::CreateFileW(
+      path.c_str(), FILE_LIST_DIRECTORY,
+      FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+      nullptr, OPEN_EXISTING,
+      FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+
+    if (h == INVALID_HANDLE_VALUE) {
+      const auto e = ::GetLastError();
+      log::error("can't watch '{}', {}", path, formatSystemMessage(e));
+    } else {
+      r->dir.reset(h);
+      r->event.reset(::CreateEventW(nullptr, TRUE, FALSE, nullptr));
+      r->buffer.resize(ChangesBufferSize / sizeof(DWORD));
+    }
+
+    m_roots.push_back(std::move(r));
+  }
+
+  ::ResetEvent(m_stop);
+  m_thread = MOShared::startSafeThread([&]{ run(); });
+}
+
+void ReadDirectoryChangesBackend::stop()
+{
+  if (m_thread.joinable()) {
+    ::SetEvent(m_stop);
+    m_thread.join();
+  }
+
+  m_roots.clear();
+}
+
+void ReadDirectoryChangesBackend::run()
+{
+  MOShared::SetThisThreadName("FileWatcher");
+
+  // event handles to wait on and the root they belong to, the stop event is
+  // last
+  std::vector<HANDLE> handles;
+  std::vector<std::size_t> indices;
+
+  for (std::size_t i=0; i<m_roots.size(); ++i) {
+    auto& r = *m_roots[i];
+
+    if (r.dir && read(r)) {
+      handles.push_back(r.event.get());
+      indices.push_back(i);
+    }
+  }
+
+  handles.push_back(m_stop);
+
+  for (;;) {
+    const auto w = ::WaitForMultipleObjects(
+      static_cast<DWORD>(handles.size()), handles.data(), FALSE, INFINITE);
+
+    if (w < WAIT_OBJECT_0 || w >= WAIT_OBJECT_0 + handles.size()) {
+      const auto e = ::GetLastError();
+      log::error("file watcher: wait failed, {}", formatSystemMessage(e));
+      break;
+    }
+
+    const auto h = w - WAIT_OBJECT_0;
+    if (h == handles.size() - 1) {
+      // stop event
+      break;
+    }
+
+    auto& r = *m_roots[indices[h]];
+
+    DWORD bytes = 0;
+    if (!::GetOverlappedResult(r.dir.get(), &r.ov, &bytes, FALSE)) {
+      const auto e = ::GetLastError();
+      log::error("file watcher: can't read changes for '{}', {}", r.path, formatSystemMessage(e));
+      bytes = 0;
+    }
+
+    r.pending = false;
+    ::ResetEvent(r.event.get());
+
+    process(indices[h], r, bytes);
+
+    // if this fails, the event is never signalled again and the root is
+    // effectively not watched anymore
+    read(r);
+  }
+
+  // the pending reads must be cancelled before the buffers are freed
+  for (auto& r : m_roots) {
+    if (r->pending) {
+      DWORD bytes = 0;
+      ::CancelIoEx(r->dir.get(), &r->ov);
+      ::GetOverlappedResult(r->dir.get(), &r->ov, &bytes, TRUE);
+      r->pending = false;
+    }
+  }
+}
+
+bool ReadDirectoryChangesBackend::read(Root& r)
+{
+  r.ov = {};
+  r.ov.hEvent = r.event.get();
+
+  const DWORD filter =
+    FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_DIR_NAME |
+    FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE;
+
+  const auto ok = ::ReadDirectoryChangesW(
+    r.dir.get(), r.buffer.data(),
+    static_cast<DWORD>(r.buffer.size() * sizeof(DWORD)),
+    TRUE, filter, nullptr, &r.ov, nullptr);
+
+  if (!ok) {
+    const auto e = ::GetLastError();
+    log::error("can't watch '{}', {}", r.path, formatSystemMessage(e));
+    return false;
+  }
+
+  r.pending = true;
+  return true;
+}
+
+void ReadDirectoryChangesBackend::process(
+  std::size_t root, Root& r, DWORD bytes)
+{
+  if (bytes == 0) {
+    // the buffer overflowed, the changes are lost
+    m_overflow(root);
+    return;
+  }
+
+  const auto* p = reinterpret_cast<const char*>(r.buffer.data());
+
+  for (;;) {
+    const auto* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(p);
+
+    // renames give both the old and the new names, they're both reported as
+    // changed
+    m_change(root, std::wstring(
+      info->FileName, info->FileNameLength / sizeof(wchar_t)));
+
+    if (info->NextEntryOffset == 0) {
+      break;
+    }
+
+    p += info->NextEntryOffset;
+  }
+}
+
+
+FileWatcher::FileWatcher(std::unique_ptr<FileWatcherBackend> backend)
+  : m_backend(std::move(backend)), m_overflowed(false), m_generation(0)
+{
+  if (!m_backend) {
+    m_backend = std::make_unique<ReadDirectoryChangesBackend>();
+  }
+
+  m_timer.setSingleShot(true);
+  m_timer.setInterval(CoalesceDelay);
+
+  connect(&m_timer, &QTimer::timeout, [&]{ flush(); });
+}
+
+FileWatcher::~FileWatcher()
+{
+  stop();
+}
+
+void FileWatcher::watch(
+  const QString& modsDirectory, const QString& overwrite,
+  const QString& dataDirectory)
+{
+  std::vector<WatchedRoot> roots = {
+    {QDir::toNativeSeparators(modsDirectory).toStdWString(), true},
+    {QDir::toNativeSeparators(overwrite).toStdWString(), false},
+    {QDir::toNativeSeparators(dataDirectory).toStdWString(), false}
+  };
+
+  const bool same = std::equal(
+    roots.begin(), roots.end(), m_roots.begin(), m_roots.end(),
+    [](auto&& a, auto&& b) { return a.path == b.path; });
+
+  if (same) {
+    return;
+  }
+
+  stop();
+
+  m_roots = std::move(roots);
+
+  std::vector<std::wstring> paths;
+  for (const auto& r : m_roots) {
+    log::debug("watching '{}'", r.path);
+    paths.push_back(r.path);
+  }
+
+  const auto generation = m_generation;
+
+  // the callbacks are called from the thread of the backend
+  m_backend->start(paths,
+    [this, generation](std::size_t root, std::wstring path) {
+      QMetaObject::invokeMethod(this, [this, generation, root, path=std::move(path)] {
+        onChange(generation, root, path);
+      }, Qt::QueuedConnection);
+    },
+
+    [this, generation](std::size_t root) {
+      QMetaObject::invokeMethod(this, [this, generation, root] {
+        onOverflow(generation, root);
+      }, Qt::QueuedConnection);
+    });
+}
+
+void FileWatcher::stop()
+{
+  m_backend->stop();
+
+  // callbacks that were already queued are ignored
+  ++m_generation;
+
+  m_roots.clear();
+  m_pending.clear();
+  m_overflowed = false;
+  m_timer.stop();
+}
+
+void FileWatcher::onChange(
+  std::size_t generation, std::size_t root, const std::wstring& path)
+{
+  if (generation != m_generation || root >= m_roots.size()) {
+    // from a previous watch()
+    return;
+  }
+
+  const auto& r = m_roots[root];
+
+  std::wstring originPath = r.path;
+  std::wstring relativePath = path;
+
+  if (r.container) {
+    // the first component is the name of the mod
+    const auto sep = path.find_first_of(L"\\/");
+
+    originPath.append(L"\\").append(path.substr(0, sep));
+
+    if (sep == std::wstring::npos) {
+      // the mod directory itself
+      relativePath.clear();
+    } else {
+      relativePath = path.substr(sep + 1);
+    }
+  }
+
+  auto& paths = m_pending[MOShared::ToLowerCopy(originPath)];
+
+  if (relativePath.empty()) {
+    // the whole origin, anything else is redundant
+    paths.clear();
+    paths.insert({});
+  } else if (!paths.contains({})) {
+    paths.insert(relativePath);
+  }
+
+  delayFlush();
+}
+
+void FileWatcher::onOverflow(std::size_t generation, std::size_t root)
+{
+  if (generation != m_generation || root >= m_roots.size()) {
+    return;
+  }
+
+  log::debug("file watcher: too many changes in '{}'", m_roots[root].path);
+
+  m_overflowed = true;
+  delayFlush();
+}
+
+void FileWatcher::delayFlush()
+{
+  if (!m_timer.isActive()) {
+    m_pendingSince.start();
+  } else if (m_pendingSince.elapsed() >= MaxCoalesceDelay.count()) {
+    // changes have been coming for a while, let the timer fire
+    return;
+  }
+
+  m_timer.start();
+}
+
+void FileWatcher::flush()
+{
+  if (m_overflowed) {
+    m_overflowed = false;
+    m_pending.clear();
+
+    emit overflowed();
+    return;
+  }
+
+  if (m_pending.empty()) {
+    return;
+  }
+
+  Changes changes;
+  std::swap(changes, m_pending);
+
+  emit changed(changes);
+}
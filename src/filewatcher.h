@@ -0,0 +1,142 @@
+#ifndef MODORGANIZER_FILEWATCHER_INCLUDED
+#define MODORGANIZER_FILEWATCHER_INCLUDED
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QTimer>
+#include <functional>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+// watches directories recursively and reports every path that was created,
+// modified, removed or renamed; implementations call the callbacks from their
+// own thread
+//
+class FileWatcherBackend
+{
+public:
+  // `root` is the index of the watched directory, `path` is relative to it
+  using ChangeCallback = std::function<void (std::size_t root, std::wstring path)>;
+
+  // called when changes were lost, such as when a buffer overflowed; the
+  // whole root must be considered changed
+  using OverflowCallback = std::function<void (std::size_t root)>;
+
+  virtual ~FileWatcherBackend() = default;
+
+  // starts watching the given directories, stops watching the previous ones
+  //
+  virtual void start(
+    const std::vector<std::wstring>& roots,
+    ChangeCallback change, OverflowCallback overflow) = 0;
+
+  // stops watching, no callbacks are called after this returns
+  //
+  virtual void stop() = 0;
+};
+
+
+// backend using ReadDirectoryChangesW(), one thread for all the roots
+//
+class ReadDirectoryChangesBackend : public FileWatcherBackend
+{
+public:
+  ReadDirectoryChangesBackend();
+  ~ReadDirectoryChangesBackend();
+
+  void start(
+    const std::vector<std::wstring>& roots,
+    ChangeCallback change, OverflowCallback overflow) override;
+
+  void stop() override;
+
+private:
+  struct Root;
+
+  std::vector<std::unique_ptr<Root>> m_roots;
+  ChangeCallback m_change;
+  OverflowCallback m_overflow;
+  HANDLE m_stop;
+  std::thread m_thread;
+
+  void run();
+  bool read(Root& r);
+  void process(std::size_t root, Root& r, DWORD bytes);
+};
+
+
+// watches the mods directory, the overwrite directory and the data directory
+// of the game, and reports the changes grouped by origin
+//
+// events are coalesced: changes are accumulated until nothing has happened
+// for a short delay and are then reported all at once; changes that keep
+// coming are still reported once they've been pending for a longer delay
+//
+class FileWatcher : public QObject
+{
+  Q_OBJECT;
+
+public:
+  // paths that changed in each origin, relative to the origin directory;
+  // keyed by the lowercase path of the origin directory
+  //
+  using Changes = std::map<std::wstring, std::set<std::wstring>>;
+
+  explicit FileWatcher(std::unique_ptr<FileWatcherBackend> backend={});
+  ~FileWatcher();
+
+  // starts watching the given directories, does nothing if they're already
+  // being watched
+  //
+  // every directory inside `modsDirectory` is an origin, `overwrite` and
+  // `dataDirectory` are origins themselves
+  //
+  void watch(
+    const QString& modsDirectory, const QString& overwrite,
+    const QString& dataDirectory);
+
+  void stop();
+
+signals:
+  // paths that changed since the last signal
+  void changed(const FileWatcher::Changes& changes);
+
+  // some changes were lost, everything must be rescanned
+  void overflowed();
+
+private:
+  struct WatchedRoot
+  {
+    std::wstring path;
+    bool container;
+  };
+
+  std::unique_ptr<FileWatcherBackend> m_backend;
+  std::vector<WatchedRoot> m_roots;
+  Changes m_pending;
+  bool m_overflowed;
+  QTimer m_timer;
+
+  // started when the first change is pending
+  QElapsedTimer m_pendingSince;
+
+  // incremented every time the roots change, the callbacks queued by the
+  // backend are tagged with it so the ones for previous roots are dropped
+  std::size_t m_generation;
+
+  void onChange(
+    std::size_t generation, std::size_t root, const std::wstring& path);
+
+  void onOverflow(std::size_t generation, std::size_t root);
+
+  // restarts the timer so it fires when nothing has changed for a while
+  void delayFlush();
+
+  void flush();
+};
+
+#endif // MODORGANIZER_FILEWATCHER_INCLUDED
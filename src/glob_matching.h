@@ -95,7 +95,7 @@ namespace MOShared {
 
       constexpr bool match(
         string_view_type const& str,
-        bool case_sensitive = false)
+        bool case_sensitive = false) const
       {
         // Empty pattern can only match with empty sting
         if (traits::empty(v))
@@ -84,6 +84,8 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 #include "shared/directoryentry.h"
 #include "shared/fileentry.h"
 #include "shared/filesorigin.h"
+#include "shared/originconnection.h"
+#include "shared/util.h"
 
 #include <QAbstractItemDelegate>
 #include <QAction>
@@ -386,6 +388,8 @@ MainWindow::MainWindow(Settings &settings
 
   connect(&m_OrganizerCore, &OrganizerCore::directoryStructureReady,
     this, &MainWindow::onDirectoryStructureChanged);
+  connect(&m_OrganizerCore, &OrganizerCore::directoryStructureChanged,
+    this, &MainWindow::onDirectoryStructureChanged);
   connect(m_OrganizerCore.directoryRefresher(), &DirectoryRefresher::progress,
     this, &MainWindow::refresherProgress);
   connect(m_OrganizerCore.directoryRefresher(), SIGNAL(error(QString)), this, SLOT(showError(QString)));
@@ -1726,7 +1730,7 @@ void MainWindow::updateBSAList(const QStringList &defaultArchives, const QString
   };
 
   for (FileEntryPtr current : files) {
-    QFileInfo fileInfo(ToQString(current->getName().c_str()));
+    QFileInfo fileInfo(ToQString(current->getName()));
 
     if (fileInfo.suffix().toLower() == "bsa" || fileInfo.suffix().toLower() == "ba2") {
       int index = activeArchives.indexOf(fileInfo.fileName());
@@ -1778,10 +1782,9 @@ void MainWindow::updateBSAList(const QStringList &defaultArchives, const QString
   for (auto iter = items.begin(); iter != items.end(); ++iter) {
     int originID = iter->second->data(1, Qt::UserRole).toInt();
 
-    const FilesOrigin& origin = m_OrganizerCore.directoryStructure()->getOriginByID(originID);
-
     QString modName;
-    const unsigned int modIndex = ModInfo::getIndex(ToQString(origin.getName()));
+    const unsigned int modIndex = m_OrganizerCore.directoryStructure()
+      ->getOriginConnection()->modIndex(originID);
 
     if (modIndex == UINT_MAX) {
       modName = UnmanagedModName();
@@ -2233,6 +2236,8 @@ void MainWindow::modRenamed(const QString &oldName, const QString &newName)
   // also fix the directory structure
   try {
     if (m_OrganizerCore.directoryStructure()->originExists(ToWString(oldName))) {
+      m_OrganizerCore.stopConflictsJob();
+
       FilesOrigin &origin = m_OrganizerCore.directoryStructure()->getOriginByName(ToWString(oldName));
       origin.setName(ToWString(newName));
     } else {
@@ -2245,8 +2250,13 @@ void MainWindow::modRenamed(const QString &oldName, const QString &newName)
 
 void MainWindow::fileMoved(const QString &filePath, const QString &oldOriginName, const QString &newOriginName)
 {
+  m_OrganizerCore.stopConflictsJob();
+
   const FileEntryPtr filePtr = m_OrganizerCore.directoryStructure()->findFile(ToWString(filePath));
-  if (filePtr.get() != nullptr) {
+  if (filePtr != nullptr) {
+    const OriginPriorities priorities(
+      *m_OrganizerCore.directoryStructure()->getOriginConnection());
+
     try {
       if (m_OrganizerCore.directoryStructure()->originExists(ToWString(newOriginName))) {
         FilesOrigin &newOrigin = m_OrganizerCore.directoryStructure()->getOriginByName(ToWString(newOriginName));
@@ -2255,12 +2265,12 @@ void MainWindow::fileMoved(const QString &filePath, const QString &oldOriginName
         WIN32_FIND_DATAW findData;
         HANDLE hFind;
         hFind = ::FindFirstFileW(ToWString(fullNewPath).c_str(), &findData);
-        filePtr->addOrigin(newOrigin.getID(), findData.ftCreationTime, L"", -1);
+        filePtr->addOrigin(newOrigin.getID(), findData.ftCreationTime, {}, priorities);
         FindClose(hFind);
       }
       if (m_OrganizerCore.directoryStructure()->originExists(ToWString(oldOriginName))) {
         FilesOrigin &oldOrigin = m_OrganizerCore.directoryStructure()->getOriginByName(ToWString(oldOriginName));
-        filePtr->removeOrigin(oldOrigin.getID());
+        filePtr->removeOrigin(oldOrigin.getID(), priorities);
       }
     } catch (const std::exception &e) {
       reportError(tr("failed to move \"%1\" from mod \"%2\" to \"%3\": %4").arg(filePath).arg(oldOriginName).arg(newOriginName).arg(e.what()));
@@ -2633,6 +2643,8 @@ void MainWindow::languageChange(const QString &newLanguage)
 
 void MainWindow::originModified(int originID)
 {
+  m_OrganizerCore.stopConflictsJob();
+
   FilesOrigin &origin = m_OrganizerCore.directoryStructure()->getOriginByID(originID);
   origin.enable(false);
 
@@ -3237,10 +3249,10 @@ void MainWindow::setCategoryListVisible(bool visible)
 {
   if (visible) {
     ui->categoriesGroup->show();
-    ui->displayCategoriesBtn->setText(ToQString(L"\u00ab"));
+    ui->displayCategoriesBtn->setText(QStringLiteral("\u00ab"));
   } else {
     ui->categoriesGroup->hide();
-    ui->displayCategoriesBtn->setText(ToQString(L"\u00bb"));
+    ui->displayCategoriesBtn->setText(QStringLiteral("\u00bb"));
   }
 }
 
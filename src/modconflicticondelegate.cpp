@@ -20,6 +20,12 @@ QList<QString> ModConflictIconDelegate::getIconsForFlags(
   if (std::find(flags.begin(), flags.end(), ModInfo::FLAG_OVERWRITE_CONFLICT) != flags.end())
     return result;
 
+  // conflicts are not known yet, only the placeholder is shown
+  if (std::find(flags.begin(), flags.end(), ModInfo::FLAG_CONFLICT_PENDING) != flags.end()) {
+    result.append(getFlagIcon(ModInfo::FLAG_CONFLICT_PENDING));
+    return result;
+  }
+
   // insert conflict icons to provide nicer alignment
   { // insert loose file conflicts first
     auto iter = std::find_first_of(flags.begin(), flags.end(),
@@ -100,6 +106,7 @@ QString ModConflictIconDelegate::getFlagIcon(ModInfo::EConflictFlag flag)
     case ModInfo::FLAG_ARCHIVE_CONFLICT_OVERWRITE: return QStringLiteral(":/MO/gui/archive_conflict_winner");
     case ModInfo::FLAG_ARCHIVE_CONFLICT_OVERWRITTEN: return QStringLiteral(":/MO/gui/archive_conflict_loser");
     case ModInfo::FLAG_OVERWRITE_CONFLICT: return QString();
+    case ModInfo::FLAG_CONFLICT_PENDING: return QStringLiteral(":/MO/gui/awaiting");
     default:
       log::warn("ModInfo flag {} has no defined icon", flag);
       return QString();
@@ -32,6 +32,7 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 #include "overwriteinfodialog.h"
 #include "versioninfo.h"
 #include "thread_utils.h"
+#include "shared/originconnection.h"
 
 #include <iplugingame.h>
 #include <versioninfo.h>
@@ -60,6 +61,33 @@ QMutex ModInfo::s_Mutex(QMutex::Recursive);
 QString ModInfo::s_HiddenExt(".mohidden");
 
 
+// origins are named after the internal name of their mod
+//
+class ModInfoIndexResolver : public MOShared::ModIndexResolver
+{
+public:
+  unsigned int generation() const override
+  {
+    return m_generation;
+  }
+
+  unsigned int modIndex(const std::wstring& originName) const override
+  {
+    return ModInfo::getIndex(QString::fromStdWString(originName));
+  }
+
+  void indicesChanged()
+  {
+    ++m_generation;
+  }
+
+private:
+  std::atomic<unsigned int> m_generation = 1;
+};
+
+ModInfoIndexResolver g_indexResolver;
+
+
 bool ModInfo::ByName(const ModInfo::Ptr &LHS, const ModInfo::Ptr &RHS)
 {
   return QString::compare(LHS->name(), RHS->name(), Qt::CaseInsensitive) < 0;
@@ -222,6 +250,11 @@ unsigned int ModInfo::getIndex(const QString &name)
   return iter->second;
 }
 
+const MOShared::ModIndexResolver& ModInfo::modIndexResolver()
+{
+  return g_indexResolver;
+}
+
 unsigned int ModInfo::findMod(const boost::function<bool (ModInfo::Ptr)> &filter)
 {
   for (unsigned int i = 0U; i < s_Collection.size(); ++i) {
@@ -291,6 +324,9 @@ void ModInfo::updateIndices()
     s_ModsByName[modName] = i;
     s_ModsByModID[std::pair<QString, int>(game, modID)].push_back(i);
   }
+
+  // the origin to mod tables of the directory structures are stale
+  g_indexResolver.indicesChanged();
 }
 
 
@@ -42,7 +42,7 @@ class QDateTime;
 #include <vector>
 
 namespace MOBase { class IPluginGame; }
-namespace MOShared { class DirectoryEntry; }
+namespace MOShared { class DirectoryEntry; class ModIndexResolver; }
 
 /**
  * @brief Represents meta information about a single mod.
@@ -73,6 +73,7 @@ public: // Type definitions:
     FLAG_ARCHIVE_CONFLICT_OVERWRITTEN,
     FLAG_ARCHIVE_CONFLICT_MIXED,
     FLAG_OVERWRITE_CONFLICT,
+    FLAG_CONFLICT_PENDING,
   };
 
   enum EFlag {
@@ -176,6 +177,12 @@ public: // Static functions:
    */
   static unsigned int getIndex(const QString &name);
 
+  /**
+   * @brief Resolver mapping origins of the directory structure to mod
+   *     indices, kept up to date by updateIndices().
+   */
+  static const MOShared::ModIndexResolver& modIndexResolver();
+
   /**
    * @brief Retrieve the overwrite mod.
    */
@@ -3,7 +3,6 @@
 #include "shared/directoryentry.h"
 #include "shared/filesorigin.h"
 #include "shared/fileentry.h"
-#include <filesystem>
 
 #include "organizercore.h"
 #include "iplugingame.h"
@@ -12,7 +11,6 @@
 
 using namespace MOBase;
 using namespace MOShared;
-namespace fs = std::filesystem;
 
 ModInfoWithConflictInfo::ModInfoWithConflictInfo(OrganizerCore& core) :
   ModInfo(core),
@@ -38,6 +36,12 @@ std::vector<ModInfo::EFlag> ModInfoWithConflictInfo::getFlags() const
 std::vector<ModInfo::EConflictFlag> ModInfoWithConflictInfo::getConflictFlags() const
 {
   std::vector<ModInfo::EConflictFlag> result;
+
+  if (m_Conflicts.value().m_Pending) {
+    result.push_back(ModInfo::FLAG_CONFLICT_PENDING);
+    return result;
+  }
+
   switch (isConflicted()) {
     case CONFLICT_MIXED: {
       result.push_back(ModInfo::FLAG_CONFLICT_MIXED);
@@ -86,148 +90,54 @@ ModInfoWithConflictInfo::Conflicts ModInfoWithConflictInfo::doConflictCheck() co
 {
   Conflicts conflicts;
 
-  bool providesAnything = false;
-  bool hasHiddenFiles = false;
+  // the lists are computed for all the mods at once by the conflict matrix
+  auto matrix = m_Core.conflictMatrix();
+
+  if (!matrix) {
+    // still being computed, the caches are cleared once it's done
+    static const auto empty = std::make_shared<const ConflictMatrix::OriginConflicts>();
 
-  int dataID = 0;
-  if (m_Core.directoryStructure()->originExists(L"data")) {
-    dataID = m_Core.directoryStructure()->getOriginByName(L"data").getID();
+    conflicts.m_Pending = true;
+    conflicts.m_Lists = empty;
+
+    return conflicts;
   }
 
-  std::wstring name = ToWString(this->name());
-  const std::wstring hideExt = ToWString(ModInfo::s_HiddenExt);
+  const std::wstring name = ToWString(this->name());
+  OriginID id = InvalidOriginID;
 
   if (m_Core.directoryStructure()->originExists(name)) {
-    FilesOrigin &origin = m_Core.directoryStructure()->getOriginByName(name);
-    std::vector<FileEntryPtr> files = origin.getFiles();
-    std::set<const DirectoryEntry*> checkedDirs;
-
-    // for all files in this origin
-    for (FileEntryPtr file : files) {
-
-      // skip hiidden file check if already found one
-      if (!hasHiddenFiles) {
-        const fs::path nameAsPath(file->getName());
-
-        if (nameAsPath.extension().wstring().compare(hideExt) == 0) {
-          hasHiddenFiles = true;
-        }
-        else {
-          const DirectoryEntry* parent = file->getParent();
-
-          // iterate on all parent direEntries to check for .mohiddden
-          while (parent != nullptr) {
-            auto insertResult = checkedDirs.insert(parent);
-
-            if (insertResult.second == false) {
-              // if already present break as we can assume to have checked the parents as well
-              break;
-            }
-            else {
-              const fs::path dirPath(parent->getName());
-              if (dirPath.extension().wstring().compare(hideExt) == 0) {
-                hasHiddenFiles = true;
-                break;
-              }
-              parent = parent->getParent();
-            }
-          }
-        }
-      }
-
-      auto alternatives = file->getAlternatives();
-      if ((alternatives.size() == 0) || (alternatives.back().originID() == dataID)) {
-        // no alternatives -> no conflict
-        providesAnything = true;
-      } else {
-        // Get the archive data for the current mod
-        DataArchiveOrigin archiveData;
-        if (file->getOrigin() == origin.getID())
-          archiveData = file->getArchive();
-        else {
-          for (const auto& alt : alternatives) {
-            if (alt.originID() == origin.getID()) {
-              archiveData = alt.archive();
-              break;
-            }
-          }
-        }
-
-        // If this is not the origin then determine the correct overwrite
-        if (file->getOrigin() != origin.getID()) {
-          FilesOrigin &altOrigin = m_Core.directoryStructure()->getOriginByID(file->getOrigin());
-          unsigned int altIndex = ModInfo::getIndex(ToQString(altOrigin.getName()));
-          if (!file->isFromArchive()) {
-            if (!archiveData.isValid())
-              conflicts.m_OverwrittenList.insert(altIndex);
-            else
-              conflicts.m_ArchiveLooseOverwrittenList.insert(altIndex);
-          }
-          else {
-            conflicts.m_ArchiveOverwrittenList.insert(altIndex);
-          }
-        } else {
-          providesAnything = true;
-        }
-
-        // Sort out the alternatives
-        for (const auto& altInfo : alternatives) {
-          if ((altInfo.originID() != dataID) && (altInfo.originID() != origin.getID())) {
-            FilesOrigin &altOrigin = m_Core.directoryStructure()->getOriginByID(altInfo.originID());
-            QString altOriginName = ToQString(altOrigin.getName());
-            unsigned int altIndex = ModInfo::getIndex(altOriginName);
-            if (!altInfo.isFromArchive()) {
-              if (!archiveData.isValid()) {
-                if (origin.getPriority() > altOrigin.getPriority()) {
-                  conflicts.m_OverwriteList.insert(altIndex);
-                } else {
-                  conflicts.m_OverwrittenList.insert(altIndex);
-                }
-              } else {
-                conflicts.m_ArchiveLooseOverwrittenList.insert(altIndex);
-              }
-            } else {
-              if (!archiveData.isValid()) {
-                conflicts.m_ArchiveLooseOverwriteList.insert(altIndex);
-              } else {
-                if (archiveData.order() > altInfo.archive().order()) {
-                  conflicts.m_ArchiveOverwriteList.insert(altIndex);
-                } else if (archiveData.order() < altInfo.archive().order()) {
-                  conflicts.m_ArchiveOverwrittenList.insert(altIndex);
-                }
-              }
-            }
-          }
-        }
-      }
-    }
+    id = m_Core.directoryStructure()->getOriginByName(name).getID();
+  }
 
-    if (files.size() != 0) {
-      if (!providesAnything)
-        conflicts.m_CurrentConflictState = CONFLICT_REDUNDANT;
-      else if (!conflicts.m_OverwriteList.empty() && !conflicts.m_OverwrittenList.empty())
-        conflicts.m_CurrentConflictState = CONFLICT_MIXED;
-      else if (!conflicts.m_OverwriteList.empty())
-        conflicts.m_CurrentConflictState = CONFLICT_OVERWRITE;
-      else if (!conflicts.m_OverwrittenList.empty())
-        conflicts.m_CurrentConflictState = CONFLICT_OVERWRITTEN;
-
-      if (!conflicts.m_ArchiveOverwriteList.empty() && !conflicts.m_ArchiveOverwrittenList.empty())
-        conflicts.m_ArchiveConflictState = CONFLICT_MIXED;
-      else if (!conflicts.m_ArchiveOverwriteList.empty())
-        conflicts.m_ArchiveConflictState = CONFLICT_OVERWRITE;
-      else if (!conflicts.m_ArchiveOverwrittenList.empty())
-        conflicts.m_ArchiveConflictState = CONFLICT_OVERWRITTEN;
-
-      if (!conflicts.m_ArchiveLooseOverwrittenList.empty() && !conflicts.m_ArchiveLooseOverwriteList.empty())
-        conflicts.m_ArchiveConflictLooseState = CONFLICT_MIXED;
-      else if (!conflicts.m_ArchiveLooseOverwrittenList.empty())
-        conflicts.m_ArchiveConflictLooseState = CONFLICT_OVERWRITTEN;
-      else if (!conflicts.m_ArchiveLooseOverwriteList.empty())
-        conflicts.m_ArchiveConflictLooseState = CONFLICT_OVERWRITE;
-
-      conflicts.m_HasHiddenFiles = hasHiddenFiles;
-    }
+  conflicts.m_Lists = matrix->get(id);
+  const auto& c = *conflicts.m_Lists;
+
+  if (c.hasFiles) {
+    if (!c.providesAnything)
+      conflicts.m_CurrentConflictState = CONFLICT_REDUNDANT;
+    else if (!c.overwrite.empty() && !c.overwritten.empty())
+      conflicts.m_CurrentConflictState = CONFLICT_MIXED;
+    else if (!c.overwrite.empty())
+      conflicts.m_CurrentConflictState = CONFLICT_OVERWRITE;
+    else if (!c.overwritten.empty())
+      conflicts.m_CurrentConflictState = CONFLICT_OVERWRITTEN;
+
+    if (!c.archiveOverwrite.empty() && !c.archiveOverwritten.empty())
+      conflicts.m_ArchiveConflictState = CONFLICT_MIXED;
+    else if (!c.archiveOverwrite.empty())
+      conflicts.m_ArchiveConflictState = CONFLICT_OVERWRITE;
+    else if (!c.archiveOverwritten.empty())
+      conflicts.m_ArchiveConflictState = CONFLICT_OVERWRITTEN;
+
+    if (!c.archiveLooseOverwritten.empty() && !c.archiveLooseOverwrite.empty())
+      conflicts.m_ArchiveConflictLooseState = CONFLICT_MIXED;
+    else if (!c.archiveLooseOverwritten.empty())
+      conflicts.m_ArchiveConflictLooseState = CONFLICT_OVERWRITTEN;
+    else if (!c.archiveLooseOverwrite.empty())
+      conflicts.m_ArchiveConflictLooseState = CONFLICT_OVERWRITE;
+
+    conflicts.m_HasHiddenFiles = c.hasHiddenFiles;
   }
 
   return conflicts;
@@ -5,6 +5,7 @@
 
 #include "memoizedlock.h"
 #include "modinfo.h"
+#include "conflictmatrix.h"
 
 #include <set>
 #include <QTime>
@@ -54,12 +55,12 @@ public:
    */
   void clearCaches() override;
 
-  const std::set<unsigned int>& getModOverwrite() const override { return m_Conflicts.value().m_OverwriteList; }
-  const std::set<unsigned int>& getModOverwritten() const override { return m_Conflicts.value().m_OverwrittenList; }
-  const std::set<unsigned int>& getModArchiveOverwrite() const override { return m_Conflicts.value().m_ArchiveOverwriteList; }
-  const std::set<unsigned int>& getModArchiveOverwritten() const override { return m_Conflicts.value().m_ArchiveOverwrittenList; }
-  const std::set<unsigned int>& getModArchiveLooseOverwrite() const override { return m_Conflicts.value().m_ArchiveLooseOverwriteList; }
-  const std::set<unsigned int>& getModArchiveLooseOverwritten() const override { return m_Conflicts.value().m_ArchiveLooseOverwrittenList; }
+  const std::set<unsigned int>& getModOverwrite() const override { return m_Conflicts.value().m_Lists->overwrite; }
+  const std::set<unsigned int>& getModOverwritten() const override { return m_Conflicts.value().m_Lists->overwritten; }
+  const std::set<unsigned int>& getModArchiveOverwrite() const override { return m_Conflicts.value().m_Lists->archiveOverwrite; }
+  const std::set<unsigned int>& getModArchiveOverwritten() const override { return m_Conflicts.value().m_Lists->archiveOverwritten; }
+  const std::set<unsigned int>& getModArchiveLooseOverwrite() const override { return m_Conflicts.value().m_Lists->archiveLooseOverwrite; }
+  const std::set<unsigned int>& getModArchiveLooseOverwritten() const override { return m_Conflicts.value().m_Lists->archiveLooseOverwritten; }
 
 public slots:
 
@@ -138,12 +139,11 @@ private:
     bool m_HasLooseOverwrite = false;
     bool m_HasHiddenFiles = false;
 
-    std::set<unsigned int> m_OverwriteList;   // indices of mods overritten by this mod
-    std::set<unsigned int> m_OverwrittenList; // indices of mods overwriting this mod
-    std::set<unsigned int> m_ArchiveOverwriteList;   // indices of mods with archive files overritten by this mod
-    std::set<unsigned int> m_ArchiveOverwrittenList; // indices of mods with archive files overwriting this mod
-    std::set<unsigned int> m_ArchiveLooseOverwriteList; // indices of mods with archives being overwritten by this mod's loose files
-    std::set<unsigned int> m_ArchiveLooseOverwrittenList; // indices of mods with loose files overwriting this mod's archive files
+    // the conflicts are still being computed
+    bool m_Pending = false;
+
+    // lists of conflicting mods from the conflict matrix, never null
+    std::shared_ptr<const ConflictMatrix::OriginConflicts> m_Lists;
   };
 
   Conflicts doConflictCheck() const;
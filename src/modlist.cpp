@@ -164,6 +164,7 @@ QString ModList::getConflictFlagText(ModInfo::EConflictFlag flag, ModInfo::Ptr m
   case ModInfo::FLAG_ARCHIVE_CONFLICT_OVERWRITE: return tr("Overwrites another archive file");
   case ModInfo::FLAG_ARCHIVE_CONFLICT_OVERWRITTEN: return tr("Overwritten by another archive file");
   case ModInfo::FLAG_ARCHIVE_CONFLICT_MIXED: return tr("Archive files overwrites & overwritten");
+  case ModInfo::FLAG_CONFLICT_PENDING: return tr("Checking for conflicts...");
   default: return "";
   }
 }
@@ -686,48 +687,21 @@ void ModList::changeModPriority(std::vector<int> sourceIndices, int newPriority)
 
   emit layoutAboutToBeChanged();
 
-  // sort the moving mods by ascending priorities
-  std::sort(sourceIndices.begin(), sourceIndices.end(),
-    [=](const int &LHS, const int &RHS) {
-    return m_Profile->getModPriority(LHS) > m_Profile->getModPriority(RHS);
-  });
-
-  // move mods that are decreasing in priority
-  for (const auto& index : sourceIndices) {
-    int oldPriority = m_Profile->getModPriority(index);
-    if (oldPriority > newPriority) {
-      if (m_Profile->setModPriority(index, newPriority)) {
-        m_ModMoved(ModInfo::getByIndex(index)->name(), oldPriority, newPriority);
-      }
-    }
-  }
+  // the mods are moved as a block just before the mod at the dropped
+  // location, only the mods in between are shifted
+  const std::vector<unsigned int> indices(
+    sourceIndices.begin(), sourceIndices.end());
 
-  // sort the moving mods by descending priorities
-  std::sort(sourceIndices.begin(), sourceIndices.end(),
-    [=](const int &LHS, const int &RHS) {
-    return m_Profile->getModPriority(LHS) < m_Profile->getModPriority(RHS);
-  });
+  const auto moved = m_Profile->moveModsPriority(indices, newPriority);
 
-  // if at least one mod is increasing in priority, the target index is
-  // that of the row BELOW the dropped location, otherwise it's the one above
-  for (const auto& index : sourceIndices) {
-    int oldPriority = m_Profile->getModPriority(index);
-    if (oldPriority < newPriority) {
-      --newPriority;
-      break;
-    }
-  }
-
-  // move mods that are increasing in priority
-  for (const auto& index : sourceIndices) {
-    int oldPriority = m_Profile->getModPriority(index);
-    if (oldPriority < newPriority) {
-      if (m_Profile->setModPriority(index, newPriority)) {
-        m_ModMoved(ModInfo::getByIndex(index)->name(), oldPriority, newPriority);
-      }
-    }
+  for (const auto& [index, oldPriority] : moved) {
+    m_ModMoved(
+      ModInfo::getByIndex(index)->name(), oldPriority,
+      m_Profile->getModPriority(index));
   }
 
+  // rows are mod indices and don't move, but views sorted by priority have
+  // to rebuild their mapping
   emit layoutChanged();
 
   QModelIndexList indices;
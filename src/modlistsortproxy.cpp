@@ -34,6 +34,7 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 #include <QMimeData>
 #include <QDebug>
 #include <QTreeView>
+#include <algorithm>
 
 using namespace MOBase;
 
@@ -232,6 +233,7 @@ bool ModListSortProxy::lessThan(const QModelIndex &left,
 void ModListSortProxy::updateFilter(const QString& filter)
 {
   m_Filter = filter;
+  compileFilter();
   updateFilterActive();
   invalidateFilter();
   emit filterInvalidated();
@@ -419,13 +421,114 @@ bool ModListSortProxy::contentMatchesMod(ModInfo::Ptr info, bool enabled, int co
   return info->hasContent(content);
 }
 
-bool ModListSortProxy::filterMatchesMod(ModInfo::Ptr info, bool enabled) const
+void ModListSortProxy::compileFilter()
+{
+  m_FilterQuery.clear();
+
+  QString filterCopy = QString(m_Filter);
+  filterCopy.replace("||", ";").replace("OR", ";").replace("|", ";");
+  const QStringList ORList = filterCopy.split(";", QString::SkipEmptyParts);
+
+  // split in ORSegments that internally use AND logic
+  for (auto& ORSegment : ORList) {
+    const QStringList ANDKeywords = ORSegment.split(" ", QString::SkipEmptyParts);
+
+    FilterSegment segment;
+    segment.reserve(static_cast<std::size_t>(ANDKeywords.size()));
+
+    for (auto& keyword : ANDKeywords) {
+      FilterKeyword k;
+      k.matcher.setPattern(keyword.toCaseFolded());
+      k.matcher.setCaseSensitivity(Qt::CaseSensitive);
+
+      bool ok = false;
+      const int filterID = keyword.toInt(&ok);
+
+      // ids are positive, so 0 or negative numbers never matched
+      if (ok && filterID > 0) {
+        k.nexusIdPrefix = QString::number(filterID);
+      }
+
+      segment.push_back(std::move(k));
+    }
+
+    m_FilterQuery.push_back(std::move(segment));
+  }
+}
+
+const ModListSortProxy::SearchKeys& ModListSortProxy::searchKeys(
+  unsigned int index, const ModInfo& info) const
+{
+  auto itor = m_SearchKeys.find(index);
+  if (itor != m_SearchKeys.end()) {
+    return itor->second;
+  }
+
+  SearchKeys keys;
+  keys.name = info.name().toCaseFolded();
+  keys.notes = info.comments().toCaseFolded();
+  keys.categories = info.categories().join("\n").toCaseFolded();
+
+  if (info.nexusId() > 0) {
+    keys.nexusId = QString::number(info.nexusId());
+  }
+
+  return m_SearchKeys.emplace(index, std::move(keys)).first->second;
+}
+
+bool ModListSortProxy::keywordMatchesMod(
+  const FilterKeyword& k, const SearchKeys& keys) const
+{
+  if (m_EnabledColumns[ModList::COL_NAME] && k.matcher.indexIn(keys.name) != -1) {
+    return true;
+  }
+
+  if (m_EnabledColumns[ModList::COL_NOTES] && k.matcher.indexIn(keys.notes) != -1) {
+    return true;
+  }
+
+  if (m_EnabledColumns[ModList::COL_CATEGORY] && k.matcher.indexIn(keys.categories) != -1) {
+    return true;
+  }
+
+  // an id matches if it starts with the digits of the keyword
+  if (m_EnabledColumns[ModList::COL_MODID] && !k.nexusIdPrefix.isEmpty()) {
+    if (keys.nexusId.startsWith(k.nexusIdPrefix)) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool ModListSortProxy::queryMatchesMod(
+  unsigned int index, const ModInfo& info) const
+{
+  const auto& keys = searchKeys(index, info);
+
+  for (auto& segment : m_FilterQuery) {
+    const bool segmentGood = std::all_of(
+      segment.begin(), segment.end(), [&](auto&& k) {
+        return keywordMatchesMod(k, keys);
+      });
+
+    if (segmentGood) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+bool ModListSortProxy::filterMatchesMod(unsigned int index, bool enabled) const
 {
   // don't check if there are no filters selected
   if (!m_FilterActive) {
     return true;
   }
 
+  ModInfo::Ptr info = ModInfo::getByIndex(index);
+
 
   // special case for separators
   if (info->hasFlag(ModInfo::FLAG_SEPARATOR)) {
@@ -453,84 +556,10 @@ bool ModListSortProxy::filterMatchesMod(ModInfo::Ptr info, bool enabled) const
 
 
   if (!m_Filter.isEmpty()) {
-    bool display = false;
-    QString filterCopy = QString(m_Filter);
-    filterCopy.replace("||", ";").replace("OR", ";").replace("|", ";");
-    QStringList ORList = filterCopy.split(";", QString::SkipEmptyParts);
-
-    bool segmentGood = true;
-
-    //split in ORSegments that internally use AND logic
-    for (auto& ORSegment : ORList) {
-      QStringList ANDKeywords = ORSegment.split(" ", QString::SkipEmptyParts);
-      segmentGood = true;
-      bool foundKeyword = false;
-
-      //check each word in the segment for match, each word needs to be matched but it doesn't matter where.
-      for (auto& currentKeyword : ANDKeywords) {
-        foundKeyword = false;
-
-        //search keyword in name
-        if (m_EnabledColumns[ModList::COL_NAME] &&
-          info->name().contains(currentKeyword, Qt::CaseInsensitive)) {
-          foundKeyword = true;
-        }
-
-        // Search by notes
-        if (!foundKeyword &&
-          m_EnabledColumns[ModList::COL_NOTES] &&
-          info->comments().contains(currentKeyword, Qt::CaseInsensitive)) {
-          foundKeyword = true;
-        }
-
-        // Search by categories
-        if (!foundKeyword &&
-          m_EnabledColumns[ModList::COL_CATEGORY]) {
-          for (auto category : info->categories()) {
-            if (category.contains(currentKeyword, Qt::CaseInsensitive)) {
-              foundKeyword = true;
-              break;
-            }
-          }
-        }
-
-        // Search by Nexus ID
-        if (!foundKeyword &&
-          m_EnabledColumns[ModList::COL_MODID]) {
-          bool ok;
-          int filterID = currentKeyword.toInt(&ok);
-          if (ok) {
-            int modID = info->nexusId();
-            while (modID > 0) {
-              if (modID == filterID) {
-                foundKeyword = true;
-                break;
-              }
-              modID = (int)(modID / 10);
-            }
-          }
-        }
-
-        if (!foundKeyword) {
-          //currentKeword is missing from everything, AND fails and we need to check next ORsegment
-          segmentGood = false;
-          break;
-        }
-
-      }//for ANDKeywords loop
-
-      if (segmentGood) {
-        //the last AND loop didn't break so the ORSegments is true so mod matches filter
-        display = true;
-        break;
-      }
-
-    }//for ORList loop
-
-    if (!display) {
+    if (!queryMatchesMod(index, *info)) {
       return false;
     }
-  }//if (!m_CurrentFilter.isEmpty())
+  }
 
 
   if (m_FilterMode == FilterAnd) {
@@ -586,7 +615,7 @@ bool ModListSortProxy::filterAcceptsRow(int source_row, const QModelIndex &paren
   if (sourceModel()->hasChildren(idx)) {
     // we need to check the separator itself first
     if (index < ModInfo::getNumMods() && ModInfo::getByIndex(index)->isSeparator()) {
-      if (filterMatchesMod(ModInfo::getByIndex(index), false)) {
+      if (filterMatchesMod(index, false)) {
         return true;
       }
     }
@@ -599,7 +628,7 @@ bool ModListSortProxy::filterAcceptsRow(int source_row, const QModelIndex &paren
     return false;
   } else {
     bool modEnabled = idx.sibling(source_row, 0).data(Qt::CheckStateRole).toInt() == Qt::Checked;
-    return filterMatchesMod(ModInfo::getByIndex(index), modEnabled);
+    return filterMatchesMod(index, modEnabled);
   }
 }
 
@@ -673,6 +702,37 @@ void ModListSortProxy::setSourceModel(QAbstractItemModel *sourceModel)
   if (sourceModel) {
     connect(sourceModel, SIGNAL(aboutToChangeData()), this, SLOT(aboutToChangeData()), Qt::UniqueConnection);
     connect(sourceModel, SIGNAL(postDataChanged()), this, SLOT(postDataChanged()), Qt::UniqueConnection);
+
+    // names, notes and categories are searched in a copy made the first time
+    // a mod is filtered, it has to be thrown away when mods change
+    connect(sourceModel, &QAbstractItemModel::dataChanged, this, &ModListSortProxy::onSourceDataChanged, Qt::UniqueConnection);
+    connect(sourceModel, &QAbstractItemModel::modelReset, this, &ModListSortProxy::clearSearchKeys, Qt::UniqueConnection);
+    connect(sourceModel, &QAbstractItemModel::rowsInserted, this, &ModListSortProxy::clearSearchKeys, Qt::UniqueConnection);
+    connect(sourceModel, &QAbstractItemModel::rowsRemoved, this, &ModListSortProxy::clearSearchKeys, Qt::UniqueConnection);
+  }
+
+  clearSearchKeys();
+}
+
+void ModListSortProxy::clearSearchKeys()
+{
+  m_SearchKeys.clear();
+}
+
+void ModListSortProxy::onSourceDataChanged(
+  const QModelIndex& topLeft, const QModelIndex& bottomRight)
+{
+  if (m_SearchKeys.empty()) {
+    return;
+  }
+
+  for (int row=topLeft.row(); row<=bottomRight.row(); ++row) {
+    bool ok = false;
+    const auto index = topLeft.sibling(row, 0).data(ModList::IndexRole).toInt(&ok);
+
+    if (ok) {
+      m_SearchKeys.erase(static_cast<unsigned int>(index));
+    }
   }
 }
 
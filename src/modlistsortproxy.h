@@ -21,7 +21,9 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 #define MODLISTSORTPROXY_H
 
 #include <QSortFilterProxyModel>
+#include <QStringMatcher>
 #include <bitset>
+#include <unordered_map>
 #include "modlist.h"
 
 class Profile;
@@ -84,11 +86,11 @@ public:
 
   /**
    * @brief tests if a filtere matches for a mod
-   * @param info mod information
+   * @param index index of the mod
    * @param enabled true if the mod is currently active
    * @return true if current active filters match for the specified mod
    */
-  bool filterMatchesMod(ModInfo::Ptr info, bool enabled) const;
+  bool filterMatchesMod(unsigned int index, bool enabled) const;
 
   /**
    * @return true if a filter is currently active
@@ -149,12 +151,58 @@ private slots:
   void aboutToChangeData();
   void postDataChanged();
 
+  // forgets the search keys of all mods, called when mods are added, removed
+  // or moved, since their indices change
+  //
+  void clearSearchKeys();
+
+  // forgets the search keys of the mods in the given rows
+  //
+  void onSourceDataChanged(const QModelIndex& topLeft, const QModelIndex& bottomRight);
+
 private:
+  // a word of the filter, compiled once when the filter changes
+  //
+  struct FilterKeyword
+  {
+    // case folded
+    QStringMatcher matcher;
+
+    // the keyword as a positive number, empty if it's not one; matches mods
+    // with an id starting with these digits
+    QString nexusIdPrefix;
+  };
+
+  // the filter is a list of segments separated by "||", "|", "OR" or ";"; a
+  // mod matches if all the keywords of any segment match
+  //
+  using FilterSegment = std::vector<FilterKeyword>;
+
+  // case folded text of a mod that keywords are searched in, built the first
+  // time a mod is filtered and kept until the mod changes
+  //
+  struct SearchKeys
+  {
+    QString name;
+    QString notes;
+
+    // separated by newlines, which can't be in a keyword
+    QString categories;
+
+    // empty if the mod has no id
+    QString nexusId;
+  };
+
   OrganizerCore* m_Organizer;
 
   Profile* m_Profile;
   std::vector<Criteria> m_Criteria;
   QString m_Filter;
+  std::vector<FilterSegment> m_FilterQuery;
+
+  // by mod index
+  mutable std::unordered_map<unsigned int, SearchKeys> m_SearchKeys;
+
   std::bitset<ModList::COL_LASTCOLUMN + 1> m_EnabledColumns;
 
   bool m_FilterActive;
@@ -163,6 +211,10 @@ private:
 
   std::vector<Criteria> m_PreChangeCriteria;
 
+  void compileFilter();
+  const SearchKeys& searchKeys(unsigned int index, const ModInfo& info) const;
+  bool keywordMatchesMod(const FilterKeyword& k, const SearchKeys& keys) const;
+  bool queryMatchesMod(unsigned int index, const ModInfo& info) const;
   bool optionsMatchMod(ModInfo::Ptr info, bool enabled) const;
   bool criteriaMatchMod(ModInfo::Ptr info, bool enabled, const Criteria& c) const;
   bool categoryMatchesMod(ModInfo::Ptr info, bool enabled, int category) const;
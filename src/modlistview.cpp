@@ -28,12 +28,16 @@
 #include "shared/fileentry.h"
 #include "shared/directoryentry.h"
 #include "shared/filesorigin.h"
+#include "shared/originconnection.h"
 #include "mainwindow.h"
 #include "modelutils.h"
 
 using namespace MOBase;
 using namespace MOShared;
 
+// number of rows repainted at a time once the conflicts are available
+constexpr std::size_t ConflictRowsPerBatch = 50;
+
 // delegate to remove indentation for mods when using collapsible
 // separator
 //
@@ -157,6 +161,12 @@ ModListView::ModListView(QWidget* parent)
   m_refreshMarkersTimer.setSingleShot(true);
   connect(&m_refreshMarkersTimer, &QTimer::timeout, [=] { refreshMarkersAndPlugins(); });
 
+  // batches of conflict rows are published between events so the ui stays
+  // responsive
+  m_conflictsTimer.setInterval(0);
+  m_conflictsTimer.setSingleShot(true);
+  connect(&m_conflictsTimer, &QTimer::timeout, [=] { publishConflictsBatch(); });
+
   installEventFilter(new CopyEventFilter(this, [=](auto& index) {
     QVariant mIndex = index.data(ModList::IndexRole);
     QString name = index.data(Qt::DisplayRole).toString();
@@ -311,12 +321,13 @@ void ModListView::setFilterOptions(ModListSortProxy::FilterMode mode, ModListSor
 
 bool ModListView::isModVisible(unsigned int index) const
 {
-  return m_sortProxy->filterMatchesMod(ModInfo::getByIndex(index), m_core->currentProfile()->modEnabled(index));
+  return m_sortProxy->filterMatchesMod(index, m_core->currentProfile()->modEnabled(index));
 }
 
 bool ModListView::isModVisible(ModInfo::Ptr mod) const
 {
-  return m_sortProxy->filterMatchesMod(mod, m_core->currentProfile()->modEnabled(ModInfo::getIndex(mod->name())));
+  const auto index = ModInfo::getIndex(mod->name());
+  return m_sortProxy->filterMatchesMod(index, m_core->currentProfile()->modEnabled(index));
 }
 
 QModelIndex ModListView::indexModelToView(const QModelIndex& index) const
@@ -437,6 +448,81 @@ void ModListView::onModPrioritiesChanged(const QModelIndexList& indices)
   setOverwriteMarkers(selectionModel()->selectedRows());
 }
 
+void ModListView::onConflictsReady()
+{
+  const auto count = static_cast<std::size_t>(m_core->modList()->rowCount());
+
+  // rows that are visible are published first
+  std::vector<int> visible;
+  std::vector<bool> queued(count, false);
+
+  const QRect area = viewport()->rect();
+
+  for (QModelIndex index = indexAt(area.topLeft());
+       index.isValid() && visualRect(index).top() <= area.bottom();
+       index = indexBelow(index)) {
+
+    const QVariant modIndex = index.data(ModList::IndexRole);
+    if (!modIndex.isValid()) {
+      // group
+      continue;
+    }
+
+    const auto i = modIndex.toUInt();
+    if (i < count && !queued[i]) {
+      queued[i] = true;
+      visible.push_back(static_cast<int>(i));
+    }
+  }
+
+  // batches are taken from the end
+  m_pendingConflictRows.clear();
+
+  for (std::size_t i = count; i > 0; --i) {
+    if (!queued[i - 1]) {
+      m_pendingConflictRows.push_back(static_cast<int>(i - 1));
+    }
+  }
+
+  m_pendingConflictRows.insert(
+    m_pendingConflictRows.end(), visible.rbegin(), visible.rend());
+
+  publishConflictsBatch();
+}
+
+void ModListView::publishConflictsBatch()
+{
+  const int count = m_core->modList()->rowCount();
+  std::vector<int> rows;
+
+  while (!m_pendingConflictRows.empty() && rows.size() < ConflictRowsPerBatch) {
+    const int row = m_pendingConflictRows.back();
+    m_pendingConflictRows.pop_back();
+
+    // mods might have been removed since
+    if (row < count) {
+      rows.push_back(row);
+    }
+  }
+
+  std::sort(rows.begin(), rows.end());
+
+  // consecutive rows are notified together
+  for (std::size_t i = 0; i < rows.size();) {
+    std::size_t j = i + 1;
+    while (j < rows.size() && rows[j] == rows[j - 1] + 1) {
+      ++j;
+    }
+
+    m_core->modList()->notifyChange(rows[i], rows[j - 1]);
+    i = j;
+  }
+
+  if (!m_pendingConflictRows.empty()) {
+    m_conflictsTimer.start();
+  }
+}
+
 void ModListView::onModInstalled(const QString& modName)
 {
   unsigned int index = ModInfo::getIndex(modName);
@@ -485,7 +571,7 @@ ModListView::ModCounters ModListView::counters() const
     const auto flags = info->getFlags();
 
     const bool enabled = m_core->currentProfile()->modEnabled(index);
-    const bool visible = m_sortProxy->filterMatchesMod(info, enabled);
+    const bool visible = m_sortProxy->filterMatchesMod(index, enabled);
 
     if (info->isBackup()) {
       c.backup++;
@@ -687,6 +773,7 @@ void ModListView::setup(OrganizerCore& core, CategoryFactory& factory, MainWindo
 
   connect(m_core, &OrganizerCore::modInstalled, [=](auto&& name) { onModInstalled(name); });
   connect(m_core, &OrganizerCore::profileChanged, this, &ModListView::onProfileChanged);
+  connect(m_core, &OrganizerCore::conflictsReady, [=] { onConflictsReady(); });
   connect(core.modList(), &ModList::modPrioritiesChanged, [=](auto&& indices) { onModPrioritiesChanged(indices); });
   connect(core.modList(), &ModList::clearOverwrite, [=] { m_actions->clearOverwrite(); });
   connect(core.modList(), &ModList::modStatesChanged, [=] {
@@ -1034,9 +1121,8 @@ void ModListView::setHighlightedMods(const std::vector<unsigned int>& pluginIndi
     QString pluginName = m_core->pluginList()->getName(idx);
 
     const MOShared::FileEntryPtr fileEntry = directoryEntry.findFile(pluginName.toStdWString());
-    if (fileEntry.get() != nullptr) {
-      QString originName = QString::fromStdWString(directoryEntry.getOriginByID(fileEntry->getOrigin()).getName());
-      const auto index = ModInfo::getIndex(originName);
+    if (fileEntry != nullptr) {
+      const auto index = directoryEntry.getOriginConnection()->modIndex(fileEntry->getOrigin());
       if (index != UINT_MAX) {
         m_markers.highlight.insert(index);
       }
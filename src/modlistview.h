@@ -250,6 +250,12 @@ private: // private functions
 
   void onModPrioritiesChanged(const QModelIndexList& indices);
   void onModInstalled(const QString& modName);
+
+  // the conflicts of all the mods are available, the rows are repainted in
+  // batches, visible ones first
+  //
+  void onConflictsReady();
+  void publishConflictsBatch();
   void onModFilterActive(bool filterActive);
 
   // refresh the overwrite markers and the highligthed plugins from
@@ -322,6 +328,11 @@ public: // member variables
   // time in a row
   QTimer m_refreshMarkersTimer;
 
+  // mod indices that still have to be repainted after the conflicts became
+  // available, the next batch is at the end
+  std::vector<int> m_pendingConflictRows;
+  QTimer m_conflictsTimer;
+
   // maintain collapsed items for each proxy to avoid
   // losing them on model reset
   std::map<QAbstractItemModel*, std::set<QString>> m_collapsed;
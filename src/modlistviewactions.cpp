@@ -523,6 +523,9 @@ void ModListViewActions::displayModInformation(ModInfo::Ptr modInfo, unsigned in
   }
 
   if (m_core.currentProfile()->modEnabled(modIndex) && !modInfo->isForeign()) {
+    // the conflicts job walks the same structure
+    m_core.stopConflictsJob();
+
     FilesOrigin& origin = m_core.directoryStructure()->getOriginByName(ToWString(modInfo->name()));
     origin.enable(false);
 
@@ -538,6 +541,9 @@ void ModListViewActions::displayModInformation(ModInfo::Ptr modInfo, unsigned in
         , modInfo->archives());
       DirectoryRefresher::cleanStructure(m_core.directoryStructure());
       m_core.directoryStructure()->getFileRegister()->sortOrigins();
+
+      // the files of the mod might have changed in the dialog
+      m_core.clearCaches({ modIndex });
       m_core.refreshLists();
     }
   }
@@ -34,6 +34,7 @@
 #include "directoryrefresher.h"
 #include "shared/directoryentry.h"
 #include "shared/filesorigin.h"
+#include "shared/originconnection.h"
 #include "shared/fileentry.h"
 #include "shared/util.h"
 
@@ -98,11 +99,15 @@ OrganizerCore::OrganizerCore(Settings &settings)
   , m_DirectoryRefresher(new DirectoryRefresher(settings.refreshThreadCount()))
   , m_DirectoryStructure(new DirectoryEntry(L"data", nullptr, 0))
   , m_DownloadManager(&NexusInterface::instance(), this)
+  , m_ConflictMatrixCancel(false)
+  , m_ConflictMatrixBuilding(false)
+  , m_ConflictMatrixGeneration(0)
   , m_DirectoryUpdate(false)
   , m_ArchivesInit(false)
   , m_PluginListsWriter(std::bind(&OrganizerCore::savePluginList, this))
 {
   env::setHandleCloserThreadCount(settings.refreshThreadCount());
+  OriginConnection::setModIndexResolver(&ModInfo::modIndexResolver());
   m_DownloadManager.setOutputDirectory(m_Settings.paths().downloads(), false);
 
   NexusInterface::instance().setCacheDirectory(m_Settings.paths().cache());
@@ -115,6 +120,11 @@ OrganizerCore::OrganizerCore(Settings &settings)
   connect(m_DirectoryRefresher.get(), SIGNAL(refreshed()), this,
           SLOT(directory_refreshed()));
 
+  connect(&m_FileWatcher, &FileWatcher::changed,
+          [&](auto&& changes) { onFilesChanged(changes); });
+  connect(&m_FileWatcher, &FileWatcher::overflowed,
+          [&] { refreshDirectoryStructure(); });
+
   connect(&m_ModList, SIGNAL(removeOrigin(QString)), this,
           SLOT(removeOrigin(QString)));
   connect(&m_ModList, &ModList::modStatesChanged, [=] { currentProfile()->writeModlist(); });
@@ -165,6 +175,13 @@ OrganizerCore::~OrganizerCore()
     m_StructureDeleter.join();
   }
 
+  stopConflictsJob();
+
+  if (m_DirectoryStructure) {
+    // refreshes don't write the snapshot themselves, it would delay them
+    m_DirectoryRefresher->saveSnapshot(*m_DirectoryStructure);
+  }
+
   saveCurrentProfile();
 
   // profile has to be cleaned up before the modinfo-buffer is cleared
@@ -362,8 +379,18 @@ void OrganizerCore::downloadRequested(QNetworkReply *reply, QString gameName, in
 
 void OrganizerCore::removeOrigin(const QString &name)
 {
+  stopConflictsJob();
+
   FilesOrigin &origin = m_DirectoryStructure->getOriginByName(ToWString(name));
   origin.enable(false);
+
+  // the mod has already been removed from the list, so the conflicts of every
+  // mod are cleared instead of only the ones it was in conflict with
+  invalidateConflictMatrix();
+  for (unsigned int i = 0; i < ModInfo::getNumMods(); ++i) {
+    ModInfo::getByIndex(i)->clearCaches();
+  }
+
   refreshLists();
 }
 
@@ -901,7 +928,7 @@ QString OrganizerCore::resolvePath(const QString &fileName) const
   }
   const FileEntryPtr file
       = m_DirectoryStructure->searchFile(ToWString(fileName), nullptr);
-  if (file.get() != nullptr) {
+  if (file != nullptr) {
     return ToQString(file->getFullPath());
   } else {
     return QString();
@@ -931,13 +958,20 @@ QStringList OrganizerCore::findFiles(
   if (!path.isEmpty() && path != ".")
     dir = dir->findSubDirectoryRecursive(ToWString(path));
   if (dir != nullptr) {
-    std::vector<FileEntryPtr> files = dir->getFiles();
-    for (FileEntryPtr &file: files) {
-      QString fullPath = ToQString(file->getFullPath());
-      if (filter(ToQString(file->getName()))) {
-        result.append(fullPath);
+    // reused for every file
+    std::wstring fullPath;
+
+    dir->forEachFile([&](const FileEntry& file) {
+      const auto name = file.getName();
+
+      if (filter(QString::fromWCharArray(name.data(), static_cast<int>(name.size())))) {
+        fullPath.clear();
+        file.appendFullPath(fullPath);
+        result.append(QString::fromStdWString(fullPath));
       }
-    }
+
+      return true;
+    });
   }
   return result;
 }
@@ -947,7 +981,7 @@ QStringList OrganizerCore::getFileOrigins(const QString &fileName) const
   QStringList result;
   const FileEntryPtr file = m_DirectoryStructure->searchFile(ToWString(fileName), nullptr);
 
-  if (file.get() != nullptr) {
+  if (file != nullptr) {
     result.append(ToQString(
         m_DirectoryStructure->getOriginByID(file->getOrigin()).getName()));
     foreach (const auto& i, file->getAlternatives()) {
@@ -968,16 +1002,21 @@ QList<MOBase::IOrganizer::FileInfo> OrganizerCore::findFileInfos(
   if (!path.isEmpty() && path != ".")
     dir = dir->findSubDirectoryRecursive(ToWString(path));
   if (dir != nullptr) {
-    std::vector<FileEntryPtr> files = dir->getFiles();
-    for (FileEntryPtr file : files) {
+    // reused for every file
+    std::wstring fullPath;
+
+    dir->forEachFile([&](const FileEntry& file) {
+      fullPath.clear();
+      file.appendFullPath(fullPath);
+
       IOrganizer::FileInfo info;
-      info.filePath    = ToQString(file->getFullPath());
+      info.filePath    = QString::fromStdWString(fullPath);
       bool fromArchive = false;
       info.origins.append(ToQString(
-          m_DirectoryStructure->getOriginByID(file->getOrigin(fromArchive))
+          m_DirectoryStructure->getOriginByID(file.getOrigin(fromArchive))
               .getName()));
-      info.archive = fromArchive ? ToQString(file->getArchive().name()) : "";
-      for (const auto& idx : file->getAlternatives()) {
+      info.archive = fromArchive ? ToQString(file.getArchiveName()) : "";
+      for (const auto& idx : file.getAlternatives()) {
         info.origins.append(
             ToQString(m_DirectoryStructure->getOriginByID(idx.originID()).getName()));
       }
@@ -985,11 +1024,121 @@ QList<MOBase::IOrganizer::FileInfo> OrganizerCore::findFileInfos(
       if (filter(info)) {
         result.append(info);
       }
-    }
+
+      return true;
+    });
   }
   return result;
 }
 
+void OrganizerCore::findFilesMatching(
+  const QString& path, const std::vector<GlobPattern<wchar_t>>& patterns,
+  bool recursive, FileInfoFields fields,
+  const std::function<bool (const IOrganizer::FileInfo&)>& f) const
+{
+  if (m_DirectoryStructure == nullptr) {
+    return;
+  }
+
+  const DirectoryEntry* root = m_DirectoryStructure;
+  if (!path.isEmpty() && path != ".") {
+    root = m_DirectoryStructure->findSubDirectoryRecursive(ToWString(path));
+  }
+
+  if (root == nullptr) {
+    return;
+  }
+
+  // directories have the lowercase names of their files, so the patterns are
+  // lowercased once and matched case-sensitively against them
+  std::vector<GlobPattern<wchar_t>> lowercasePatterns;
+  lowercasePatterns.reserve(patterns.size());
+
+  for (auto&& p : patterns) {
+    lowercasePatterns.emplace_back(ToLowerCopy(p.native()));
+  }
+
+  auto matches = [&](std::wstring_view name) {
+    for (auto&& p : lowercasePatterns) {
+      if (p.match(name, true)) {
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  // reused for every file
+  IOrganizer::FileInfo info;
+  std::wstring fullPath;
+  bool stop = false;
+
+  // depth-first, in the same order as the tree
+  std::vector<const DirectoryEntry*> dirs = {root};
+
+  while (!dirs.empty() && !stop) {
+    const auto* dir = dirs.back();
+    dirs.pop_back();
+
+    dir->forEachFileName([&](std::wstring_view name, FileIndex index) {
+      if (!matches(name)) {
+        return true;
+      }
+
+      const auto file = dir->getFileByIndex(index);
+      if (!file) {
+        return true;
+      }
+
+      if (fields & FileInfoPath) {
+        fullPath.clear();
+        file->appendFullPath(fullPath);
+        info.filePath = QString::fromStdWString(fullPath);
+      }
+
+      if (fields & (FileInfoOrigins | FileInfoArchive)) {
+        bool fromArchive = false;
+        const auto origin = file->getOrigin(fromArchive);
+
+        if (fields & FileInfoOrigins) {
+          info.origins.clear();
+          info.origins.append(ToQString(
+            m_DirectoryStructure->getOriginByID(origin).getName()));
+
+          for (const auto& alt : file->getAlternatives()) {
+            info.origins.append(ToQString(
+              m_DirectoryStructure->getOriginByID(alt.originID()).getName()));
+          }
+        }
+
+        if (fields & FileInfoArchive) {
+          info.archive = fromArchive ?
+            ToQString(file->getArchiveName()) : QString();
+        }
+      }
+
+      if (!f(info)) {
+        stop = true;
+        return false;
+      }
+
+      return true;
+    });
+
+    if (recursive && !stop) {
+      // pushed in reverse so they're popped in order
+      const auto first = dirs.size();
+
+      dir->forEachDirectory([&](const DirectoryEntry& d) {
+        dirs.push_back(&d);
+        return true;
+      });
+
+      std::reverse(dirs.begin() + first, dirs.end());
+    }
+  }
+}
+
 DownloadManager *OrganizerCore::downloadManager()
 {
   return &m_DownloadManager;
@@ -1037,7 +1186,7 @@ bool OrganizerCore::previewFileWithAlternatives(
 
   const FileEntryPtr file = directoryStructure()->searchFile(ToWString(fileName), nullptr);
 
-  if (file.get() == nullptr) {
+  if (file == nullptr) {
     reportError(tr("file not found: %1").arg(qUtf8Printable(fileName)));
     return false;
   }
@@ -1283,7 +1432,7 @@ void OrganizerCore::updateModsActiveState(const QList<unsigned int> &modIndices,
     for (const QString &esm :
       dir.entryList(QStringList() << "*.esm", QDir::Files)) {
       const FileEntryPtr file = m_DirectoryStructure->findFile(ToWString(esm));
-      if (file.get() == nullptr) {
+      if (file == nullptr) {
         log::warn("failed to activate {}", esm);
         continue;
       }
@@ -1299,7 +1448,7 @@ void OrganizerCore::updateModsActiveState(const QList<unsigned int> &modIndices,
     for (const QString &esl :
       dir.entryList(QStringList() << "*.esl", QDir::Files)) {
       const FileEntryPtr file = m_DirectoryStructure->findFile(ToWString(esl));
-      if (file.get() == nullptr) {
+      if (file == nullptr) {
         log::warn("failed to activate {}", esl);
         continue;
       }
@@ -1315,7 +1464,7 @@ void OrganizerCore::updateModsActiveState(const QList<unsigned int> &modIndices,
     QStringList esps = dir.entryList(QStringList() << "*.esp", QDir::Files);
     for (const QString &esp : esps) {
       const FileEntryPtr file = m_DirectoryStructure->findFile(ToWString(esp));
-      if (file.get() == nullptr) {
+      if (file == nullptr) {
         log::warn("failed to activate {}", esp);
         continue;
       }
@@ -1349,6 +1498,8 @@ void OrganizerCore::updateModInDirectoryStructure(unsigned int index,
 
 void OrganizerCore::updateModsInDirectoryStructure(QMap<unsigned int, ModInfo::Ptr> modInfo)
 {
+  stopConflictsJob();
+
   std::vector<DirectoryRefresher::EntryInfo> entries;
 
   for (auto idx : modInfo.keys()) {
@@ -1514,26 +1665,38 @@ void OrganizerCore::directory_refreshed()
   DirectoryEntry *newStructure = m_DirectoryRefresher->stealDirectoryStructure();
   Q_ASSERT(newStructure != m_DirectoryStructure);
 
+  // the current structure is about to be patched or deleted
+  stopConflictsJob();
+
   if (newStructure == nullptr) {
-    // TODO: don't know why this happens, this slot seems to get called twice
-    // with only one emit
-    return;
-  }
+    // an incremental refresh doesn't build a new structure, it only gives the
+    // origins that have to be patched into the current one
+    if (!m_DirectoryRefresher->applyIncrementalChanges(m_DirectoryStructure)) {
+      // TODO: don't know why this happens, this slot seems to get called twice
+      // with only one emit
+      return;
+    }
+  } else {
+    std::swap(m_DirectoryStructure, newStructure);
 
-  std::swap(m_DirectoryStructure, newStructure);
+    if (m_StructureDeleter.joinable()) {
+      m_StructureDeleter.join();
+    }
 
-  if (m_StructureDeleter.joinable()) {
-    m_StructureDeleter.join();
+    m_StructureDeleter = MOShared::startSafeThread([=]{
+      log::debug("structure deleter thread start");
+      delete newStructure;
+      log::debug("structure deleter thread done");
+    });
   }
 
-  m_StructureDeleter = MOShared::startSafeThread([=]{
-    log::debug("structure deleter thread start");
-    delete newStructure;
-    log::debug("structure deleter thread done");
-  });
-
   m_DirectoryUpdate = false;
 
+  // started right away instead of on the first request, the mod list needs
+  // the conflicts of every mod as soon as it's repainted
+  invalidateConflictMatrix();
+  conflictMatrix();
+
   log::debug("clearing caches");
   for (int i = 0; i < m_ModList.rowCount(); ++i) {
     ModInfo::Ptr modInfo = ModInfo::getByIndex(i);
@@ -1555,11 +1718,105 @@ void OrganizerCore::directory_refreshed()
     refreshLists();
   }
 
+  if (m_Settings.watchFiles() && m_GamePlugin != nullptr) {
+    m_FileWatcher.watch(
+      m_Settings.paths().mods(), m_Settings.paths().overwrite(),
+      m_GamePlugin->dataDirectory().absolutePath());
+  } else {
+    m_FileWatcher.stop();
+  }
+
   emit directoryStructureReady();
 
   log::debug("refresh done");
 }
 
+void OrganizerCore::onFilesChanged(const FileWatcher::Changes& changes)
+{
+  if (m_DirectoryUpdate) {
+    // the structure is being replaced, the changes are applied to the new one
+    // since they might have been missed
+    m_PostRefreshTasks.append([this, changes]{ onFilesChanged(changes); });
+    return;
+  }
+
+  TimeThis tt("OrganizerCore::onFilesChanged()");
+
+  stopConflictsJob();
+
+  // active origins by their lowercase path
+  std::map<std::wstring, FilesOrigin*> origins;
+
+  m_DirectoryStructure->getOriginConnection()->forEachOrigin([&](auto&& o) {
+    origins.emplace(
+      ToLowerCopy(o.getPath()), &m_DirectoryStructure->getOriginByID(o.getID()));
+  });
+
+  std::vector<unsigned int> modIndices;
+  bool listsChanged = false;
+  bool structureChanged = false;
+
+  for (auto&& [originPath, paths] : changes) {
+    auto itor = origins.find(originPath);
+    if (itor == origins.end()) {
+      // not an active origin
+      continue;
+    }
+
+    auto& origin = *itor->second;
+    bool originChanged = false;
+
+    for (const auto& path : paths) {
+      if (DirectoryRefresher::isIgnoredPath(path)) {
+        // not in the structure, such as the meta.ini files written by MO
+        // itself
+        continue;
+      }
+
+      log::debug(
+        "files changed in '{}': '{}'", origin.getName(),
+        path.empty() ? L"*" : path);
+
+      m_DirectoryStructure->syncOriginPath(origin, path);
+      originChanged = true;
+
+      // plugins and archives are in the root of an origin
+      if (path.find_first_of(L"\\/") == std::wstring::npos) {
+        listsChanged = true;
+      }
+    }
+
+    if (!originChanged) {
+      continue;
+    }
+
+    structureChanged = true;
+
+    const auto index =
+      m_DirectoryStructure->getOriginConnection()->modIndex(origin.getID());
+
+    if (index != UINT_MAX) {
+      modIndices.push_back(index);
+    }
+  }
+
+  if (!structureChanged) {
+    return;
+  }
+
+  DirectoryRefresher::cleanStructure(m_DirectoryStructure);
+
+  // conflict flags of these mods and of the ones they conflict with
+  clearCaches(modIndices);
+  m_ModList.notifyChange(0, m_ModList.rowCount() - 1);
+
+  if (listsChanged && m_CurrentProfile != nullptr) {
+    refreshLists();
+  }
+
+  emit directoryStructureChanged();
+}
+
 void OrganizerCore::profileRefresh()
 {
   refresh();
@@ -1567,35 +1824,38 @@ void OrganizerCore::profileRefresh()
 
 void OrganizerCore::clearCaches(std::vector<unsigned int> const& indices) const
 {
-  const auto insert = [](auto& dest, const auto& from) {
-    dest.insert(from.begin(), from.end());
+  const auto insert = [](auto& dest, const ModInfo::Ptr& modInfo) {
+    for (auto* list : {
+      &modInfo->getModOverwrite(), &modInfo->getModOverwritten(),
+      &modInfo->getModArchiveOverwrite(), &modInfo->getModArchiveOverwritten(),
+      &modInfo->getModArchiveLooseOverwrite(), &modInfo->getModArchiveLooseOverwritten()})
+    {
+      dest.insert(list->begin(), list->end());
+    }
   };
+
   std::set<unsigned int> allIndices;
-  for (const auto index : indices) {
-    ModInfo::Ptr modInfo = ModInfo::getByIndex(index);
 
-    if (m_CurrentProfile->modEnabled(index)) {
-      // if the mod is enabled, we need to first clear its cache so that
-      // getModOverwrite(), ..., returns the newly conflicting mods (in case
-      // the mod just got enabled)
+  // if a mod is disabled, we need to first fetch the conflicting mods from
+  // the current matrix, before it's built again without that mod
+  for (const auto index : indices) {
+    if (!m_CurrentProfile->modEnabled(index)) {
+      ModInfo::Ptr modInfo = ModInfo::getByIndex(index);
+      insert(allIndices, modInfo);
       modInfo->clearCaches();
-      insert(allIndices, modInfo->getModOverwrite());
-      insert(allIndices, modInfo->getModOverwritten());
-      insert(allIndices, modInfo->getModArchiveOverwrite());
-      insert(allIndices, modInfo->getModArchiveOverwritten());
-      insert(allIndices, modInfo->getModArchiveLooseOverwrite());
-      insert(allIndices, modInfo->getModArchiveLooseOverwritten());
     }
-    else {
-      // if the mod is disabled, we need to first fetch the conflicting
-      // mods, and then clear the cache
-      insert(allIndices, modInfo->getModOverwrite());
-      insert(allIndices, modInfo->getModOverwritten());
-      insert(allIndices, modInfo->getModArchiveOverwrite());
-      insert(allIndices, modInfo->getModArchiveOverwritten());
-      insert(allIndices, modInfo->getModArchiveLooseOverwrite());
-      insert(allIndices, modInfo->getModArchiveLooseOverwritten());
+  }
+
+  invalidateConflictMatrix();
+
+  // if a mod is enabled, we need to first clear its cache so that
+  // getModOverwrite(), ..., returns the newly conflicting mods (in case the
+  // mod just got enabled)
+  for (const auto index : indices) {
+    if (m_CurrentProfile->modEnabled(index)) {
+      ModInfo::Ptr modInfo = ModInfo::getByIndex(index);
       modInfo->clearCaches();
+      insert(allIndices, modInfo);
     }
   }
 
@@ -1604,31 +1864,200 @@ void OrganizerCore::clearCaches(std::vector<unsigned int> const& indices) const
   }
 }
 
+std::shared_ptr<const ConflictMatrix> OrganizerCore::conflictMatrix() const
+{
+  std::scoped_lock lock(m_ConflictMatrixMutex);
+
+  if (m_ConflictMatrix || m_ConflictMatrixBuilding) {
+    return m_ConflictMatrix;
+  }
+
+  if (m_ConflictMatrixThread.joinable()) {
+    // the previous job is done but its result was not delivered yet
+    m_ConflictMatrixThread.join();
+  }
+
+  log::debug("computing conflicts in the background");
+
+  m_ConflictMatrixBuilding = true;
+
+  auto* self = const_cast<OrganizerCore*>(this);
+  auto* root = m_DirectoryStructure;
+  const auto threads = m_Settings.refreshThreadCount();
+  const auto generation = m_ConflictMatrixGeneration;
+
+  m_ConflictMatrixThread = MOShared::startSafeThread([=] {
+    MOShared::SetThisThreadName("ConflictMatrix");
+
+    auto m = ConflictMatrix::build(*root, threads, &m_ConflictMatrixCancel);
+    if (!m) {
+      // cancelled
+      return;
+    }
+
+    QMetaObject::invokeMethod(self, [=] {
+      self->onConflictMatrixBuilt(m, generation);
+    }, Qt::QueuedConnection);
+  });
+
+  return {};
+}
+
+void OrganizerCore::onConflictMatrixBuilt(
+  std::shared_ptr<ConflictMatrix> m, unsigned int generation)
+{
+  {
+    std::scoped_lock lock(m_ConflictMatrixMutex);
+
+    if (generation != m_ConflictMatrixGeneration) {
+      // the job was stopped after this was queued
+      return;
+    }
+
+    if (m_ConflictMatrixThread.joinable()) {
+      m_ConflictMatrixThread.join();
+    }
+
+    m_ConflictMatrix = std::move(m);
+    m_ConflictMatrixBuilding = false;
+  }
+
+  // the mods cached their conflicts as pending
+  for (unsigned int i = 0; i < ModInfo::getNumMods(); ++i) {
+    ModInfo::getByIndex(i)->clearCaches();
+  }
+
+  emit conflictsReady();
+}
+
+void OrganizerCore::stopConflictsJob() const
+{
+  std::thread t;
+
+  {
+    std::scoped_lock lock(m_ConflictMatrixMutex);
+
+    t = std::move(m_ConflictMatrixThread);
+
+    if (m_ConflictMatrixBuilding) {
+      m_ConflictMatrixBuilding = false;
+      ++m_ConflictMatrixGeneration;
+    }
+  }
+
+  // joined without the lock, the job might need other locks, such as the one
+  // for mod indices
+  if (t.joinable()) {
+    m_ConflictMatrixCancel = true;
+    t.join();
+    m_ConflictMatrixCancel = false;
+  }
+}
+
+void OrganizerCore::invalidateConflictMatrix() const
+{
+  stopConflictsJob();
+
+  std::scoped_lock lock(m_ConflictMatrixMutex);
+  m_ConflictMatrix.reset();
+}
+
 void OrganizerCore::modPrioritiesChanged(const QModelIndexList& indices)
 {
+  stopConflictsJob();
+
+  std::vector<unsigned int> vindices;
+
+  for (auto& idx : indices) {
+    vindices.push_back(idx.data(ModList::IndexRole).toInt());
+  }
+
+  const std::set<unsigned int> movedMods(vindices.begin(), vindices.end());
+
+  // origins of the mods that were moved, and the old and new priorities of
+  // all the other ones
+  struct Other
+  {
+    OriginID id;
+    int oldPriority, newPriority;
+  };
+
+  std::vector<OriginID> moved;
+  std::vector<Other> others;
+
   for (unsigned int i = 0; i < currentProfile()->numMods(); ++i) {
     int priority = currentProfile()->getModPriority(i);
     if (currentProfile()->modEnabled(i)) {
       ModInfo::Ptr modInfo = ModInfo::getByIndex(i);
       // priorities in the directory structure are one higher because data is 0
-      directoryStructure()->getOriginByName(MOBase::ToWString(modInfo->internalName())).setPriority(priority + 1);
+      FilesOrigin& origin = directoryStructure()->getOriginByName(MOBase::ToWString(modInfo->internalName()));
+
+      if (movedMods.contains(i)) {
+        moved.push_back(origin.getID());
+      } else {
+        others.push_back({origin.getID(), origin.getPriority(), priority + 1});
+      }
+
+      origin.setPriority(priority + 1);
     }
   }
   refreshBSAList();
   currentProfile()->writeModlist();
-  directoryStructure()->getFileRegister()->sortOrigins();
 
-  std::vector<unsigned int> vindices;
+  // the other mods only shift to make room for the moved ones, so the files
+  // of the moved mods are the only ones that need to be sorted again; if the
+  // others changed order between themselves, they're all considered moved
+  std::sort(others.begin(), others.end(), [](auto&& a, auto&& b) {
+    return (a.oldPriority < b.oldPriority);
+  });
 
-  for (auto& idx : indices) {
-    vindices.push_back(idx.data(ModList::IndexRole).toInt());
+  const bool othersKeptOrder = std::is_sorted(
+    others.begin(), others.end(), [](auto&& a, auto&& b) {
+      return (a.newPriority < b.newPriority);
+    });
+
+  if (!othersKeptOrder) {
+    for (const auto& o : others) {
+      if (o.oldPriority != o.newPriority) {
+        moved.push_back(o.id);
+      }
+    }
+  }
+
+  std::set<OriginID> changed;
+  bool updated = false;
+
+  {
+    std::scoped_lock lock(m_ConflictMatrixMutex);
+
+    if (m_ConflictMatrix) {
+      updated = m_ConflictMatrix->updatePriorities(
+        *m_DirectoryStructure, moved, changed);
+    }
+  }
+
+  if (!updated) {
+    directoryStructure()->getFileRegister()->sortOrigins();
+    clearCaches(vindices);
+    return;
   }
 
-  clearCaches(vindices);
+  // only the mods sharing files with the moved ones can have different
+  // conflicts
+  const auto origins = m_DirectoryStructure->getOriginConnection();
+
+  for (const auto id : changed) {
+    const auto index = origins->modIndex(id);
+    if (index != UINT_MAX) {
+      ModInfo::getByIndex(index)->clearCaches();
+    }
+  }
 }
 
 void OrganizerCore::modStatusChanged(unsigned int index)
 {
+  stopConflictsJob();
+
   try {
     ModInfo::Ptr modInfo = ModInfo::getByIndex(index);
     if (m_CurrentProfile->modEnabled(index)) {
@@ -1667,6 +2096,8 @@ void OrganizerCore::modStatusChanged(unsigned int index)
 }
 
 void OrganizerCore::modStatusChanged(QList<unsigned int> index) {
+  stopConflictsJob();
+
   try {
     QMap<unsigned int, ModInfo::Ptr> modsToEnable;
     QMap<unsigned int, ModInfo::Ptr> modsToDisable;
@@ -2072,7 +2503,7 @@ std::vector<Mapping> OrganizerCore::fileMapping(
 
     QString originPath
         = QString::fromStdWString(base->getOriginByID(origin).getPath());
-    QString fileName = QString::fromStdWString(current->getName());
+    QString fileName = ToQString(current->getName());
 //    QString fileName = ToQString(current->getName());
     QString source   = originPath + relPath + fileName;
     QString target   = dataPath + relPath + fileName;
@@ -2084,10 +2515,14 @@ std::vector<Mapping> OrganizerCore::fileMapping(
   // recurse into subdirectories
   for (const auto& d : directoryEntry->getSubDirectories()) {
     int origin = d->anyOrigin();
+    if (origin == InvalidOriginID) {
+      // nothing in this directory comes from an origin, nothing to map
+      continue;
+    }
 
     QString originPath
         = QString::fromStdWString(base->getOriginByID(origin).getPath());
-    QString dirName = QString::fromStdWString(d->getName());
+    QString dirName = ToQString(d->getName());
     QString source  = originPath + relPath + dirName;
     QString target  = dataPath + relPath + dirName;
 
@@ -14,6 +14,9 @@
 #include "processrunner.h"
 #include "uilocker.h"
 #include "envdump.h"
+#include "filewatcher.h"
+#include "conflictmatrix.h"
+#include "glob_matching.h"
 #include <imoinfo.h>
 #include <iplugindiagnose.h>
 #include <versioninfo.h>
@@ -94,6 +97,20 @@ private:
 
 public:
 
+  // fields of the FileInfo given to the callback of findFilesMatching(),
+  // the others are left empty
+  //
+  enum FileInfoField
+  {
+    NoFileInfo      = 0x00,
+    FileInfoPath    = 0x01,
+    FileInfoOrigins = 0x02,
+    FileInfoArchive = 0x04,
+    AllFileInfo     = FileInfoPath | FileInfoOrigins | FileInfoArchive
+  };
+
+  Q_DECLARE_FLAGS(FileInfoFields, FileInfoField);
+
   /**
    * Small holder for the game content returned by the ModDataContent feature (the
    * list of all possible contents, not the per-mod content).
@@ -215,6 +232,23 @@ public:
   SelfUpdater *updater() { return &m_Updater; }
   InstallationManager *installationManager();
   MOShared::DirectoryEntry *directoryStructure() { return m_DirectoryStructure; }
+
+  // conflicts between all the mods in the current directory structure; they're
+  // computed in the background when the structure has changed, this returns
+  // null until they're ready and conflictsReady() is emitted
+  //
+  std::shared_ptr<const ConflictMatrix> conflictMatrix() const;
+
+  // stops computing the conflicts in the background, must be called before
+  // the directory structure is changed; they're computed again the next time
+  // they're needed
+  //
+  void stopConflictsJob() const;
+
+  // clear the conflict caches of all the given mods, and the mods in conflict
+  // with the given mods
+  //
+  void clearCaches(std::vector<unsigned int> const& indices) const;
   DirectoryRefresher *directoryRefresher() { return m_DirectoryRefresher.get(); }
   ExecutablesList *executablesList() { return &m_ExecutablesList; }
   void setExecutablesList(const ExecutablesList &executablesList) {
@@ -324,6 +358,20 @@ public:
   QStringList findFiles(const QString &path, const std::function<bool (const QString &)> &filter) const;
   QStringList getFileOrigins(const QString &fileName) const;
   QList<MOBase::IOrganizer::FileInfo> findFileInfos(const QString &path, const std::function<bool (const MOBase::IOrganizer::FileInfo &)> &filter) const;
+
+  // calls `f` for every file in `path` whose name matches any of the given
+  // patterns, case-insensitively, recursing into subdirectories if
+  // `recursive` is true; `f` returns false to stop
+  //
+  // names are matched before anything is built for a file and only the
+  // requested fields are filled, the FileInfo is reused between calls
+  //
+  void findFilesMatching(
+    const QString& path,
+    const std::vector<MOShared::GlobPattern<wchar_t>>& patterns,
+    bool recursive, FileInfoFields fields,
+    const std::function<bool (const MOBase::IOrganizer::FileInfo&)>& f) const;
+
   DownloadManager *downloadManager();
   PluginList *pluginList();
   ModList *modList();
@@ -397,6 +445,14 @@ signals:
   // Use queued connections
   void directoryStructureReady();
 
+  // the directory structure was updated in place after files were changed
+  // outside of MO
+  void directoryStructureChanged();
+
+  // the conflicts of all the mods are available, see conflictMatrix()
+  //
+  void conflictsReady();
+
 private:
 
   void saveCurrentProfile();
@@ -405,10 +461,14 @@ private:
   void updateModActiveState(int index, bool active);
   void updateModsActiveState(const QList<unsigned int> &modIndices, bool active);
 
-  // clear the conflict caches of all the given mods, and the mods in conflict
-  // with the given mods
+  // the conflict matrix will be built again the next time it's needed
   //
-  void clearCaches(std::vector<unsigned int> const& indices) const;
+  void invalidateConflictMatrix() const;
+
+  // called on the main thread when the background job is done
+  //
+  void onConflictMatrixBuilt(
+    std::shared_ptr<ConflictMatrix> m, unsigned int generation);
 
   bool createDirectory(const QString &path);
 
@@ -429,6 +489,7 @@ private:
 private slots:
 
   void directory_refreshed();
+  void onFilesChanged(const FileWatcher::Changes& changes);
   void downloadRequested(QNetworkReply *reply, QString gameName, int modID, const QString &fileName);
   void removeOrigin(const QString &name);
   void downloadSpeed(const QString &serverName, int bytesPerSecond);
@@ -483,6 +544,21 @@ private:
   QThread m_RefresherThread;
 
   std::thread m_StructureDeleter;
+  FileWatcher m_FileWatcher;
+
+  // null when the structure has changed since it was built, or while it's
+  // being built
+  mutable std::shared_ptr<ConflictMatrix> m_ConflictMatrix;
+  mutable std::mutex m_ConflictMatrixMutex;
+
+  // builds the matrix in the background
+  mutable std::thread m_ConflictMatrixThread;
+  mutable std::atomic<bool> m_ConflictMatrixCancel;
+  mutable bool m_ConflictMatrixBuilding;
+
+  // incremented every time the job is stopped, so results of previous jobs
+  // are ignored
+  mutable unsigned int m_ConflictMatrixGeneration;
 
   bool m_DirectoryUpdate;
   bool m_ArchivesInit;
@@ -493,4 +569,6 @@ private:
   UILocker m_UILocker;
 };
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(OrganizerCore::FileInfoFields);
+
 #endif // ORGANIZERCORE_H
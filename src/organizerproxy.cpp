@@ -248,18 +248,21 @@ QStringList OrganizerProxy::findFiles(const QString &path, const std::function<b
 
 QStringList OrganizerProxy::findFiles(const QString& path, const QStringList& globFilters) const
 {
-  QList<GlobPattern<QChar>> patterns;
+  std::vector<GlobPattern<wchar_t>> patterns;
   for (auto& gfilter : globFilters) {
-    patterns.append(GlobPattern(gfilter));
+    patterns.emplace_back(gfilter.toStdWString());
   }
-  return findFiles(path, [&patterns](const QString& filename) {
-    for (auto& p : patterns) {
-      if (p.match(filename)) {
-        return true;
-      }
-    }
-    return false;
-  });
+
+  // names are matched before any path is built
+  QStringList result;
+  m_Proxied->findFilesMatching(
+    path, patterns, false, OrganizerCore::FileInfoPath,
+    [&](const FileInfo& info) {
+      result.append(info.filePath);
+      return true;
+    });
+
+  return result;
 }
 
 QStringList OrganizerProxy::getFileOrigins(const QString &fileName) const
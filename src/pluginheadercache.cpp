@@ -0,0 +1,290 @@
+#include "pluginheadercache.h"
+#include "thread_utils.h"
+#include "shared/appconfig.h"
+#include "shared/snapshotio.h"
+#include "shared/util.h"
+#include <espfile.h>
+#include <log.h>
+#include <utility.h>
+#include <QApplication>
+#include <QFile>
+#include <QSaveFile>
+
+using namespace MOBase;
+using namespace MOShared;
+
+// "MOPC"
+constexpr uint32_t PluginCacheMagic = 0x43504f4d;
+
+// must be incremented every time the format changes, older caches are ignored
+constexpr uint32_t PluginCacheVersion = 1;
+
+
+void writeHeader(SnapshotWriter& w, const PluginHeader& h)
+{
+  w.write(static_cast<uint8_t>(h.valid));
+  w.write(static_cast<uint8_t>(h.isMaster));
+  w.write(static_cast<uint8_t>(h.isLightFlagged));
+  w.write(h.author);
+  w.write(h.description);
+  w.write(h.masters);
+}
+
+std::shared_ptr<const PluginHeader> readHeader(SnapshotReader& r)
+{
+  auto h = std::make_shared<PluginHeader>();
+
+  h->valid = (r.read<uint8_t>() != 0);
+  h->isMaster = (r.read<uint8_t>() != 0);
+  h->isLightFlagged = (r.read<uint8_t>() != 0);
+  h->author = r.readQString();
+  h->description = r.readQString();
+  h->masters = r.readQStringList();
+
+  return h;
+}
+
+
+PluginHeaderCache& PluginHeaderCache::instance()
+{
+  static PluginHeaderCache cache;
+  return cache;
+}
+
+QString PluginHeaderCache::path()
+{
+  return
+    qApp->property("dataPath").toString() + "/" +
+    QString::fromStdWString(AppConfig::pluginCacheFileName());
+}
+
+std::shared_ptr<const PluginHeader> PluginHeaderCache::parse(
+  const std::wstring& path)
+{
+  auto h = std::make_shared<PluginHeader>();
+
+  try {
+    ESP::File file(path);
+
+    h->isMaster = file.isMaster();
+    h->isLightFlagged = file.isLight();
+    h->author = QString::fromLatin1(file.author().c_str());
+    h->description = QString::fromLatin1(file.description().c_str());
+
+    for (auto&& m : file.masters()) {
+      h->masters.push_back(QString::fromStdString(m));
+    }
+
+    h->valid = true;
+  } catch (const std::exception &e) {
+    log::error("failed to parse plugin file {}: {}", path, e.what());
+  }
+
+  return h;
+}
+
+std::shared_ptr<const PluginHeader> PluginHeaderCache::get(
+  const std::wstring& pluginPath)
+{
+  WIN32_FILE_ATTRIBUTE_DATA fad = {};
+
+  if (!::GetFileAttributesExW(pluginPath.c_str(), GetFileExInfoStandard, &fad)) {
+    const auto e = ::GetLastError();
+
+    log::warn(
+      "failed to get last modified date for '{}', {}",
+      pluginPath, formatSystemMessage(e));
+
+    // can't be cached without its size and date
+    return parse(pluginPath);
+  }
+
+  const FILETIME fileTime = fad.ftLastWriteTime;
+  const uint64_t size =
+    (static_cast<uint64_t>(fad.nFileSizeHigh) << 32) | fad.nFileSizeLow;
+
+  const auto key = ToLowerCopy(pluginPath);
+
+  {
+    std::scoped_lock lock(m_mutex);
+
+    auto itor = m_entries.find(key);
+
+    if (itor != m_entries.end()) {
+      auto& e = itor->second;
+
+      if (e.size == size && ::CompareFileTime(&e.fileTime, &fileTime) == 0) {
+        e.used = true;
+        return e.header;
+      }
+    }
+  }
+
+  auto header = parse(pluginPath);
+
+  if (!header->valid) {
+    // not cached, the failure might be temporary, such as the file being
+    // locked by another tool, so it's parsed again next time
+    return header;
+  }
+
+  std::scoped_lock lock(m_mutex);
+
+  auto& e = m_entries[key];
+  e.size = size;
+  e.fileTime = fileTime;
+  e.header = header;
+  e.used = true;
+
+  m_dirty = true;
+
+  return header;
+}
+
+std::vector<std::shared_ptr<const PluginHeader>> PluginHeaderCache::get(
+  const std::vector<std::wstring>& pluginPaths, std::size_t threadCount)
+{
+  TimeThis tt("PluginHeaderCache::get()");
+
+  std::vector<std::shared_ptr<const PluginHeader>> headers(pluginPaths.size());
+
+  parallelMap(pluginPaths.begin(), pluginPaths.end(), [&](const std::wstring& p) {
+    const auto i = static_cast<std::size_t>(&p - pluginPaths.data());
+    headers[i] = get(p);
+  }, threadCount);
+
+  return headers;
+}
+
+bool PluginHeaderCache::load(const QString& path)
+{
+  TimeThis tt("PluginHeaderCache::load()");
+
+  std::scoped_lock lock(m_mutex);
+
+  if (m_loaded) {
+    return true;
+  }
+
+  m_loaded = true;
+
+  QFile f(path);
+
+  if (!f.exists()) {
+    return true;
+  }
+
+  try
+  {
+    if (!f.open(QIODevice::ReadOnly)) {
+      throw SnapshotError(f.errorString().toStdString());
+    }
+
+    const QByteArray bytes = f.readAll();
+    const auto* p = reinterpret_cast<const uchar*>(bytes.constData());
+
+    SnapshotReader r(p, p + bytes.size());
+
+    if (r.read<uint32_t>() != PluginCacheMagic) {
+      throw SnapshotError("not a plugin cache");
+    }
+
+    if (const auto v=r.read<uint32_t>(); v != PluginCacheVersion) {
+      log::debug(
+        "ignoring plugin cache '{}', version {} instead of {}",
+        path, v, PluginCacheVersion);
+
+      return true;
+    }
+
+    std::unordered_map<std::wstring, Entry> entries;
+
+    const auto count = r.read<uint32_t>();
+
+    for (uint32_t i=0; i<count; ++i) {
+      auto pluginPath = r.readString();
+
+      Entry e;
+      e.size = r.read<uint64_t>();
+      e.fileTime.dwLowDateTime = r.read<uint32_t>();
+      e.fileTime.dwHighDateTime = r.read<uint32_t>();
+      e.header = readHeader(r);
+
+      if (!e.header->valid) {
+        // failed headers are parsed again instead, see get()
+        continue;
+      }
+
+      entries.emplace(std::move(pluginPath), std::move(e));
+    }
+
+    m_entries = std::move(entries);
+
+    log::debug("plugin cache has {} plugins", m_entries.size());
+
+    return true;
+  }
+  catch(std::exception& e)
+  {
+    log::error("failed to load plugin cache '{}': {}", path, e.what());
+    return false;
+  }
+}
+
+bool PluginHeaderCache::save(const QString& path)
+{
+  std::scoped_lock lock(m_mutex);
+
+  if (!m_dirty) {
+    return true;
+  }
+
+  TimeThis tt("PluginHeaderCache::save()");
+
+  for (auto itor=m_entries.begin(); itor!=m_entries.end();) {
+    // failed headers are never persisted, see get()
+    if (itor->second.used && itor->second.header->valid) {
+      ++itor;
+    } else {
+      itor = m_entries.erase(itor);
+    }
+  }
+
+  m_dirty = false;
+
+  try
+  {
+    QSaveFile f(path);
+
+    if (!f.open(QIODevice::WriteOnly)) {
+      throw SnapshotError(f.errorString().toStdString());
+    }
+
+    SnapshotWriter w(f);
+
+    w.write(PluginCacheMagic);
+    w.write(PluginCacheVersion);
+    w.write(static_cast<uint32_t>(m_entries.size()));
+
+    for (const auto& [pluginPath, e] : m_entries) {
+      w.write(std::wstring_view(pluginPath));
+      w.write(e.size);
+      w.write(static_cast<uint32_t>(e.fileTime.dwLowDateTime));
+      w.write(static_cast<uint32_t>(e.fileTime.dwHighDateTime));
+      writeHeader(w, *e.header);
+    }
+
+    w.flush();
+
+    if (!f.commit()) {
+      throw SnapshotError(f.errorString().toStdString());
+    }
+
+    return true;
+  }
+  catch(std::exception& e)
+  {
+    log::error("failed to save plugin cache to '{}': {}", path, e.what());
+    return false;
+  }
+}
@@ -0,0 +1,84 @@
+#ifndef MODORGANIZER_PLUGINHEADERCACHE_INCLUDED
+#define MODORGANIZER_PLUGINHEADERCACHE_INCLUDED
+
+#include <QString>
+#include <QStringList>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+// what the plugin list needs from the header of a plugin
+//
+struct PluginHeader
+{
+  // false if the plugin couldn't be parsed, the other members are empty
+  bool valid = false;
+
+  bool isMaster = false;
+  bool isLightFlagged = false;
+  QString author;
+  QString description;
+  QStringList masters;
+};
+
+
+// keeps the header of every plugin that has been parsed, keyed by the path
+// of the plugin along with its size and last write time so a plugin that
+// changes on disk is parsed again
+//
+// the cache is saved in the instance directory, it's small enough to be
+// loaded entirely
+//
+class PluginHeaderCache
+{
+public:
+  static PluginHeaderCache& instance();
+
+  // path to the cache file for the current instance
+  //
+  static QString path();
+
+  // returns the header of the given plugin, parsing it if necessary; never
+  // null
+  //
+  std::shared_ptr<const PluginHeader> get(const std::wstring& pluginPath);
+
+  // returns the headers of all the given plugins in the same order, the ones
+  // that are not in the cache are parsed using `threadCount` threads
+  //
+  std::vector<std::shared_ptr<const PluginHeader>> get(
+    const std::vector<std::wstring>& pluginPaths, std::size_t threadCount);
+
+  // loads the given cache file, does nothing if a file has already been
+  // loaded; returns false on errors
+  //
+  bool load(const QString& path);
+
+  // saves the plugins that have been requested since the cache was loaded if
+  // any of them had to be parsed, does nothing otherwise; entries for plugins
+  // that were not requested are dropped
+  //
+  bool save(const QString& path);
+
+private:
+  static std::shared_ptr<const PluginHeader> parse(const std::wstring& path);
+
+  struct Entry
+  {
+    uint64_t size = 0;
+    FILETIME fileTime = {};
+    std::shared_ptr<const PluginHeader> header;
+
+    // whether the entry has been requested since the cache was loaded
+    bool used = false;
+  };
+
+  // keyed by lowercase path
+  std::unordered_map<std::wstring, Entry> m_entries;
+  bool m_loaded = false;
+  bool m_dirty = false;
+  std::mutex m_mutex;
+};
+
+#endif // MODORGANIZER_PLUGINHEADERCACHE_INCLUDED
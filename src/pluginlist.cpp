@@ -26,13 +26,14 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 #include "shared/directoryentry.h"
 #include "shared/filesorigin.h"
 #include "shared/fileentry.h"
+#include "shared/originconnection.h"
+#include "shared/util.h"
+#include "pluginheadercache.h"
 
 #include <utility.h>
 #include <iplugingame.h>
-#include <espfile.h>
 #include <report.h>
 #include "shared/windows_error.h"
-#include <safewritefile.h>
 #include <gameplugins.h>
 
 #include <QtDebug>
@@ -46,6 +47,7 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 #include <QFileInfo>
 #include <QListWidgetItem>
 #include <QRegularExpression>
+#include <QSet>
 #include <QString>
 #include <QApplication>
 #include <QKeyEvent>
@@ -95,9 +97,72 @@ static QString TruncateString(const QString& text)
 }
 
 
+// archives and ini files in the root of the data directory, so every plugin
+// can find its own without going through all the files again
+//
+class PluginFilesIndex
+{
+public:
+  explicit PluginFilesIndex(const std::vector<FileEntryPtr>& files)
+  {
+    for (FileEntryPtr file : files) {
+      if (file == nullptr) {
+        continue;
+      }
+
+      QString name = ToQString(file->getName());
+      QString lower = name.toLower();
+
+      if (lower.endsWith(".bsa") || lower.endsWith(".ba2")) {
+        m_Archives.push_back({std::move(lower), std::move(name)});
+      } else if (lower.endsWith(".ini")) {
+        lower.chop(4);
+        m_Inis.insert(std::move(lower));
+      }
+    }
+
+    std::sort(m_Archives.begin(), m_Archives.end());
+  }
+
+  // archives with a name starting with the given base name of a plugin
+  //
+  std::set<QString> archives(const QString& baseName) const
+  {
+    const QString prefix = baseName.toLower();
+    std::set<QString> result;
+
+    // all the names starting with the prefix are sorted right after it
+    auto itor = std::lower_bound(
+      m_Archives.begin(), m_Archives.end(), prefix,
+      [](auto&& a, auto&& p) { return a.first < p; });
+
+    for (; itor != m_Archives.end() && itor->first.startsWith(prefix); ++itor) {
+      result.insert(itor->second);
+    }
+
+    return result;
+  }
+
+  // whether there's an ini file with the given base name of a plugin
+  //
+  bool hasIni(const QString& baseName) const
+  {
+    return m_Inis.contains(baseName.toLower());
+  }
+
+private:
+  // lowercase name and name of each archive, sorted by lowercase name
+  std::vector<std::pair<QString, QString>> m_Archives;
+
+  // lowercase names of ini files without the extension
+  QSet<QString> m_Inis;
+};
+
+
 PluginList::PluginList(OrganizerCore& organizer)
   : QAbstractItemModel(&organizer)
   , m_Organizer(organizer)
+  , m_Saved(false)
   , m_FontMetrics(QFont())
 {
   connect(this, SIGNAL(writePluginsList()), this, SLOT(generatePluginIndexes()));
@@ -184,6 +249,14 @@ void PluginList::refresh(const QString &profileName
     m_ESPsByPriority.clear();
   }
 
+  // plugins are added and removed below, the graph is built again once
+  // they're all known
+  m_MasterGraph = {};
+
+  // the lists on disk might not match anymore, such as after a profile
+  // change, they're always written on the next save
+  m_Saved = false;
+
   ChangeBracket<PluginList> layoutChange(this);
 
   QStringList primaryPlugins = m_GamePlugin->primaryPlugins();
@@ -194,9 +267,18 @@ void PluginList::refresh(const QString &profileName
 
   QStringList availablePlugins;
 
+  // mod of every origin, fetched once for the whole loop
+  const auto modIndices = baseDirectory.getOriginConnection()->modIndices();
+
   std::vector<FileEntryPtr> files = baseDirectory.getFiles();
+  const PluginFilesIndex index(files);
+
+  // plugins that are not in the list yet, their headers are all read at once
+  std::vector<std::pair<FileEntryPtr, QString>> newPlugins;
+  std::vector<std::wstring> newPaths;
+
   for (FileEntryPtr current : files) {
-    if (current.get() == nullptr) {
+    if (current == nullptr) {
       continue;
     }
     QString filename = ToQString(current->getName());
@@ -211,44 +293,52 @@ void PluginList::refresh(const QString &profileName
         continue;
       }
 
-      bool forceEnabled = Settings::instance().game().forceEnableCoreFiles() &&
-        primaryPlugins.contains(filename, Qt::CaseInsensitive);
+      newPlugins.push_back({current, filename});
+      newPaths.push_back(current->getFullPath());
+    }
+  }
 
-      bool archive = false;
-      try {
-        FilesOrigin &origin = baseDirectory.getOriginByID(current->getOrigin(archive));
-
-        //name without extension
-        QString baseName = QFileInfo(filename).baseName();
-
-        QString iniPath = baseName + ".ini";
-        bool hasIni = baseDirectory.findFile(ToWString(iniPath)).get() != nullptr;
-        std::set<QString> loadedArchives;
-        QString candidateName;
-        for (FileEntryPtr archiveCandidate : files) {
-          candidateName = ToQString(archiveCandidate->getName());
-          if (candidateName.startsWith(baseName, Qt::CaseInsensitive) &&
-             (candidateName.endsWith(".bsa", Qt::CaseInsensitive) ||
-              candidateName.endsWith(".ba2", Qt::CaseInsensitive))) {
-            loadedArchives.insert(candidateName);
-          }
-        }
+  auto& headerCache = PluginHeaderCache::instance();
+  headerCache.load(PluginHeaderCache::path());
 
-        QString originName = ToQString(origin.getName());
-        unsigned int modIndex = ModInfo::getIndex(originName);
-        if (modIndex != UINT_MAX) {
-          ModInfo::Ptr modInfo = ModInfo::getByIndex(modIndex);
-          originName = modInfo->name();
-        }
+  const auto headers = headerCache.get(
+    newPaths, Settings::instance().refreshThreadCount());
+
+  for (std::size_t i = 0; i < newPlugins.size(); ++i) {
+    const FileEntryPtr current = newPlugins[i].first;
+    const QString& filename = newPlugins[i].second;
+
+    bool forceEnabled = Settings::instance().game().forceEnableCoreFiles() &&
+      primaryPlugins.contains(filename, Qt::CaseInsensitive);
 
-        m_ESPs.push_back(ESPInfo(filename, forceEnabled, originName, ToQString(current->getFullPath()), hasIni, loadedArchives, lightPluginsAreSupported));
-        m_ESPs.rbegin()->priority = -1;
-      } catch (const std::exception &e) {
-        reportError(tr("failed to update esp info for file %1 (source id: %2), error: %3").arg(filename).arg(current->getOrigin(archive)).arg(e.what()));
+    bool archive = false;
+    try {
+      FilesOrigin &origin = baseDirectory.getOriginByID(current->getOrigin(archive));
+
+      //name without extension
+      QString baseName = QFileInfo(filename).baseName();
+
+      bool hasIni = index.hasIni(baseName);
+      std::set<QString> loadedArchives = index.archives(baseName);
+
+      QString originName = ToQString(origin.getName());
+      const auto id = static_cast<std::size_t>(origin.getID());
+      const unsigned int modIndex =
+        (id < modIndices->size() ? (*modIndices)[id] : UINT_MAX);
+      if (modIndex != UINT_MAX) {
+        ModInfo::Ptr modInfo = ModInfo::getByIndex(modIndex);
+        originName = modInfo->name();
       }
+
+      m_ESPs.push_back(ESPInfo(filename, forceEnabled, originName, ToQString(newPaths[i]), hasIni, loadedArchives, lightPluginsAreSupported, *headers[i]));
+      m_ESPs.rbegin()->priority = -1;
+    } catch (const std::exception &e) {
+      reportError(tr("failed to update esp info for file %1 (source id: %2), error: %3").arg(filename).arg(current->getOrigin(archive)).arg(e.what()));
     }
   }
 
+  headerCache.save(PluginHeaderCache::path());
+
   for (const auto &espName : m_ESPsByName) {
     if (!availablePlugins.contains(espName.first, Qt::CaseInsensitive)) {
       m_ESPs[espName.second].name = "";
@@ -319,6 +409,7 @@ void PluginList::enableESP(const QString &name, bool enable)
 
     emit writePluginsList();
     if (enabled != m_ESPs[iter->second].enabled) {
+      updateMastersOf(iter->second);
       pluginStatesChanged({ name }, state(name));
     }
   } else {
@@ -343,6 +434,7 @@ void PluginList::setEnabled(const QModelIndexList& indices, bool enabled)
   for (auto& idx : indices) {
     if (m_ESPs[idx.row()].enabled != enabled) {
       m_ESPs[idx.row()].enabled = enabled;
+      updateMastersOf(idx.row());
       dirty.append(m_ESPs[idx.row()].name);
     }
   }
@@ -356,9 +448,11 @@ void PluginList::setEnabled(const QModelIndexList& indices, bool enabled)
 void PluginList::setEnabledAll(bool enabled)
 {
   QStringList dirty;
-  for (ESPInfo &info : m_ESPs) {
+  for (int i = 0; i < static_cast<int>(m_ESPs.size()); ++i) {
+    ESPInfo &info = m_ESPs[i];
     if (info.enabled != enabled) {
       info.enabled = enabled;
+      updateMastersOf(i);
       dirty.append(info.name);
     }
   }
@@ -395,13 +489,20 @@ void PluginList::shiftPluginsPriority(const QModelIndexList& indices, int offset
     return offset > 0 ? !cmp : cmp;
     });
 
+  ChangeBracket<PluginList> layoutChange(this);
+
   for (auto index : allIndex) {
     int newPriority = m_ESPs[index].priority + offset;
     if (newPriority >= 0 && newPriority < rowCount()) {
-      setPluginPriority(index, newPriority);
+      if (!movePlugin(index, newPriority)) {
+        updateIndices();
+      }
     }
   }
 
+  generatePluginIndexes();
+
+  layoutChange.finish();
   refreshLoadOrder();
 }
 
@@ -476,6 +577,9 @@ bool PluginList::isEnabled(int index)
 
 void PluginList::readLockedOrderFrom(const QString &fileName)
 {
+  // a previous version might still be queued
+  m_LockedOrderWriter.flush();
+
   m_LockedOrder.clear();
 
   QFile file(fileName);
@@ -572,24 +676,64 @@ void PluginList::readLockedOrderFrom(const QString &fileName)
 
 void PluginList::writeLockedOrder(const QString &fileName) const
 {
-  SafeWriteFile file(fileName);
+  QByteArray content;
 
-  file->resize(0);
-  file->write(QString("# This file was automatically generated by Mod Organizer.\r\n").toUtf8());
+  content.append(QString("# This file was automatically generated by Mod Organizer.\r\n").toUtf8());
   for (auto iter = m_LockedOrder.begin(); iter != m_LockedOrder.end(); ++iter) {
-    file->write(QString("%1|%2\r\n").arg(iter->first).arg(iter->second).toUtf8());
+    content.append(QString("%1|%2\r\n").arg(iter->first).arg(iter->second).toUtf8());
+  }
+
+  m_LockedOrderWriter.write(fileName, std::move(content));
+}
+
+QStringList PluginList::changedSinceSave() const
+{
+  QStringList changed;
+
+  for (const auto& esp : m_ESPs) {
+    auto iter = m_SavedStates.find(esp.name);
+
+    if (iter == m_SavedStates.end() ||
+        iter->second.enabled != esp.enabled ||
+        iter->second.priority != esp.priority) {
+      changed.append(esp.name);
+    }
+  }
+
+  // removed plugins
+  for (const auto& [name, state] : m_SavedStates) {
+    if (m_ESPsByName.find(name) == m_ESPsByName.end()) {
+      changed.append(name);
+    }
   }
-  file.commit();
+
+  return changed;
 }
 
 void PluginList::saveTo(const QString &lockedOrderFileName) const
 {
-  GamePlugins *gamePlugins = m_GamePlugin->feature<GamePlugins>();
-  if (gamePlugins) {
-    gamePlugins->writePluginLists(m_Organizer.managedGameOrganizer()->pluginList());
+  if (!m_Saved || !changedSinceSave().isEmpty()) {
+    GamePlugins *gamePlugins = m_GamePlugin->feature<GamePlugins>();
+    if (gamePlugins) {
+      gamePlugins->writePluginLists(m_Organizer.managedGameOrganizer()->pluginList());
+    }
+
+    m_SavedStates.clear();
+    for (const auto& esp : m_ESPs) {
+      m_SavedStates[esp.name] = {esp.enabled, esp.priority};
+    }
   }
 
-  writeLockedOrder(lockedOrderFileName);
+  if (!m_Saved ||
+      lockedOrderFileName != m_SavedLockedOrderFile ||
+      m_LockedOrder != m_SavedLockedOrder) {
+    writeLockedOrder(lockedOrderFileName);
+
+    m_SavedLockedOrder = m_LockedOrder;
+    m_SavedLockedOrderFile = lockedOrderFileName;
+  }
+
+  m_Saved = true;
 }
 
 
@@ -605,7 +749,7 @@ bool PluginList::saveLoadOrder(DirectoryEntry &directoryStructure)
   for (ESPInfo &esp : m_ESPs) {
     std::wstring espName = ToWString(esp.name);
     const FileEntryPtr fileEntry = directoryStructure.findFile(espName);
-    if (fileEntry.get() != nullptr) {
+    if (fileEntry != nullptr) {
       QString fileName;
       bool archive = false;
       int originid = fileEntry->getOrigin(archive);
@@ -726,7 +870,10 @@ void PluginList::refreshLoadOrder()
       int temp = targetPrio;
       int index = nameIter->second;
       if (m_ESPs[index].priority != temp) {
-        setPluginPriority(index, temp);
+        if (!movePlugin(index, temp)) {
+          updateIndices();
+        }
+
         m_ESPs[index].loadOrder = iter->first;
         syncLoadOrder();
         savePluginsList = true;
@@ -734,6 +881,7 @@ void PluginList::refreshLoadOrder()
     }
   }
   if (savePluginsList) {
+    generatePluginIndexes();
     emit writePluginsList();
   }
 }
@@ -773,8 +921,13 @@ IPluginList::PluginStates PluginList::state(const QString &name) const
 void PluginList::setState(const QString &name, PluginStates state) {
   auto iter = m_ESPsByName.find(name);
   if (iter != m_ESPsByName.end()) {
-    m_ESPs[iter->second].enabled = (state == IPluginList::STATE_ACTIVE) ||
-                                     m_ESPs[iter->second].forceEnabled;
+    const bool enabled = (state == IPluginList::STATE_ACTIVE) ||
+                         m_ESPs[iter->second].forceEnabled;
+
+    if (m_ESPs[iter->second].enabled != enabled) {
+      m_ESPs[iter->second].enabled = enabled;
+      updateMastersOf(iter->second);
+    }
   } else {
     log::warn("Plugin not found: {}", name);
   }
@@ -987,21 +1140,54 @@ int PluginList::columnCount(const QModelIndex &) const
 
 void PluginList::testMasters()
 {
-  std::set<QString, FileNameComparator> enabledMasters;
-  for (const auto& iter: m_ESPs) {
-    if (iter.enabled) {
-      enabledMasters.insert(iter.name);
+  const auto count = m_ESPs.size();
+
+  m_MasterGraph.masters.assign(count, {});
+  m_MasterGraph.dependents.assign(count, {});
+
+  for (int i = 0; i < static_cast<int>(count); ++i) {
+    for (const auto& master : m_ESPs[i].masters) {
+      auto iter = m_ESPsByName.find(master);
+      if (iter != m_ESPsByName.end()) {
+        m_MasterGraph.masters[i].push_back(iter->second);
+        m_MasterGraph.dependents[iter->second].push_back(i);
+      }
     }
+
+    updateMasterUnset(i);
   }
+}
 
-  for (auto& iter: m_ESPs) {
-    iter.masterUnset.clear();
-    if (iter.enabled) {
-      for (const auto& master: iter.masters) {
-        if (enabledMasters.find(master) == enabledMasters.end()) {
-          iter.masterUnset.insert(master);
-        }
-      }
+void PluginList::updateMastersOf(int index)
+{
+  if (m_MasterGraph.dependents.size() != m_ESPs.size()) {
+    // the graph is built at the end of refresh()
+    return;
+  }
+
+  updateMasterUnset(index);
+
+  for (const int dependent : m_MasterGraph.dependents[index]) {
+    updateMasterUnset(dependent);
+    emit dataChanged(this->index(dependent, 0), this->index(dependent, columnCount() - 1));
+  }
+}
+
+void PluginList::updateMasterUnset(int index)
+{
+  auto& esp = m_ESPs[index];
+  esp.masterUnset.clear();
+
+  if (!esp.enabled) {
+    return;
+  }
+
+  // masters that are not in the list are never set
+  esp.masterUnset.insert(esp.masters.begin(), esp.masters.end());
+
+  for (const int master : m_MasterGraph.masters[index]) {
+    if (m_ESPs[master].enabled) {
+      esp.masterUnset.erase(m_ESPs[master].name);
     }
   }
 }
@@ -1375,7 +1561,7 @@ bool PluginList::setData(const QModelIndex &modIndex, const QVariant &value, int
   if (oldState != newState) {
     try {
       pluginStatesChanged({ modName }, newState);
-      testMasters();
+      updateMastersOf(modIndex.row());
       emit dataChanged(
           this->index(0, 0),
           this->index(static_cast<int>(m_ESPs.size()), columnCount()));
@@ -1423,6 +1609,28 @@ Qt::ItemFlags PluginList::flags(const QModelIndex &modelIndex) const
 }
 
 void PluginList::setPluginPriority(int row, int &newPriority)
+{
+  const int oldPriority = m_ESPs.at(row).priority;
+
+  if (!movePlugin(row, newPriority)) {
+    updateIndices();
+    return;
+  }
+
+  const int priority = m_ESPs[row].priority;
+
+  if (priority > oldPriority) {
+    emit dataChanged(index(oldPriority + 1, 0), index(priority, columnCount()));
+  } else if (priority < oldPriority) {
+    emit dataChanged(index(priority, 0), index(oldPriority - 1, columnCount()));
+  }
+
+  emit dataChanged(index(row, 0), index(row, columnCount()));
+
+  generatePluginIndexes();
+}
+
+bool PluginList::movePlugin(int row, int &newPriority)
 {
   int newPriorityTemp = newPriority;
 
@@ -1458,25 +1666,28 @@ void PluginList::setPluginPriority(int row, int &newPriority)
     if (newPriorityTemp > oldPriority) {
       // priority is higher than the old, so the gap we left is in lower priorities
       for (int i = oldPriority + 1; i <= newPriorityTemp; ++i) {
-        --m_ESPs.at(m_ESPsByPriority.at(i)).priority;
+        const int other = m_ESPsByPriority.at(i);
+        --m_ESPs.at(other).priority;
+        m_ESPsByPriority[i - 1] = other;
       }
-      emit dataChanged(index(oldPriority + 1, 0), index(newPriorityTemp, columnCount()));
     } else {
-      for (int i = newPriorityTemp; i < oldPriority; ++i) {
-        ++m_ESPs.at(m_ESPsByPriority.at(i)).priority;
+      for (int i = oldPriority - 1; i >= newPriorityTemp; --i) {
+        const int other = m_ESPsByPriority.at(i);
+        ++m_ESPs.at(other).priority;
+        m_ESPsByPriority[i + 1] = other;
       }
-      emit dataChanged(index(newPriorityTemp, 0), index(oldPriority - 1, columnCount()));
       ++newPriority;
     }
 
     m_ESPs.at(row).priority = newPriorityTemp;
-    emit dataChanged(index(row, 0), index(row, columnCount()));
+    m_ESPsByPriority.at(newPriorityTemp) = row;
     m_PluginMoved(m_ESPs[row].name, oldPriority, newPriorityTemp);
   } catch (const std::out_of_range&) {
     reportError(tr("failed to restore load order for %1").arg(m_ESPs[row].name));
+    return false;
   }
 
-  updateIndices();
+  return true;
 }
 
 void PluginList::changePluginPriority(std::vector<int> rows, int newPriority)
@@ -1517,10 +1728,16 @@ void PluginList::changePluginPriority(std::vector<int> rows, int newPriority)
     }
   }
 
+  // the layout change covers all the moved plugins, the indexes only have to
+  // be generated once
   for (std::vector<int>::const_iterator iter = rows.begin(); iter != rows.end(); ++iter) {
-    setPluginPriority(*iter, newPriority);
+    if (!movePlugin(*iter, newPriority)) {
+      updateIndices();
+    }
   }
 
+  generatePluginIndexes();
+
   layoutChange.finish();
   refreshLoadOrder();
   emit writePluginsList();
@@ -1578,26 +1795,22 @@ QModelIndex PluginList::parent(const QModelIndex&) const
 
 PluginList::ESPInfo::ESPInfo(const QString &name, bool enabled,
                              const QString &originName, const QString &fullPath,
-                             bool hasIni, std::set<QString> archives, bool lightPluginsAreSupported)
+                             bool hasIni, std::set<QString> archives, bool lightPluginsAreSupported,
+                             const PluginHeader& header)
   : name(name), fullPath(fullPath), enabled(enabled), forceEnabled(enabled),
     priority(0), loadOrder(-1), originName(originName), hasIni(hasIni),
     archives(archives.begin(), archives.end()), modSelected(false)
 {
-  try {
-    ESP::File file(ToWString(fullPath));
-    isMaster = file.isMaster();
+  if (header.valid) {
+    isMaster = header.isMaster;
     auto extension = name.right(3).toLower();
     isLight = lightPluginsAreSupported && (extension == "esl");
-    isLightFlagged = lightPluginsAreSupported && file.isLight();
+    isLightFlagged = lightPluginsAreSupported && header.isLightFlagged;
 
-    author = QString::fromLatin1(file.author().c_str());
-    description = QString::fromLatin1(file.description().c_str());
-
-    for (auto&& m : file.masters()) {
-      masters.insert(QString::fromStdString(m));
-    }
-  } catch (const std::exception &e) {
-    log::error("failed to parse plugin file {}: {}", fullPath, e.what());
+    author = header.author;
+    description = header.description;
+    masters.insert(header.masters.begin(), header.masters.end());
+  } else {
     isMaster = false;
     isLight = false;
     isLightFlagged = false;
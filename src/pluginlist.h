@@ -24,6 +24,7 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 #include <ipluginlist.h>
 #include "profile.h"
 #include "loot.h"
+#include "backgroundfilewriter.h"
 
 namespace MOBase { class IPluginGame; }
 
@@ -45,6 +46,7 @@ namespace MOBase { class IPluginGame; }
 #include <map>
 
 class OrganizerCore;
+struct PluginHeader;
 
 
 template <class C>
@@ -308,7 +310,7 @@ private:
     ESPInfo(
       const QString &name, bool enabled, const QString &originName,
       const QString &fullPath, bool hasIni, std::set<QString> archives,
-      bool lightSupported);
+      bool lightSupported, const PluginHeader& header);
 
     QString name;
     QString fullPath;
@@ -352,12 +354,38 @@ private:
 
   void writeLockedOrder(const QString &fileName) const;
 
+  // names of the plugins that were added, removed, enabled, disabled or moved
+  // since the lists were last saved
+  //
+  QStringList changedSinceSave() const;
+
   void readLockedOrderFrom(const QString &fileName);
   void setPluginPriority(int row, int &newPriority);
+
+  // moves the plugin and shifts the ones in between, keeping m_ESPsByPriority
+  // up to date; doesn't emit dataChanged() nor generate the plugin indexes,
+  // the caller must do it once all plugins have been moved
+  //
+  // returns false if the priorities were inconsistent, updateIndices() must be
+  // called in that case
+  //
+  bool movePlugin(int row, int &newPriority);
   void changePluginPriority(std::vector<int> rows, int newPriority);
 
+  // builds the master dependencies of all the plugins and updates their
+  // missing masters, must be called when the list of plugins changes
+  //
   void testMasters();
 
+  // updates the missing masters of the given plugin and of the plugins
+  // depending on it, after it was enabled or disabled
+  //
+  void updateMastersOf(int index);
+
+  // updates the missing masters of the given plugin from the graph
+  //
+  void updateMasterUnset(int index);
+
   void fixPriorities();
 
   int findPluginByPriority(int priority);
@@ -376,11 +404,40 @@ private:
   OrganizerCore& m_Organizer;
 
   std::vector<ESPInfo> m_ESPs;
-  mutable std::map<QString, QByteArray> m_LastSaveHash;
+
+  // state of every plugin when the lists were last saved, compared with the
+  // current one to know whether they have to be written again; cleared on
+  // refresh()
+  struct SavedState
+  {
+    bool enabled;
+    int priority;
+  };
+
+  mutable std::map<QString, SavedState, MOBase::FileNameComparator> m_SavedStates;
+  mutable std::map<QString, int, MOBase::FileNameComparator> m_SavedLockedOrder;
+  mutable QString m_SavedLockedOrderFile;
+  mutable bool m_Saved;
+
+  // the locked order is written in the background
+  mutable BackgroundFileWriter m_LockedOrderWriter;
 
   std::map<QString, int, MOBase::FileNameComparator> m_ESPsByName;
   std::vector<int> m_ESPsByPriority;
 
+  // master dependencies between plugins, indexed like m_ESPs; masters that
+  // are not in the list have no edge
+  struct MasterGraph
+  {
+    // plugins that are masters of each plugin
+    std::vector<std::vector<int>> masters;
+
+    // plugins that have each plugin as a master
+    std::vector<std::vector<int>> dependents;
+  };
+
+  MasterGraph m_MasterGraph;
+
   std::map<QString, int, MOBase::FileNameComparator> m_LockedOrder;
 
   std::map<QString, AdditionalInfo, MOBase::FileNameComparator> m_AdditionalInfo; // maps esp names to boss information
@@ -681,33 +681,124 @@ bool Profile::setModPriority(unsigned int index, int &newPriority)
 
   newPriority = std::clamp(newPriority, 0, static_cast<int>(m_NumRegularMods) - 1);
 
-  int oldPriority = m_ModStatus.at(index).m_Priority;
-  int lastPriority = INT_MIN;
+  const int oldPriority = m_ModStatus.at(index).m_Priority;
 
   if (newPriority == oldPriority) {
     // nothing to do
     return false;
   }
 
-  for (const auto& [priority, index] : m_ModIndexByPriority) {
-    if (newPriority < oldPriority && priority >= newPriority && priority < oldPriority) {
-      m_ModStatus.at(index).m_Priority += 1;
-    }
-    else if (newPriority > oldPriority && priority <= newPriority && priority > oldPriority) {
-      m_ModStatus.at(index).m_Priority -= 1;
+  // only the mods between the old and new priorities are shifted
+  const int first = std::min(oldPriority, newPriority);
+  const int last = std::max(oldPriority, newPriority);
+
+  std::vector<unsigned int> order;
+  order.reserve(static_cast<std::size_t>(last - first) + 1);
+
+  for (auto itor=m_ModIndexByPriority.lower_bound(first);
+    itor!=m_ModIndexByPriority.end() && itor->first <= last; ++itor) {
+    if (itor->second != index) {
+      order.push_back(itor->second);
     }
-    lastPriority = std::max(lastPriority, priority);
   }
 
-  newPriority = std::min(newPriority, lastPriority);
-  m_ModStatus.at(index).m_Priority = std::min(newPriority, lastPriority);
+  const auto pos = std::min(
+    static_cast<std::size_t>(newPriority - first), order.size());
 
-  updateIndices();
+  order.insert(order.begin() + pos, index);
+  assignPriorities(first, order);
+
+  newPriority = m_ModStatus[index].m_Priority;
   m_ModListWriter.write();
 
   return true;
 }
 
+std::vector<std::pair<unsigned int, int>> Profile::moveModsPriority(
+  const std::vector<unsigned int>& indices, int priority)
+{
+  const int regularCount = static_cast<int>(m_NumRegularMods);
+  priority = std::clamp(priority, 0, regularCount);
+
+  // range of priorities that changes, from the first moved mod or the target
+  // to the last moved mod or the mod before the target
+  int first = priority;
+  int last = priority - 1;
+
+  std::set<unsigned int> moving;
+
+  for (auto index : indices) {
+    if (index >= m_ModStatus.size()) {
+      continue;
+    }
+
+    if (ModInfo::getByIndex(index)->hasAutomaticPriority()) {
+      continue;
+    }
+
+    const int p = m_ModStatus[index].m_Priority;
+    first = std::min(first, p);
+    last = std::max(last, p);
+
+    moving.insert(index);
+  }
+
+  if (moving.empty()) {
+    return {};
+  }
+
+  last = std::min(last, regularCount - 1);
+
+  std::vector<unsigned int> before, moved, after;
+
+  for (auto itor=m_ModIndexByPriority.lower_bound(first);
+    itor!=m_ModIndexByPriority.end() && itor->first <= last; ++itor) {
+    if (moving.count(itor->second)) {
+      moved.push_back(itor->second);
+    } else if (itor->first < priority) {
+      before.push_back(itor->second);
+    } else {
+      after.push_back(itor->second);
+    }
+  }
+
+  std::vector<std::pair<unsigned int, int>> changed;
+  changed.reserve(moved.size());
+
+  for (auto index : moved) {
+    changed.push_back({index, m_ModStatus[index].m_Priority});
+  }
+
+  std::vector<unsigned int> order = std::move(before);
+  order.insert(order.end(), moved.begin(), moved.end());
+  order.insert(order.end(), after.begin(), after.end());
+
+  assignPriorities(first, order);
+
+  changed.erase(
+    std::remove_if(changed.begin(), changed.end(), [&](auto&& c) {
+      return (m_ModStatus[c.first].m_Priority == c.second);
+    }),
+    changed.end());
+
+  if (!changed.empty()) {
+    m_ModListWriter.write();
+  }
+
+  return changed;
+}
+
+void Profile::assignPriorities(int first, const std::vector<unsigned int>& order)
+{
+  int priority = first;
+
+  for (auto index : order) {
+    m_ModStatus[index].m_Priority = priority;
+    m_ModIndexByPriority[priority] = index;
+    ++priority;
+  }
+}
+
 Profile *Profile::createPtrFrom(const QString &name, const Profile &reference, MOBase::IPluginGame const *gamePlugin)
 {
   QString profileDirectory = Settings::instance().paths().profiles() + "/" + name;
@@ -293,6 +293,19 @@ public:
   //
   bool setModPriority(unsigned int index, int& newPriority);
 
+  // moves the given mods as a single block, in their current relative order,
+  // just before the mod that currently has the given priority; a priority
+  // higher than the last regular mod moves them at the end
+  //
+  // mods with an automatic priority are ignored, only the mods between the
+  // moved ones and the target get a new priority
+  //
+  // returns the mods from `indices` whose priority has changed, along with
+  // their old priority
+  //
+  std::vector<std::pair<unsigned int, int>> moveModsPriority(
+    const std::vector<unsigned int>& indices, int priority);
+
   /**
    * @brief determine if a mod is enabled
    *
@@ -373,6 +386,11 @@ private:
 
   void updateIndices();
 
+  // gives consecutive priorities starting at `first` to the given mods and
+  // updates m_ModIndexByPriority for them
+  //
+  void assignPriorities(int first, const std::vector<unsigned int>& order);
+
   void copyFilesTo(QString &target) const;
 
   std::vector<std::wstring> splitDZString(const wchar_t *buffer) const;
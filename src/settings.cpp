@@ -312,6 +312,26 @@ void Settings::setArchiveParsing(bool b)
   set(m_Settings, "Settings", "archive_parsing_experimental", b);
 }
 
+bool Settings::incrementalRefresh() const
+{
+  return get<bool>(m_Settings, "Settings", "incremental_refresh", true);
+}
+
+void Settings::setIncrementalRefresh(bool b)
+{
+  set(m_Settings, "Settings", "incremental_refresh", b);
+}
+
+bool Settings::watchFiles() const
+{
+  return get<bool>(m_Settings, "Settings", "watch_files", true);
+}
+
+void Settings::setWatchFiles(bool b)
+{
+  set(m_Settings, "Settings", "watch_files", b);
+}
+
 std::vector<std::map<QString, QVariant>> Settings::executables() const
 {
   ScopedReadArray sra(m_Settings, "customExecutables");
@@ -815,6 +815,18 @@ public:
   bool archiveParsing() const;
   void setArchiveParsing(bool b);
 
+  // whether a refresh is allowed to only rescan the mods that have changed on
+  // disk when the list of mods itself hasn't changed
+  //
+  bool incrementalRefresh() const;
+  void setIncrementalRefresh(bool b);
+
+  // whether the mods, overwrite and data directories are watched so changes
+  // made outside of MO are picked up without a refresh
+  //
+  bool watchFiles() const;
+  void setWatchFiles(bool b);
+
   // whether the user wants to check for updates
   //
   bool checkForUpdates() const;
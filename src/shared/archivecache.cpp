@@ -0,0 +1,396 @@
+#include "archivecache.h"
+#include "appconfig.h"
+#include "snapshotio.h"
+#include "util.h"
+#include <bsatk.h>
+#include <log.h>
+#include <utility.h>
+#include <QApplication>
+
+namespace MOShared
+{
+
+using namespace MOBase;
+
+// "MOAC"
+constexpr uint32_t ArchiveCacheMagic = 0x43414f4d;
+
+// must be incremented every time the format changes, older caches are ignored
+constexpr uint32_t ArchiveCacheVersion = 1;
+
+
+void buildFolder(ArchiveIndex::Folder& out, const BSA::Folder::Ptr& folder)
+{
+  const auto fileCount = folder->getNumFiles();
+  out.files.reserve(fileCount);
+
+  for (unsigned int i=0; i<fileCount; ++i) {
+    const BSA::File::Ptr file = folder->getFile(i);
+
+    out.files.push_back({
+      ToWString(file->getName(), true),
+      file->getFileSize(),
+      file->getUncompressedFileSize()});
+  }
+
+  const auto dirCount = folder->getNumSubFolders();
+  out.folders.resize(dirCount);
+
+  for (unsigned int i=0; i<dirCount; ++i) {
+    const BSA::Folder::Ptr sub = folder->getSubFolder(i);
+
+    out.folders[i].name = ToWString(sub->getName(), true);
+    buildFolder(out.folders[i], sub);
+  }
+}
+
+std::shared_ptr<const ArchiveIndex> parseArchive(const std::wstring& path)
+{
+  BSA::Archive archive;
+  BSA::EErrorCode res = BSA::ERROR_NONE;
+
+  try
+  {
+    // read() can return an error, but it can also throw if the file is not a
+    // valid bsa
+    res = archive.read(ToString(path, false).c_str(), false);
+  }
+  catch(std::exception& e)
+  {
+    log::error("invalid bsa '{}', error {}", path, e.what());
+    return {};
+  }
+
+  if ((res != BSA::ERROR_NONE) && (res != BSA::ERROR_INVALIDHASHES)) {
+    log::error("invalid bsa '{}', error {}", path, res);
+    return {};
+  }
+
+  auto index = std::make_shared<ArchiveIndex>();
+  buildFolder(index->root, archive.getRoot());
+
+  return index;
+}
+
+void writeFolder(SnapshotWriter& w, const ArchiveIndex::Folder& folder)
+{
+  w.write(std::wstring_view(folder.name));
+
+  w.write(static_cast<uint32_t>(folder.files.size()));
+  for (const auto& f : folder.files) {
+    w.write(std::wstring_view(f.name));
+    w.write(f.size);
+    w.write(f.uncompressedSize);
+  }
+
+  w.write(static_cast<uint32_t>(folder.folders.size()));
+  for (const auto& sub : folder.folders) {
+    writeFolder(w, sub);
+  }
+}
+
+// number of bytes writeFolder() will write for the given folder
+//
+std::size_t folderSize(const ArchiveIndex::Folder& folder)
+{
+  auto stringSize = [](const std::wstring& s) {
+    return sizeof(uint32_t) + s.size() * sizeof(wchar_t);
+  };
+
+  std::size_t size = stringSize(folder.name) + sizeof(uint32_t) * 2;
+
+  for (const auto& f : folder.files) {
+    size += stringSize(f.name) + sizeof(uint64_t) * 2;
+  }
+
+  for (const auto& sub : folder.folders) {
+    size += folderSize(sub);
+  }
+
+  return size;
+}
+
+void readFolder(SnapshotReader& r, ArchiveIndex::Folder& folder)
+{
+  folder.name = r.readString();
+
+  const auto fileCount = r.read<uint32_t>();
+  folder.files.reserve(fileCount);
+
+  for (uint32_t i=0; i<fileCount; ++i) {
+    auto name = r.readString();
+    const auto size = r.read<uint64_t>();
+    const auto uncompressedSize = r.read<uint64_t>();
+
+    folder.files.push_back({std::move(name), size, uncompressedSize});
+  }
+
+  const auto dirCount = r.read<uint32_t>();
+  folder.folders.resize(dirCount);
+
+  for (uint32_t i=0; i<dirCount; ++i) {
+    readFolder(r, folder.folders[i]);
+  }
+}
+
+
+ArchiveCache& ArchiveCache::instance()
+{
+  static ArchiveCache cache;
+  return cache;
+}
+
+QString ArchiveCache::path()
+{
+  return
+    qApp->property("dataPath").toString() + "/" +
+    QString::fromStdWString(AppConfig::archiveCacheFileName());
+}
+
+std::shared_ptr<const ArchiveIndex> ArchiveCache::get(
+  const std::wstring& archivePath, FILETIME& fileTime)
+{
+  fileTime = {};
+
+  WIN32_FILE_ATTRIBUTE_DATA fad = {};
+
+  if (!::GetFileAttributesExW(archivePath.c_str(), GetFileExInfoStandard, &fad)) {
+    const auto e = ::GetLastError();
+
+    log::warn(
+      "failed to get last modified date for '{}', {}",
+      archivePath, formatSystemMessage(e));
+
+    // can't be cached without its size and date
+    return parseArchive(archivePath);
+  }
+
+  fileTime = fad.ftLastWriteTime;
+  const uint64_t size =
+    (static_cast<uint64_t>(fad.nFileSizeHigh) << 32) | fad.nFileSizeLow;
+
+  const auto key = ToLowerCopy(archivePath);
+
+  const uchar* data = nullptr;
+  std::size_t dataSize = 0;
+
+  // keeps the file mapped until the entry has been deserialized, save() can
+  // be called by the refresher while the ui thread adds archives
+  std::shared_lock mapping(m_mappingMutex);
+
+  {
+    std::scoped_lock lock(m_mutex);
+
+    auto itor = m_entries.find(key);
+
+    if (itor != m_entries.end()) {
+      auto& e = itor->second;
+
+      if (e.size == size && ::CompareFileTime(&e.fileTime, &fileTime) == 0) {
+        e.used = true;
+
+        if (e.index) {
+          return e.index;
+        }
+
+        data = e.data;
+        dataSize = e.dataSize;
+      }
+    }
+  }
+
+  std::shared_ptr<const ArchiveIndex> index;
+
+  if (data) {
+    try
+    {
+      auto cached = std::make_shared<ArchiveIndex>();
+
+      SnapshotReader r(data, data + dataSize);
+      readFolder(r, cached->root);
+
+      index = std::move(cached);
+    }
+    catch(std::exception& ex)
+    {
+      log::error(
+        "bad entry for '{}' in archive cache: {}", archivePath, ex.what());
+    }
+  }
+
+  mapping.unlock();
+
+  const bool parsed = !index;
+
+  if (parsed) {
+    index = parseArchive(archivePath);
+
+    if (!index) {
+      return {};
+    }
+  }
+
+  std::scoped_lock lock(m_mutex);
+
+  auto& e = m_entries[key];
+  e.size = size;
+  e.fileTime = fileTime;
+  e.index = index;
+  e.data = nullptr;
+  e.dataSize = 0;
+  e.used = true;
+
+  if (parsed) {
+    m_dirty = true;
+  }
+
+  return index;
+}
+
+bool ArchiveCache::load(const QString& path)
+{
+  TimeThis tt("ArchiveCache::load()");
+
+  std::scoped_lock lock(m_mutex);
+
+  if (m_loaded) {
+    return true;
+  }
+
+  m_loaded = true;
+
+  auto f = std::make_unique<QFile>(path);
+
+  if (!f->exists()) {
+    return true;
+  }
+
+  try
+  {
+    if (!f->open(QIODevice::ReadOnly)) {
+      throw SnapshotError(f->errorString().toStdString());
+    }
+
+    const auto fileSize = f->size();
+    const uchar* p = f->map(0, fileSize);
+
+    if (!p) {
+      throw SnapshotError(f->errorString().toStdString());
+    }
+
+    SnapshotReader r(p, p + fileSize);
+
+    if (r.read<uint32_t>() != ArchiveCacheMagic) {
+      throw SnapshotError("not an archive cache");
+    }
+
+    if (const auto v=r.read<uint32_t>(); v != ArchiveCacheVersion) {
+      log::debug(
+        "ignoring archive cache '{}', version {} instead of {}",
+        path, v, ArchiveCacheVersion);
+
+      return true;
+    }
+
+    std::unordered_map<std::wstring, Entry> entries;
+
+    const auto count = r.read<uint32_t>();
+
+    for (uint32_t i=0; i<count; ++i) {
+      auto archivePath = r.readString();
+
+      Entry e;
+      e.size = r.read<uint64_t>();
+      e.fileTime.dwLowDateTime = r.read<uint32_t>();
+      e.fileTime.dwHighDateTime = r.read<uint32_t>();
+
+      // the listing is only deserialized when it's requested
+      e.dataSize = static_cast<std::size_t>(r.read<uint64_t>());
+      e.data = r.skip(e.dataSize);
+
+      entries.emplace(std::move(archivePath), std::move(e));
+    }
+
+    m_entries = std::move(entries);
+    m_file = std::move(f);
+
+    log::debug("archive cache has {} archives", m_entries.size());
+
+    return true;
+  }
+  catch(std::exception& e)
+  {
+    log::error("failed to load archive cache '{}': {}", path, e.what());
+    return false;
+  }
+}
+
+bool ArchiveCache::save(const QString& path)
+{
+  // waits for get() calls that are reading from the mapped file
+  std::scoped_lock lock(m_mappingMutex, m_mutex);
+
+  if (!m_dirty) {
+    return true;
+  }
+
+  TimeThis tt("ArchiveCache::save()");
+
+  // entries that were not requested don't have an index, they're dropped
+  for (auto itor=m_entries.begin(); itor!=m_entries.end();) {
+    if (itor->second.used && itor->second.index) {
+      itor->second.data = nullptr;
+      itor->second.dataSize = 0;
+      ++itor;
+    } else {
+      itor = m_entries.erase(itor);
+    }
+  }
+
+  // nothing points into the mapped file anymore, and it has to be closed
+  // before it can be replaced
+  m_file.reset();
+  m_dirty = false;
+
+  try
+  {
+    QSaveFile f(path);
+
+    if (!f.open(QIODevice::WriteOnly)) {
+      throw SnapshotError(f.errorString().toStdString());
+    }
+
+    SnapshotWriter w(f);
+
+    w.write(ArchiveCacheMagic);
+    w.write(ArchiveCacheVersion);
+    w.write(static_cast<uint32_t>(m_entries.size()));
+
+    for (const auto& [archivePath, e] : m_entries) {
+      w.write(std::wstring_view(archivePath));
+      w.write(e.size);
+      w.write(static_cast<uint32_t>(e.fileTime.dwLowDateTime));
+      w.write(static_cast<uint32_t>(e.fileTime.dwHighDateTime));
+
+      // the size of the listing is written first so it can be skipped when
+      // loading
+      w.write(static_cast<uint64_t>(folderSize(e.index->root)));
+      writeFolder(w, e.index->root);
+    }
+
+    w.flush();
+
+    if (!f.commit()) {
+      throw SnapshotError(f.errorString().toStdString());
+    }
+
+    return true;
+  }
+  catch(std::exception& e)
+  {
+    log::error("failed to save archive cache to '{}': {}", path, e.what());
+    return false;
+  }
+}
+
+} // namespace
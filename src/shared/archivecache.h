@@ -0,0 +1,105 @@
+#ifndef MO_REGISTER_ARCHIVECACHE_INCLUDED
+#define MO_REGISTER_ARCHIVECACHE_INCLUDED
+
+#include <QFile>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+namespace MOShared
+{
+
+// listing of the folders and files in an archive, which is all the directory
+// structure needs from it
+//
+struct ArchiveIndex
+{
+  struct File
+  {
+    std::wstring name;
+    uint64_t size = 0;
+
+    // 0 if the file is not compressed
+    uint64_t uncompressedSize = 0;
+  };
+
+  struct Folder
+  {
+    std::wstring name;
+    std::vector<File> files;
+    std::vector<Folder> folders;
+  };
+
+  Folder root;
+};
+
+
+// keeps the listing of every archive that has been parsed, keyed by the path
+// of the archive along with its size and last write time so an archive that
+// changes on disk is parsed again
+//
+// the cache is saved in the instance directory; when it's loaded, the file is
+// only mapped in memory and an archive is deserialized the first time it's
+// requested
+//
+class ArchiveCache
+{
+public:
+  static ArchiveCache& instance();
+
+  // path to the cache file for the current instance
+  //
+  static QString path();
+
+  // returns the listing of the given archive, parsing it if necessary; sets
+  // `fileTime` to the last write time of the archive
+  //
+  // returns null if the archive doesn't exist or is not valid
+  //
+  std::shared_ptr<const ArchiveIndex> get(
+    const std::wstring& archivePath, FILETIME& fileTime);
+
+  // maps the given cache file, does nothing if a file has already been
+  // loaded; returns false on errors
+  //
+  bool load(const QString& path);
+
+  // saves the archives that have been requested since the cache was loaded
+  // if any of them had to be parsed, does nothing otherwise; entries for
+  // archives that were not requested are dropped
+  //
+  bool save(const QString& path);
+
+private:
+  struct Entry
+  {
+    uint64_t size = 0;
+    FILETIME fileTime = {};
+
+    // set when the archive has been parsed or deserialized
+    std::shared_ptr<const ArchiveIndex> index;
+
+    // serialized listing in the mapped file, until it's deserialized
+    const uchar* data = nullptr;
+    std::size_t dataSize = 0;
+
+    // whether the entry has been requested since the cache was loaded
+    bool used = false;
+  };
+
+  // keyed by lowercase path
+  std::unordered_map<std::wstring, Entry> m_entries;
+  std::unique_ptr<QFile> m_file;
+  bool m_loaded = false;
+  bool m_dirty = false;
+  std::mutex m_mutex;
+
+  // held shared by get() while it reads from the mapped file and exclusively
+  // by save() to unmap it; always taken before m_mutex
+  std::shared_mutex m_mappingMutex;
+};
+
+} // namespace
+
+#endif // MO_REGISTER_ARCHIVECACHE_INCLUDED
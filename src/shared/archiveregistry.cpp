@@ -0,0 +1,64 @@
+#include "archiveregistry.h"
+
+namespace MOShared
+{
+
+ArchiveID ArchiveRegistry::intern(std::wstring_view name)
+{
+  if (name.empty()) {
+    return InvalidArchiveID;
+  }
+
+  std::scoped_lock lock(m_Mutex);
+
+  auto itor = m_Lookup.find(name);
+  if (itor != m_Lookup.end()) {
+    return itor->second;
+  }
+
+  const auto& stored = m_Names.emplace_back(name);
+  const auto id = static_cast<ArchiveID>(m_Names.size());
+
+  m_Lookup.emplace(stored, id);
+
+  return id;
+}
+
+ArchiveID ArchiveRegistry::find(std::wstring_view name) const
+{
+  if (name.empty()) {
+    return InvalidArchiveID;
+  }
+
+  std::scoped_lock lock(m_Mutex);
+
+  auto itor = m_Lookup.find(name);
+  if (itor == m_Lookup.end()) {
+    return InvalidArchiveID;
+  }
+
+  return itor->second;
+}
+
+std::wstring_view ArchiveRegistry::name(ArchiveID id) const
+{
+  if (id == InvalidArchiveID) {
+    return {};
+  }
+
+  std::scoped_lock lock(m_Mutex);
+
+  if (id > m_Names.size()) {
+    return {};
+  }
+
+  return m_Names[id - 1];
+}
+
+std::size_t ArchiveRegistry::size() const
+{
+  std::scoped_lock lock(m_Mutex);
+  return m_Names.size();
+}
+
+} // namespace
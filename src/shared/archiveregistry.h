@@ -0,0 +1,62 @@
+#ifndef MO_REGISTER_ARCHIVEREGISTRY_INCLUDED
+#define MO_REGISTER_ARCHIVEREGISTRY_INCLUDED
+
+#include "fileregisterfwd.h"
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace MOShared
+{
+
+// names of all the archives that have files in a structure
+//
+// files only store the id of their archive, which is given out the first time
+// an archive name is interned; ids stay valid for the lifetime of the
+// registry, which is owned by the FileRegister
+//
+// archives are only interned once per archive folder while the structure is
+// built, so a single mutex is enough
+//
+class ArchiveRegistry
+{
+public:
+  ArchiveRegistry() = default;
+
+  // noncopyable
+  ArchiveRegistry(const ArchiveRegistry&) = delete;
+  ArchiveRegistry& operator=(const ArchiveRegistry&) = delete;
+
+  // returns the id for the given archive name, adding it if necessary; an
+  // empty name is InvalidArchiveID
+  //
+  ArchiveID intern(std::wstring_view name);
+
+  // returns the id for the given archive name, or InvalidArchiveID if no file
+  // in the structure comes from that archive
+  //
+  ArchiveID find(std::wstring_view name) const;
+
+  // returns the name of the given archive, empty for InvalidArchiveID; the
+  // view stays valid for the lifetime of the registry
+  //
+  std::wstring_view name(ArchiveID id) const;
+
+  // number of archives
+  //
+  std::size_t size() const;
+
+private:
+  mutable std::mutex m_Mutex;
+
+  // indexed by id - 1, a deque so the views in m_Lookup are never moved
+  std::deque<std::wstring> m_Names;
+
+  std::unordered_map<std::wstring_view, ArchiveID> m_Lookup;
+};
+
+} // namespace
+
+#endif // MO_REGISTER_ARCHIVEREGISTRY_INCLUDED
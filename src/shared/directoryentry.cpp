@@ -33,10 +33,13 @@ namespace MOShared
 using namespace MOBase;
 const int MAXPATH_UNICODE = 32767;
 
+// calls f() and adds the time it took to `out` if instrumentation is enabled;
+// when it's not, this is only a relaxed load and a branch
+//
 template <class F>
-void elapsedImpl(std::chrono::nanoseconds& out, F&& f)
+void elapsed(std::chrono::nanoseconds& out, F&& f)
 {
-  if constexpr (DirectoryStats::EnableInstrumentation) {
+  if (DirectoryStats::enabled()) {
     const auto start = std::chrono::high_resolution_clock::now();
     f();
     const auto end = std::chrono::high_resolution_clock::now();
@@ -46,11 +49,6 @@ void elapsedImpl(std::chrono::nanoseconds& out, F&& f)
   }
 }
 
-// elapsed() is not optimized out when EnableInstrumentation is false even
-// though it's equivalent that this macro
-#define elapsed(OUT, F) (F)();
-//#define elapsed(OUT, F) elapsedImpl(OUT, F);
-
 static bool SupportOptimizedFind()
 {
   // large fetch and basic info for FindFirstFileEx is supported on win server 2008 r2, win 7 and newer
@@ -67,30 +65,52 @@ static bool SupportOptimizedFind()
   return (::VerifyVersionInfo(&versionInfo, VER_MAJORVERSION | VER_MINORVERSION, mask) == TRUE);
 }
 
-bool DirCompareByName::operator()(
-    const DirectoryEntry* lhs, const DirectoryEntry* rhs) const
+// lowercases the given string in a buffer owned by the thread, the returned
+// view is only valid until the next call on the same thread; this is used to
+// look up names without allocating
+//
+static std::wstring_view toLowerTemp(std::wstring_view s)
 {
-  return _wcsicmp(lhs->getName().c_str(), rhs->getName().c_str()) < 0;
+  thread_local std::wstring buffer;
+
+  buffer.assign(s.begin(), s.end());
+  ToLowerInPlace(buffer);
+
+  return buffer;
 }
 
 
 DirectoryEntry::DirectoryEntry(
-  std::wstring name, DirectoryEntry* parent, int originID) :
+  std::wstring_view name, DirectoryEntry* parent, int originID) :
     m_OriginConnection(new OriginConnection),
-    m_Name(std::move(name)), m_Parent(parent), m_Populated(false), m_TopLevel(true)
+    m_Parent(parent), m_Populated(false), m_TopLevel(true)
 {
   m_FileRegister.reset(new FileRegister(m_OriginConnection));
+  m_Name = m_FileRegister->strings().intern(name);
   m_Origins.insert(originID);
 }
 
 DirectoryEntry::DirectoryEntry(
-  std::wstring name, DirectoryEntry* parent, int originID,
+  std::wstring_view name, DirectoryEntry* parent, int originID,
   boost::shared_ptr<FileRegister> fileRegister,
   boost::shared_ptr<OriginConnection> originConnection) :
     m_FileRegister(fileRegister), m_OriginConnection(originConnection),
-    m_Name(std::move(name)), m_Parent(parent), m_Populated(false), m_TopLevel(false)
+    m_Name(name), m_Parent(parent), m_Populated(false), m_TopLevel(false)
 {
-  m_Origins.insert(originID);
+  if (m_Parent) {
+    // the name of the root is not part of the path
+    const auto parentPath = m_Parent->getRelativePath();
+
+    std::wstring path;
+    path.reserve(parentPath.size() + 1 + m_Name.size());
+    path.append(parentPath).append(L"\\").append(m_Name);
+
+    m_RelativePath = m_FileRegister->strings().intern(path);
+  }
+
+  if (originID != InvalidOriginID) {
+    m_Origins.insert(originID);
+  }
 }
 
 DirectoryEntry::~DirectoryEntry()
@@ -100,14 +120,12 @@ DirectoryEntry::~DirectoryEntry()
 
 void DirectoryEntry::clear()
 {
-  for (auto itor=m_SubDirectories.rbegin(); itor!=m_SubDirectories.rend(); ++itor) {
-    delete *itor;
+  for (auto* d : m_SubDirectories) {
+    delete d;
   }
 
   m_Files.clear();
-  m_FilesLookup.clear();
   m_SubDirectories.clear();
-  m_SubDirectoriesLookup.clear();
 }
 
 void DirectoryEntry::addFromOrigin(
@@ -138,33 +156,89 @@ void DirectoryEntry::addFromList(
   stats = {};
 
   FilesOrigin &origin = createOrigin(originName, directory, priority, stats);
-  addDir(origin, root, stats);
+  const OriginPriorities priorities(*m_OriginConnection);
+
+  addDir(origin, root, priorities, stats);
 }
 
 void DirectoryEntry::addDir(
-  FilesOrigin& origin, env::Directory& d, DirectoryStats& stats)
+  FilesOrigin& origin, env::Directory& d, const OriginPriorities& priorities,
+  DirectoryStats& stats, bool ordered)
 {
   elapsed(stats.dirTimes, [&]{
     for (auto& sd : d.dirs) {
-      auto* sdirEntry = getSubDirectory(sd, true, stats, origin.getID());
-      sdirEntry->addDir(origin, sd, stats);
+      auto* sdirEntry = getSubDirectory(sd.name, true, stats, origin.getID());
+      sdirEntry->addDir(origin, sd, priorities, stats, ordered);
     }
   });
 
   elapsed(stats.fileTimes, [&]{
     for (auto& f : d.files) {
-      insert(f, origin, L"", -1, stats);
+      insert(f.name, origin, f.lastModified, {}, priorities, stats, ordered);
     }
   });
 
   m_Populated = true;
 }
 
+void DirectoryEntry::mergeFiles(
+  FilesOrigin& origin, env::Directory& d, DirectoryStats& stats)
+{
+  // the origins are appended in order, the priorities are never used
+  const OriginPriorities priorities(*m_OriginConnection);
+
+  for (auto& f : d.files) {
+    insert(f.name, origin, f.lastModified, {}, priorities, stats, true);
+  }
+
+  m_Populated = true;
+}
+
+void DirectoryEntry::mergeDirectory(
+  FilesOrigin& origin, env::Directory& d, DirectoryStats& stats)
+{
+  // m_Populated is not set here, the tasks merging the different
+  // subdirectories run concurrently on the same entry; mergeFiles() sets it
+  auto* sdirEntry = getSubDirectory(d.name, true, stats, origin.getID());
+  const OriginPriorities priorities(*m_OriginConnection);
+
+  sdirEntry->addDir(origin, d, priorities, stats, true);
+}
+
+void DirectoryEntry::mergeArchiveFiles(
+  FilesOrigin& origin, const ArchiveIndex::Folder& folder, FILETIME fileTime,
+  const std::wstring& archiveName, int order, DirectoryStats& stats)
+{
+  const DataArchiveOrigin archive(
+    m_FileRegister->archives().intern(archiveName), order);
+
+  const OriginPriorities priorities(*m_OriginConnection);
+
+  addArchiveFiles(origin, folder, fileTime, archive, priorities, stats, true);
+  m_Populated = true;
+}
+
+void DirectoryEntry::mergeArchiveFolder(
+  FilesOrigin& origin, const ArchiveIndex::Folder& folder, FILETIME fileTime,
+  const std::wstring& archiveName, int order, DirectoryStats& stats)
+{
+  DirectoryEntry* folderEntry = getSubDirectoryRecursive(
+    folder.name, true, stats, origin.getID());
+
+  const DataArchiveOrigin archive(
+    m_FileRegister->archives().intern(archiveName), order);
+
+  const OriginPriorities priorities(*m_OriginConnection);
+
+  folderEntry->addFiles(
+    origin, folder, fileTime, archive, priorities, stats, true);
+}
+
 void DirectoryEntry::addFromAllBSAs(
   const std::wstring& originName, const std::wstring& directory,
   int priority, const std::vector<std::wstring>& archives,
   const std::set<std::wstring>& enabledArchives,
-  const std::vector<std::wstring>& loadOrder,
+  const LoadOrderIndex& loadOrder,
   DirectoryStats& stats)
 {
   for (const auto& archive : archives) {
@@ -175,27 +249,9 @@ void DirectoryEntry::addFromAllBSAs(
       continue;
     }
 
-    const auto filenameLc = ToLowerCopy(filename);
-
-    int order = -1;
-
-    for (auto plugin : loadOrder)
-    {
-      const auto pluginNameLc =
-        ToLowerCopy(std::filesystem::path(plugin).stem().native());
-
-      if (filenameLc.starts_with(pluginNameLc + L" - ") ||
-          filenameLc.starts_with(pluginNameLc + L".")) {
-        auto itor = std::find(loadOrder.begin(), loadOrder.end(), plugin);
-        if (itor != loadOrder.end()) {
-          order = std::distance(loadOrder.begin(), itor);
-        }
-      }
-    }
-
     addFromBSA(
       originName, directory, archivePath.native(),
-      priority, order, stats);
+      priority, loadOrder.archiveOrder(filename), stats);
   }
 }
 
@@ -210,41 +266,186 @@ void DirectoryEntry::addFromBSA(
     return;
   }
 
-  BSA::Archive archive;
-  BSA::EErrorCode res = BSA::ERROR_NONE;
+  FILETIME ft = {};
+  const auto index = ArchiveCache::instance().get(archivePath, ft);
 
-  try
-  {
-    // read() can return an error, but it can also throw if the file is not a
-    // valid bsa
-    res = archive.read(ToString(archivePath, false).c_str(), false);
-  }
-  catch(std::exception& e)
-  {
-    log::error("invalid bsa '{}', error {}", archivePath, e.what());
+  if (!index) {
     return;
   }
 
-  if ((res != BSA::ERROR_NONE) && (res != BSA::ERROR_INVALIDHASHES)) {
-    log::error("invalid bsa '{}', error {}", archivePath, res);
+  const DataArchiveOrigin archive(
+    m_FileRegister->archives().intern(archiveName), order);
+
+  const OriginPriorities priorities(*m_OriginConnection);
+  addFiles(origin, index->root, ft, archive, priorities, stats);
+
+  m_Populated = true;
+}
+
+void DirectoryEntry::syncOriginPath(
+  FilesOrigin& origin, const std::wstring& relativePath)
+{
+  const auto originID = origin.getID();
+
+  // whether the file has a loose copy in the origin; the origin can also have
+  // an entry for an archive, so every entry is checked
+  auto hasLooseOrigin = [&](const FileEntry& f) {
+    if (f.getOrigin() == originID && !f.getArchive().isValid()) {
+      return true;
+    }
+
+    for (const auto& alt : f.getAlternatives()) {
+      if (alt.originID() == originID && !alt.isFromArchive()) {
+        return true;
+      }
+    }
+
+    return false;
+  };
+
+  const OriginPriorities priorities(*m_OriginConnection);
+
+  // files of this origin that might have been removed
+  std::vector<FileEntryPtr> candidates;
+
+  if (relativePath.empty()) {
+    candidates = origin.getFiles();
+  } else {
+    if (auto f=searchFile(relativePath)) {
+      candidates.push_back(f);
+    }
+
+    if (auto* d=findSubDirectoryRecursive(relativePath)) {
+      std::vector<const DirectoryEntry*> dirs = {d};
+
+      while (!dirs.empty()) {
+        const auto* current = dirs.back();
+        dirs.pop_back();
+
+        current->forEachFile([&](auto&& f) {
+          candidates.push_back(m_FileRegister->getFile(f.getIndex()));
+          return true;
+        });
+
+        for (const auto* sd : current->getSubDirectories()) {
+          dirs.push_back(sd);
+        }
+      }
+    }
+  }
+
+  std::wstring path;
+
+  for (auto f : candidates) {
+    if (!f || !hasLooseOrigin(*f)) {
+      continue;
+    }
+
+    path.clear();
+    f->appendFullPath(path, originID);
+
+    if (::GetFileAttributesW(path.c_str()) == INVALID_FILE_ATTRIBUTES) {
+      origin.removeFile(f->getIndex());
+      m_FileRegister->removeOrigin(f->getIndex(), originID, priorities);
+    }
+  }
+
+  // add what exists on disk
+  std::wstring fullPath = origin.getPath();
+  if (!relativePath.empty()) {
+    fullPath.append(L"\\").append(relativePath);
+  }
+
+  WIN32_FILE_ATTRIBUTE_DATA fad = {};
+  if (!::GetFileAttributesExW(fullPath.c_str(), GetFileExInfoStandard, &fad)) {
     return;
   }
 
-  std::error_code ec;
-  const auto lwt = std::filesystem::last_write_time(archivePath, ec);
-  FILETIME ft = {};
+  DirectoryStats dummy;
+
+  if (fad.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+    auto* d = this;
+    if (!relativePath.empty()) {
+      d = getSubDirectoryRecursive(relativePath, true, dummy, originID);
+    }
+
+    // addFiles() replaces the fingerprint of the origin, but this is only a
+    // part of it
+    const auto fp = origin.fingerprint();
 
-  if (ec) {
-    log::warn(
-      "failed to get last modified date for '{}', {}",
-      archivePath, ec.message());
+    env::DirectoryWalker walker;
+    d->addFiles(walker, origin, fullPath, dummy);
+
+    origin.setFingerprint(fp);
   } else {
-    ft = ToFILETIME(lwt);
+    const auto sep = relativePath.find_last_of(L"\\/");
+
+    auto* d = this;
+    if (sep != std::wstring::npos) {
+      d = getSubDirectoryRecursive(
+        relativePath.substr(0, sep), true, dummy, originID);
+    }
+
+    const auto name = (sep == std::wstring::npos ?
+      relativePath : relativePath.substr(sep + 1));
+
+    d->insert(name, origin, fad.ftLastWriteTime, {}, priorities, dummy);
+  }
+}
+
+FileEntryPtr DirectoryEntry::addResolvedFile(
+  std::wstring_view name, OriginID origin, DataArchiveOrigin archive,
+  AlternativesVector alternatives, FILETIME fileTime)
+{
+  DirectoryStats dummy;
+  auto& strings = m_FileRegister->strings();
+
+  auto fe = m_FileRegister->createFile(strings.intern(name), this, dummy);
+  addFileToList(strings.intern(toLowerTemp(name)), fe->getIndex());
+
+  getOriginByID(origin).addFile(fe->getIndex());
+  for (const auto& alt : alternatives) {
+    getOriginByID(alt.originID()).addFile(fe->getIndex());
   }
 
-  addFiles(origin, archive.getRoot(), ft, archiveName, order, stats);
+  fe->setOrigins(origin, archive, std::move(alternatives));
+  fe->setFileTime(fileTime);
 
-  m_Populated = true;
+  return fe;
+}
+
+DirectoryEntry* DirectoryEntry::addSubDirectory(
+  std::wstring_view name, OriginID originID)
+{
+  DirectoryStats dummy;
+  return getSubDirectory(name, true, dummy, originID);
+}
+
+void DirectoryEntry::freeze()
+{
+  {
+    std::scoped_lock lock(m_FilesMutex);
+    m_Files.freeze();
+  }
+
+  std::scoped_lock lock(m_SubDirMutex);
+  m_SubDirectories.freeze();
+
+  for (auto* d : m_SubDirectories) {
+    d->freeze();
+  }
+}
+
+void DirectoryEntry::sortFiles() const
+{
+  std::scoped_lock lock(m_FilesMutex);
+  m_Files.sort();
+}
+
+void DirectoryEntry::sortSubDirectories() const
+{
+  std::scoped_lock lock(m_SubDirMutex);
+  m_SubDirectories.sort();
 }
 
 void DirectoryEntry::propagateOrigin(int origin)
@@ -283,9 +484,12 @@ int DirectoryEntry::anyOrigin() const
 {
   bool ignore;
 
-  for (auto iter = m_Files.begin(); iter != m_Files.end(); ++iter) {
-    FileEntryPtr entry = m_FileRegister->getFile(iter->second);
-    if ((entry.get() != nullptr) && !entry->isFromArchive()) {
+  sortFiles();
+  sortSubDirectories();
+
+  for (auto index : m_Files) {
+    FileEntryPtr entry = m_FileRegister->getFile(index);
+    if ((entry != nullptr) && !entry->isFromArchive()) {
       return entry->getOrigin(ignore);
     }
   }
@@ -299,15 +503,41 @@ int DirectoryEntry::anyOrigin() const
     }
   }
 
+  std::scoped_lock lock(m_OriginsMutex);
+
+  if (m_Origins.empty()) {
+    return InvalidOriginID;
+  }
+
   return *(m_Origins.begin());
 }
 
+std::vector<OriginID> DirectoryEntry::getOrigins() const
+{
+  std::scoped_lock lock(m_OriginsMutex);
+  return {m_Origins.begin(), m_Origins.end()};
+}
+
+void DirectoryEntry::addOrigins(const std::vector<OriginID>& origins)
+{
+  std::scoped_lock lock(m_OriginsMutex);
+
+  for (const auto id : origins) {
+    if (id != InvalidOriginID) {
+      m_Origins.insert(id);
+    }
+  }
+}
+
 std::vector<FileEntryPtr> DirectoryEntry::getFiles() const
 {
+  sortFiles();
+
   std::vector<FileEntryPtr> result;
+  result.reserve(m_Files.size());
 
-  for (auto iter = m_Files.begin(); iter != m_Files.end(); ++iter) {
-    result.push_back(m_FileRegister->getFile(iter->second));
+  for (auto index : m_Files) {
+    result.push_back(m_FileRegister->getFile(index));
   }
 
   return result;
@@ -316,19 +546,15 @@ std::vector<FileEntryPtr> DirectoryEntry::getFiles() const
 DirectoryEntry* DirectoryEntry::findSubDirectory(
   const std::wstring &name, bool alreadyLowerCase) const
 {
-  SubDirectoriesLookup::const_iterator itor;
+  DirectoryEntry* const* d = nullptr;
 
   if (alreadyLowerCase) {
-    itor = m_SubDirectoriesLookup.find(name);
+    d = m_SubDirectories.find(name);
   } else {
-    itor = m_SubDirectoriesLookup.find(ToLowerCopy(name));
+    d = m_SubDirectories.find(toLowerTemp(name));
   }
 
-  if (itor == m_SubDirectoriesLookup.end()) {
-    return nullptr;
-  }
-
-  return itor->second;
+  return (d ? *d : nullptr);
 }
 
 DirectoryEntry* DirectoryEntry::findSubDirectoryRecursive(const std::wstring &path)
@@ -340,16 +566,16 @@ DirectoryEntry* DirectoryEntry::findSubDirectoryRecursive(const std::wstring &pa
 const FileEntryPtr DirectoryEntry::findFile(
   const std::wstring &name, bool alreadyLowerCase) const
 {
-  FilesLookup::const_iterator iter;
+  const FileIndex* index = nullptr;
 
   if (alreadyLowerCase) {
-    iter = m_FilesLookup.find(DirectoryEntryFileKey(name));
+    index = m_Files.find(name);
   } else {
-    iter = m_FilesLookup.find(DirectoryEntryFileKey(ToLowerCopy(name)));
+    index = m_Files.find(toLowerTemp(name));
   }
 
-  if (iter != m_FilesLookup.end()) {
-    return m_FileRegister->getFile(iter->second);
+  if (index) {
+    return m_FileRegister->getFile(*index);
   } else {
     return FileEntryPtr();
   }
@@ -357,10 +583,11 @@ const FileEntryPtr DirectoryEntry::findFile(
 
 const FileEntryPtr DirectoryEntry::findFile(const DirectoryEntryFileKey& key) const
 {
-  auto iter = m_FilesLookup.find(key);
+  // the key already has the hash of the name
+  const auto* index = m_Files.find(key.value, key.hash);
 
-  if (iter != m_FilesLookup.end()) {
-    return m_FileRegister->getFile(iter->second);
+  if (index) {
+    return m_FileRegister->getFile(*index);
   } else {
     return FileEntryPtr();
   }
@@ -368,13 +595,18 @@ const FileEntryPtr DirectoryEntry::findFile(const DirectoryEntryFileKey& key) co
 
 bool DirectoryEntry::hasFile(const std::wstring& name) const
 {
-  return m_Files.contains(ToLowerCopy(name));
+  return (m_Files.find(toLowerTemp(name)) != nullptr);
 }
 
 bool DirectoryEntry::containsArchive(std::wstring archiveName)
 {
-  for (auto iter = m_Files.begin(); iter != m_Files.end(); ++iter) {
-    FileEntryPtr entry = m_FileRegister->getFile(iter->second);
+  if (m_FileRegister->archives().find(archiveName) == InvalidArchiveID) {
+    // no file in the structure comes from this archive
+    return false;
+  }
+
+  for (auto index : m_Files) {
+    FileEntryPtr entry = m_FileRegister->getFile(index);
     if (entry->isFromArchive(archiveName)) {
       return true;
     }
@@ -403,10 +635,10 @@ const FileEntryPtr DirectoryEntry::searchFile(
 
   if (len == std::string::npos) {
     // no more path components
-    auto iter = m_Files.find(ToLowerCopy(path));
+    const auto* index = m_Files.find(toLowerTemp(path));
 
-    if (iter != m_Files.end()) {
-      return m_FileRegister->getFile(iter->second);
+    if (index) {
+      return m_FileRegister->getFile(*index);
     } else if (directory != nullptr) {
       DirectoryEntry* temp = findSubDirectory(path);
       if (temp != nullptr) {
@@ -462,15 +694,10 @@ void DirectoryEntry::removeDir(const std::wstring &path)
   size_t pos = path.find_first_of(L"\\/");
 
   if (pos == std::string::npos) {
-    for (auto iter = m_SubDirectories.begin(); iter != m_SubDirectories.end(); ++iter) {
-      DirectoryEntry* entry = *iter;
-
-      if (CaseInsensitiveEqual(entry->getName(), path)) {
-        entry->removeDirRecursive();
-        removeDirectoryFromList(iter);
-        delete entry;
-        break;
-      }
+    if (DirectoryEntry* entry=findSubDirectory(path)) {
+      entry->removeDirRecursive();
+      removeDirectoryFromList(entry);
+      delete entry;
     }
   } else {
     std::wstring dirName = path.substr(0, pos);
@@ -487,21 +714,20 @@ void DirectoryEntry::removeDir(const std::wstring &path)
 
 bool DirectoryEntry::remove(const std::wstring &fileName, int* origin)
 {
-  const auto lcFileName = ToLowerCopy(fileName);
-
-  auto iter = m_Files.find(lcFileName);
+  const auto* index = m_Files.find(toLowerTemp(fileName));
   bool b = false;
 
-  if (iter != m_Files.end()) {
+  if (index) {
     if (origin != nullptr) {
-      FileEntryPtr entry = m_FileRegister->getFile(iter->second);
-      if (entry.get() != nullptr) {
+      FileEntryPtr entry = m_FileRegister->getFile(*index);
+      if (entry != nullptr) {
         bool ignore;
         *origin = entry->getOrigin(ignore);
       }
     }
 
-    b = m_FileRegister->removeFile(iter->second);
+    // copied, removing the file removes it from the index
+    b = m_FileRegister->removeFile(FileIndex(*index));
   }
 
   return b;
@@ -509,6 +735,7 @@ bool DirectoryEntry::remove(const std::wstring &fileName, int* origin)
 
 bool DirectoryEntry::hasContentsFromOrigin(int originID) const
 {
+  std::scoped_lock lock(m_OriginsMutex);
   return m_Origins.find(originID) != m_Origins.end();
 }
 
@@ -536,84 +763,48 @@ void DirectoryEntry::removeFiles(const std::set<FileIndex> &indices)
 
 FileEntryPtr DirectoryEntry::insert(
   std::wstring_view fileName, FilesOrigin &origin, FILETIME fileTime,
-  std::wstring_view archive, int order, DirectoryStats& stats)
+  DataArchiveOrigin archive, const OriginPriorities& priorities,
+  DirectoryStats& stats, bool ordered)
 {
-  std::wstring fileNameLower = ToLowerCopy(fileName);
+  const auto fileNameLower = toLowerTemp(fileName);
   FileEntryPtr fe;
 
-  DirectoryEntryFileKey key(std::move(fileNameLower));
-
   {
     std::unique_lock lock(m_FilesMutex);
 
-    FilesLookup::iterator itor;
+    const FileIndex* index = nullptr;
 
     elapsed(stats.filesLookupTimes, [&]{
-      itor = m_FilesLookup.find(key);
+      index = m_Files.find(fileNameLower);
     });
 
-    if (itor != m_FilesLookup.end()) {
+    if (index) {
+      const auto existing = *index;
       lock.unlock();
       ++stats.fileExists;
-      fe = m_FileRegister->getFile(itor->second);
+      fe = m_FileRegister->getFile(existing);
     } else {
       ++stats.fileCreate;
-      fe = m_FileRegister->createFile(
-        std::wstring(fileName.begin(), fileName.end()), this, stats);
+
+      // if the name is already lowercase, both interned strings are the same
+      auto& strings = m_FileRegister->strings();
+      const auto nameLc = strings.intern(fileNameLower);
+      const auto name = strings.intern(fileName);
+
+      fe = m_FileRegister->createFile(name, this, stats);
 
       elapsed(stats.addFileTimes, [&] {
-        addFileToList(std::move(key.value), fe->getIndex());
+        addFileToList(nameLc, fe->getIndex());
       });
-
-      // fileNameLower has moved from this point
     }
   }
 
   elapsed(stats.addOriginToFileTimes, [&]{
-    fe->addOrigin(origin.getID(), fileTime, archive, order);
-  });
-
-  elapsed(stats.addFileToOriginTimes, [&]{
-    origin.addFile(fe->getIndex());
-  });
-
-  return fe;
-}
-
-FileEntryPtr DirectoryEntry::insert(
-  env::File& file, FilesOrigin &origin, std::wstring_view archive, int order,
-  DirectoryStats& stats)
-{
-  FileEntryPtr fe;
-
-  {
-    std::unique_lock lock(m_FilesMutex);
-
-    FilesMap::iterator itor;
-
-    elapsed(stats.filesLookupTimes, [&]{
-      itor = m_Files.find(file.lcname);
-    });
-
-    if (itor != m_Files.end()) {
-      lock.unlock();
-      ++stats.fileExists;
-      fe = m_FileRegister->getFile(itor->second);
+    if (ordered) {
+      fe->appendOrigin(origin.getID(), fileTime, archive);
     } else {
-      ++stats.fileCreate;
-      fe = m_FileRegister->createFile(std::move(file.name), this, stats);
-      // file.name has been moved from this point
-
-      elapsed(stats.addFileTimes, [&]{
-        addFileToList(std::move(file.lcname), fe->getIndex());
-      });
-
-      // file.lcname has been moved from this point
+      fe->addOrigin(origin.getID(), fileTime, archive, priorities);
     }
-  }
-
-  elapsed(stats.addOriginToFileTimes, [&]{
-    fe->addOrigin(origin.getID(), file.lastModified, archive, order);
   });
 
   elapsed(stats.addFileToOriginTimes, [&]{
@@ -626,15 +817,19 @@ FileEntryPtr DirectoryEntry::insert(
 struct DirectoryEntry::Context
 {
   FilesOrigin& origin;
+  const OriginPriorities& priorities;
   DirectoryStats& stats;
   std::stack<DirectoryEntry*> current;
+  OriginFingerprint::Builder fingerprint;
 };
 
 void DirectoryEntry::addFiles(
   env::DirectoryWalker& walker, FilesOrigin &origin,
   const std::wstring& path, DirectoryStats& stats)
 {
-  Context cx = {origin, stats};
+  const OriginPriorities priorities(*m_OriginConnection);
+
+  Context cx = {origin, priorities, stats};
   cx.current.push(this);
 
   walker.forEachEntry(path, &cx,
@@ -648,11 +843,63 @@ void DirectoryEntry::addFiles(
       onDirectoryEnd((Context*)pcx, path);
     },
 
-    [](void* pcx, std::wstring_view path, FILETIME ft, uint64_t)
+    [](void* pcx, std::wstring_view path, FILETIME ft, uint64_t size)
+    {
+      onFile((Context*)pcx, path, ft, size);
+    }
+  );
+
+  origin.setFingerprint(cx.fingerprint.result());
+}
+
+void DirectoryEntry::addFilesFromDirectory(
+  env::DirectoryWalker& walker, FilesOrigin& origin, const std::wstring& path,
+  OriginFingerprint::Builder& fingerprint,
+  std::vector<PendingDirectory>& subdirs, DirectoryStats& stats)
+{
+  struct ShallowContext
+  {
+    DirectoryEntry* self;
+    FilesOrigin& origin;
+    const OriginPriorities& priorities;
+    const std::wstring& path;
+    OriginFingerprint::Builder& fingerprint;
+    std::vector<PendingDirectory>& subdirs;
+    DirectoryStats& stats;
+  };
+
+  const OriginPriorities priorities(*m_OriginConnection);
+
+  ShallowContext cx = {
+    this, origin, priorities, path, fingerprint, subdirs, stats};
+
+  walker.forEachEntryInDirectory(path, &cx,
+    [](void* pcx, std::wstring_view name)
+    {
+      auto* cx = static_cast<ShallowContext*>(pcx);
+
+      auto* sd = cx->self->getSubDirectory(
+        name, true, cx->stats, cx->origin.getID());
+
+      std::wstring sdPath;
+      sdPath.reserve(cx->path.size() + 1 + name.size());
+      sdPath.append(cx->path).append(L"\\").append(name);
+
+      cx->fingerprint.enterDirectory(name);
+      cx->subdirs.push_back({sd, std::move(sdPath), cx->fingerprint.pathHash()});
+      cx->fingerprint.leaveDirectory();
+    },
+
+    [](void* pcx, std::wstring_view name, FILETIME ft, uint64_t size)
     {
-      onFile((Context*)pcx, path, ft);
+      auto* cx = static_cast<ShallowContext*>(pcx);
+
+      cx->self->insert(name, cx->origin, ft, {}, cx->priorities, cx->stats);
+      cx->fingerprint.addFile(name, ft, size);
     }
   );
+
+  m_Populated = true;
 }
 
 void DirectoryEntry::onDirectoryStart(Context* cx, std::wstring_view path)
@@ -663,6 +910,8 @@ void DirectoryEntry::onDirectoryStart(Context* cx, std::wstring_view path)
 
     cx->current.push(sd);
   });
+
+  cx->fingerprint.enterDirectory(path);
 }
 
 void DirectoryEntry::onDirectoryEnd(Context* cx, std::wstring_view path)
@@ -670,114 +919,88 @@ void DirectoryEntry::onDirectoryEnd(Context* cx, std::wstring_view path)
   elapsed(cx->stats.dirTimes, [&] {
     cx->current.pop();
   });
+
+  cx->fingerprint.leaveDirectory();
 }
 
-void DirectoryEntry::onFile(Context* cx, std::wstring_view path, FILETIME ft)
+void DirectoryEntry::onFile(
+  Context* cx, std::wstring_view path, FILETIME ft, uint64_t size)
 {
   elapsed(cx->stats.fileTimes, [&]{
-    cx->current.top()->insert(path, cx->origin, ft, L"", -1, cx->stats);
+    cx->current.top()->insert(
+      path, cx->origin, ft, {}, cx->priorities, cx->stats);
   });
+
+  cx->fingerprint.addFile(path, ft, size);
 }
 
 void DirectoryEntry::addFiles(
-  FilesOrigin& origin, const BSA::Folder::Ptr archiveFolder, FILETIME fileTime,
-  const std::wstring& archiveName, int order, DirectoryStats& stats)
+  FilesOrigin& origin, const ArchiveIndex::Folder& archiveFolder,
+  FILETIME fileTime, DataArchiveOrigin archive,
+  const OriginPriorities& priorities, DirectoryStats& stats, bool ordered)
 {
-  // add files
-  const auto fileCount = archiveFolder->getNumFiles();
-  for (unsigned int i=0; i<fileCount; ++i) {
-    const BSA::File::Ptr file = archiveFolder->getFile(i);
-
-    auto f = insert(
-      ToWString(file->getName(), true), origin, fileTime,
-      archiveName, order, stats);
-
-    if (f) {
-      if (file->getUncompressedFileSize() > 0) {
-        f->setFileSize(file->getFileSize(), file->getUncompressedFileSize());
-      } else {
-        f->setFileSize(file->getFileSize(), FileEntry::NoFileSize);
-      }
-    }
-  }
+  addArchiveFiles(
+    origin, archiveFolder, fileTime, archive, priorities, stats, ordered);
 
   // recurse into subdirectories
-  const auto dirCount = archiveFolder->getNumSubFolders();
-  for (unsigned int i=0; i<dirCount; ++i) {
-    const BSA::Folder::Ptr folder = archiveFolder->getSubFolder(i);
-
+  for (const auto& folder : archiveFolder.folders) {
     DirectoryEntry* folderEntry = getSubDirectoryRecursive(
-      ToWString(folder->getName(), true), true, stats, origin.getID());
+      folder.name, true, stats, origin.getID());
 
-    folderEntry->addFiles(origin, folder, fileTime, archiveName, order, stats);
+    folderEntry->addFiles(
+      origin, folder, fileTime, archive, priorities, stats, ordered);
   }
 }
 
-DirectoryEntry* DirectoryEntry::getSubDirectory(
-  std::wstring_view name, bool create, DirectoryStats& stats, int originID)
+void DirectoryEntry::addArchiveFiles(
+  FilesOrigin& origin, const ArchiveIndex::Folder& archiveFolder,
+  FILETIME fileTime, DataArchiveOrigin archive,
+  const OriginPriorities& priorities, DirectoryStats& stats, bool ordered)
 {
-  std::wstring nameLc = ToLowerCopy(name);
-
-  std::scoped_lock lock(m_SubDirMutex);
-
-  SubDirectoriesLookup::iterator itor;
-  elapsed(stats.subdirLookupTimes, [&] {
-    itor = m_SubDirectoriesLookup.find(nameLc);
-  });
-
-  if (itor != m_SubDirectoriesLookup.end()) {
-    ++stats.subdirExists;
-    return itor->second;
-  }
-
-  if (create) {
-    ++stats.subdirCreate;
-
-    auto* entry = new DirectoryEntry(
-      std::wstring(name.begin(), name.end()), this, originID,
-      m_FileRegister, m_OriginConnection);
-
-    elapsed(stats.addDirectoryTimes, [&] {
-      addDirectoryToList(entry, std::move(nameLc));
-      // nameLc is moved from this point
-    });
+  for (const auto& file : archiveFolder.files) {
+    auto f = insert(
+      file.name, origin, fileTime, archive, priorities, stats, ordered);
 
-    return entry;
-  } else {
-    return nullptr;
+    if (f) {
+      if (file.uncompressedSize > 0) {
+        f->setFileSize(file.size, file.uncompressedSize);
+      } else {
+        f->setFileSize(file.size, FileEntry::NoFileSize);
+      }
+    }
   }
 }
 
 DirectoryEntry* DirectoryEntry::getSubDirectory(
-  env::Directory& dir, bool create, DirectoryStats& stats, int originID)
+  std::wstring_view name, bool create, DirectoryStats& stats, int originID)
 {
-  SubDirectoriesLookup::iterator itor;
+  const auto nameLc = toLowerTemp(name);
 
   std::scoped_lock lock(m_SubDirMutex);
 
+  DirectoryEntry* const* existing = nullptr;
   elapsed(stats.subdirLookupTimes, [&] {
-    itor = m_SubDirectoriesLookup.find(dir.lcname);
+    existing = m_SubDirectories.find(nameLc);
   });
 
-  if (itor != m_SubDirectoriesLookup.end()) {
+  if (existing) {
     ++stats.subdirExists;
-    return itor->second;
+    return *existing;
   }
 
   if (create) {
     ++stats.subdirCreate;
 
+    auto& strings = m_FileRegister->strings();
+
     auto* entry = new DirectoryEntry(
-      std::move(dir.name), this, originID,
+      strings.intern(name), this, originID,
       m_FileRegister, m_OriginConnection);
-    // dir.name is moved from this point
 
-    elapsed(stats.addDirectoryTimes, [&]{
-      addDirectoryToList(entry, std::move(dir.lcname));
+    elapsed(stats.addDirectoryTimes, [&] {
+      addDirectoryToList(entry, strings.intern(nameLc));
     });
 
-    // dir.lcname is moved from this point
-
     return entry;
   } else {
     return nullptr;
@@ -811,11 +1034,14 @@ DirectoryEntry* DirectoryEntry::getSubDirectoryRecursive(
 
 void DirectoryEntry::removeDirRecursive()
 {
-  while (!m_Files.empty()) {
-    m_FileRegister->removeFile(m_Files.begin()->second);
+  // removing a file from the register removes it from the index, so the
+  // indices are copied first
+  std::vector<FileIndex> files(m_Files.begin(), m_Files.end());
+  for (auto index : files) {
+    m_FileRegister->removeFile(index);
   }
 
-  m_FilesLookup.clear();
+  m_Files.clear();
 
   for (DirectoryEntry* entry : m_SubDirectories) {
     entry->removeDirRecursive();
@@ -823,88 +1049,51 @@ void DirectoryEntry::removeDirRecursive()
   }
 
   m_SubDirectories.clear();
-  m_SubDirectoriesLookup.clear();
 }
 
-void DirectoryEntry::addDirectoryToList(DirectoryEntry* e, std::wstring nameLc)
+void DirectoryEntry::addDirectoryToList(DirectoryEntry* e, std::wstring_view nameLc)
 {
-  m_SubDirectories.insert(e);
-  m_SubDirectoriesLookup.emplace(std::move(nameLc), e);
+  m_SubDirectories.insert(nameLc, e);
 }
 
-void DirectoryEntry::removeDirectoryFromList(SubDirectories::iterator itor)
+void DirectoryEntry::removeDirectoryFromList(DirectoryEntry* e)
 {
-  const auto* entry = *itor;
-
-  {
-    auto itor2 = std::find_if(
-      m_SubDirectoriesLookup.begin(), m_SubDirectoriesLookup.end(),
-      [&](auto&& d) { return (d.second == entry); });
+  const auto n = m_SubDirectories.removeIf([&](auto* d) { return (d == e); });
 
-    if (itor2 == m_SubDirectoriesLookup.end()) {
-      log::error("entry {} not in sub directories map", entry->getName());
-    } else {
-      m_SubDirectoriesLookup.erase(itor2);
-    }
+  if (n == 0) {
+    log::error(
+      "entry {} not in sub directories map", std::wstring(e->getName()));
   }
-
-  m_SubDirectories.erase(itor);
 }
 
 void DirectoryEntry::removeFileFromList(FileIndex index)
 {
-  auto removeFrom = [&](auto& list) {
-    auto iter = std::find_if(
-      list.begin(), list.end(),
-      [&index](auto&& pair) { return (pair.second == index); }
-    );
+  const auto n = m_Files.removeIf([&](auto i) { return (i == index); });
 
-    if (iter == list.end()) {
-      auto f = m_FileRegister->getFile(index);
+  if (n == 0) {
+    auto f = m_FileRegister->getFile(index);
 
-      if (f) {
-        log::error(
-          "can't remove file '{}', not in directory entry '{}'",
-          f->getName(), getName());
-      } else {
-        log::error(
-          "can't remove file with index {}, not in directory entry '{}' and "
-          "not in register",
-          index, getName());
-      }
+    if (f) {
+      log::error(
+        "can't remove file '{}', not in directory entry '{}'",
+        std::wstring(f->getName()), std::wstring(getName()));
     } else {
-      list.erase(iter);
+      log::error(
+        "can't remove file with index {}, not in directory entry '{}' and "
+        "not in register",
+        index, std::wstring(getName()));
     }
-  };
-
-  removeFrom(m_FilesLookup);
-  removeFrom(m_Files);
+  }
 }
 
 void DirectoryEntry::removeFilesFromList(const std::set<FileIndex>& indices)
 {
-  for (auto iter = m_Files.begin(); iter != m_Files.end();) {
-    if (indices.find(iter->second) != indices.end()) {
-      iter = m_Files.erase(iter);
-    } else {
-      ++iter;
-    }
-  }
-
-  for (auto iter = m_FilesLookup.begin(); iter != m_FilesLookup.end();) {
-    if (indices.find(iter->second) != indices.end()) {
-      iter = m_FilesLookup.erase(iter);
-    } else {
-      ++iter;
-    }
-  }
+  m_Files.removeIf([&](auto i) { return (indices.find(i) != indices.end()); });
 }
 
-void DirectoryEntry::addFileToList(std::wstring fileNameLower, FileIndex index)
+void DirectoryEntry::addFileToList(std::wstring_view fileNameLower, FileIndex index)
 {
-  m_FilesLookup.emplace(fileNameLower, index);
-  m_Files.emplace(std::move(fileNameLower), index);
-  // fileNameLower has been moved from this point
+  m_Files.insert(fileNameLower, index);
 }
 
 struct DumpFailed : public std::runtime_error
@@ -940,9 +1129,10 @@ void DirectoryEntry::dump(std::FILE* f, const std::wstring& parentPath) const
 {
   {
     std::scoped_lock lock(m_FilesMutex);
+    m_Files.sort();
 
-    for (auto&& index : m_Files) {
-      const auto file = m_FileRegister->getFile(index.second);
+    for (auto index : m_Files) {
+      const auto file = m_FileRegister->getFile(index);
       if (!file) {
         continue;
       }
@@ -953,8 +1143,8 @@ void DirectoryEntry::dump(std::FILE* f, const std::wstring& parentPath) const
       }
 
       const auto& o = m_OriginConnection->getByID(file->getOrigin());
-      const auto path = parentPath + L"\\" + file->getName();
-      const auto line = path + L"\t(" + o.getName() + L")\r\n";
+      auto line = parentPath + L"\\";
+      line.append(file->getName()).append(L"\t(" + o.getName() + L")\r\n");
 
       const auto lineu8 = MOShared::ToString(line, true);
 
@@ -968,8 +1158,11 @@ void DirectoryEntry::dump(std::FILE* f, const std::wstring& parentPath) const
 
   {
     std::scoped_lock lock(m_SubDirMutex);
-    for (auto&& d : m_SubDirectories) {
-      const auto path = parentPath + L"\\" + d->m_Name;
+    m_SubDirectories.sort();
+
+    for (auto* d : m_SubDirectories) {
+      auto path = parentPath + L"\\";
+      path.append(d->m_Name);
       d->dump(f, path);
     }
   }
@@ -21,47 +21,44 @@ along with Mod Organizer.  If not, see <http://www.gnu.org/licenses/>.
 #define MO_REGISTER_DIRECTORYENTRY_INCLUDED
 
 #include "fileregister.h"
+#include "archivecache.h"
+#include "loadorderindex.h"
+#include "flatindex.h"
 #include <bsatk.h>
 
 namespace env
 {
   class DirectoryWalker;
   struct Directory;
-  struct File;
-}
-
-namespace std
-{
-  template <>
-  struct hash<MOShared::DirectoryEntryFileKey>
-  {
-    using argument_type = MOShared::DirectoryEntryFileKey;
-    using result_type = std::size_t;
-
-    inline result_type operator()(const argument_type& key) const;
-  };
 }
 
 
 namespace MOShared
 {
 
-struct DirCompareByName
-{
-    bool operator()(const DirectoryEntry* a, const DirectoryEntry* b) const;
-};
-
-
 class DirectoryEntry
 {
 public:
-    using SubDirectories = std::set<DirectoryEntry*, DirCompareByName>;
+  // ordered by lowercase name once the structure has been frozen, see
+  // freeze()
+  using SubDirectories = FlatIndex<DirectoryEntry*>;
+
+  // a subdirectory that was created by addFilesFromDirectory() but not walked
+  // yet
+  //
+  struct PendingDirectory
+  {
+    DirectoryEntry* entry;
+    std::wstring path;
+    std::size_t pathHash;
+  };
 
     DirectoryEntry(
-    std::wstring name, DirectoryEntry* parent, OriginID originID);
+    std::wstring_view name, DirectoryEntry* parent, OriginID originID);
 
+  // the name must have been interned in the string pool of the file register
   DirectoryEntry(
-    std::wstring name, DirectoryEntry* parent, OriginID originID,
+    std::wstring_view name, DirectoryEntry* parent, OriginID originID,
     boost::shared_ptr<FileRegister> fileRegister,
     boost::shared_ptr<OriginConnection> originConnection);
 
@@ -112,7 +109,7 @@ public:
     const std::wstring& originName, const std::wstring& directory,
     int priority, const std::vector<std::wstring>& archives,
     const std::set<std::wstring>& enabledArchives,
-    const std::vector<std::wstring>& loadOrder,
+    const LoadOrderIndex& loadOrder,
     DirectoryStats& stats);
 
   void addFromBSA(
@@ -124,36 +121,124 @@ public:
     const std::wstring& originName, const std::wstring& directory,
     env::Directory& root, int priority, DirectoryStats& stats);
 
+  // adds the files directly inside `path` for the given origin; the
+  // subdirectories are created but not walked, they're added to `subdirs` so
+  // they can be walked separately, possibly on other threads
+  //
+  void addFilesFromDirectory(
+    env::DirectoryWalker& walker, FilesOrigin& origin, const std::wstring& path,
+    OriginFingerprint::Builder& fingerprint,
+    std::vector<PendingDirectory>& subdirs, DirectoryStats& stats);
+
+  // used by the second phase of a full refresh, see
+  // DirectoryRefresher::buildStructure(); the origins must be merged in the
+  // order sortOrigins() would put them in, archives first, so the files never
+  // need to be sorted
+  //
+  // mergeFiles() adds the files directly in `d` to this directory,
+  // mergeDirectory() adds `d` as a subdirectory, recursively
+  //
+  void mergeFiles(FilesOrigin& origin, env::Directory& d, DirectoryStats& stats);
+  void mergeDirectory(
+    FilesOrigin& origin, env::Directory& d, DirectoryStats& stats);
+
+  // same as above for the root folder of an archive and one of its subfolders
+  //
+  void mergeArchiveFiles(
+    FilesOrigin& origin, const ArchiveIndex::Folder& folder, FILETIME fileTime,
+    const std::wstring& archiveName, int order, DirectoryStats& stats);
+
+  void mergeArchiveFolder(
+    FilesOrigin& origin, const ArchiveIndex::Folder& folder, FILETIME fileTime,
+    const std::wstring& archiveName, int order, DirectoryStats& stats);
+
+  // brings the loose files of the given origin under `relativePath` in sync
+  // with the disk, used when a change has been reported by the file watcher;
+  // the path can be a file or a directory and is empty for the whole origin
+  //
+  // files that don't exist anymore are removed from the origin and files that
+  // are not in the structure yet are added; must be called on the root
+  //
+  void syncOriginPath(FilesOrigin& origin, const std::wstring& relativePath);
+
+  // adds a file with origins that have already been resolved, such as when
+  // loading a snapshot of the structure; the alternatives must be sorted
+  //
+  FileEntryPtr addResolvedFile(
+    std::wstring_view name, OriginID origin, DataArchiveOrigin archive,
+    AlternativesVector alternatives, FILETIME fileTime);
+
+  // returns the subdirectory by the given name, creating it if necessary
+  //
+  DirectoryEntry* addSubDirectory(std::wstring_view name, OriginID originID);
+
   void propagateOrigin(OriginID origin);
 
-  const std::wstring& getName() const
+  // sorts the files and subdirectories of this directory and all its
+  // subdirectories by name and trims the memory reserved for insertions,
+  // called once a refresh is done
+  //
+  // directories that have not been frozen are sorted on the first iteration,
+  // lookups work either way
+  //
+  void freeze();
+
+  std::wstring_view getName() const
   {
     return m_Name;
   }
 
+  // path of this directory relative to the data directory, starting with a
+  // backslash, empty for the root; interned in the string pool when the
+  // directory is created so building a file path is a single concatenation
+  //
+  std::wstring_view getRelativePath() const
+  {
+    return m_RelativePath;
+  }
+
   boost::shared_ptr<FileRegister> getFileRegister()
   {
     return m_FileRegister;
   }
 
+  boost::shared_ptr<OriginConnection> getOriginConnection() const
+  {
+    return m_OriginConnection;
+  }
+
   bool originExists(const std::wstring& name) const;
   FilesOrigin& getOriginByID(OriginID ID) const;
   FilesOrigin& getOriginByName(const std::wstring& name) const;
   const FilesOrigin* findOriginByID(OriginID ID) const;
 
+  // returns InvalidOriginID if no origin has anything in this directory
+  //
   OriginID anyOrigin() const;
 
+  // origins that have files in this directory or its subdirectories
+  //
+  std::vector<OriginID> getOrigins() const;
+
+  // adds origins without propagating them to the parents, used when loading
+  // a snapshot, where every directory has its own list
+  //
+  void addOrigins(const std::vector<OriginID>& origins);
+
   std::vector<FileEntryPtr> getFiles() const;
 
   const SubDirectories& getSubDirectories() const
   {
+    sortSubDirectories();
     return m_SubDirectories;
   }
 
   template <class F>
   void forEachDirectory(F&& f) const
   {
-    for (auto&& d : m_SubDirectories) {
+    sortSubDirectories();
+
+    for (auto* d : m_SubDirectories) {
       if (!f(*d)) {
         break;
       }
@@ -163,8 +248,10 @@ public:
   template <class F>
   void forEachFile(F&& f) const
   {
-    for (auto&& p : m_Files) {
-      if (auto file=m_FileRegister->getFile(p.second)) {
+    sortFiles();
+
+    for (auto index : m_Files) {
+      if (auto file=m_FileRegister->getFile(index)) {
         if (!f(*file)) {
           break;
         }
@@ -172,11 +259,28 @@ public:
     }
   }
 
+  // calls `f(name, index)` with the lowercase name of every file, so names
+  // can be matched without looking up the files
+  //
+  template <class F>
+  void forEachFileName(F&& f) const
+  {
+    sortFiles();
+
+    for (auto&& e : m_Files.entries()) {
+      if (!f(e.name, e.value)) {
+        break;
+      }
+    }
+  }
+
   template <class F>
   void forEachFileIndex(F&& f) const
   {
-    for (auto&& p : m_Files) {
-      if (!f(p.second)) {
+    sortFiles();
+
+    for (auto index : m_Files) {
+      if (!f(index)) {
         break;
       }
     }
@@ -236,18 +340,18 @@ public:
   void dump(const std::wstring& file) const;
 
 private:
-  using FilesMap = std::map<std::wstring, FileIndex>;
-  using FilesLookup = std::unordered_map<DirectoryEntryFileKey, FileIndex>;
-  using SubDirectoriesLookup = std::unordered_map<std::wstring, DirectoryEntry*>;
+  // all the names are views into the string pool of the file register, the
+  // keys are lowercase; the indexes are mutable because they're sorted
+  // lazily, see sortFiles()
+  using FilesIndex = FlatIndex<FileIndex>;
 
   boost::shared_ptr<FileRegister> m_FileRegister;
   boost::shared_ptr<OriginConnection> m_OriginConnection;
 
-  std::wstring m_Name;
-  FilesMap m_Files;
-  FilesLookup m_FilesLookup;
-  SubDirectories m_SubDirectories;
-  SubDirectoriesLookup m_SubDirectoriesLookup;
+  std::wstring_view m_Name;
+  std::wstring_view m_RelativePath;
+  mutable FilesIndex m_Files;
+  mutable SubDirectories m_SubDirectories;
 
   DirectoryEntry* m_Parent;
   std::set<OriginID> m_Origins;
@@ -258,30 +362,36 @@ private:
   mutable std::mutex m_OriginsMutex;
 
 
+  // if `ordered` is true, the origin is appended with
+  // FileEntry::appendOrigin() instead of being sorted in
+  //
   FileEntryPtr insert(
     std::wstring_view fileName, FilesOrigin& origin, FILETIME fileTime,
-    std::wstring_view archive, int order, DirectoryStats& stats);
-
-  FileEntryPtr insert(
-    env::File& file, FilesOrigin& origin,
-    std::wstring_view archive, int order, DirectoryStats& stats);
+    DataArchiveOrigin archive, const OriginPriorities& priorities,
+    DirectoryStats& stats, bool ordered=false);
 
   void addFiles(
     env::DirectoryWalker& walker, FilesOrigin& origin,
     const std::wstring& path, DirectoryStats& stats);
 
   void addFiles(
-    FilesOrigin& origin, BSA::Folder::Ptr archiveFolder, FILETIME fileTime,
-    const std::wstring& archiveName, int order, DirectoryStats& stats);
+    FilesOrigin& origin, const ArchiveIndex::Folder& archiveFolder,
+    FILETIME fileTime, DataArchiveOrigin archive,
+    const OriginPriorities& priorities, DirectoryStats& stats,
+    bool ordered=false);
 
-  void addDir(FilesOrigin& origin, env::Directory& d, DirectoryStats& stats);
+  void addArchiveFiles(
+    FilesOrigin& origin, const ArchiveIndex::Folder& archiveFolder,
+    FILETIME fileTime, DataArchiveOrigin archive,
+    const OriginPriorities& priorities, DirectoryStats& stats, bool ordered);
 
-  DirectoryEntry* getSubDirectory(
-    std::wstring_view name, bool create, DirectoryStats& stats,
-    OriginID originID = InvalidOriginID);
+  void addDir(
+    FilesOrigin& origin, env::Directory& d,
+    const OriginPriorities& priorities, DirectoryStats& stats,
+    bool ordered=false);
 
   DirectoryEntry* getSubDirectory(
-    env::Directory& dir, bool create, DirectoryStats& stats,
+    std::wstring_view name, bool create, DirectoryStats& stats,
     OriginID originID = InvalidOriginID);
 
   DirectoryEntry* getSubDirectoryRecursive(
@@ -290,32 +400,28 @@ private:
 
   void removeDirRecursive();
 
-  void addDirectoryToList(DirectoryEntry* e, std::wstring nameLc);
-  void removeDirectoryFromList(SubDirectories::iterator itor);
+  void addDirectoryToList(DirectoryEntry* e, std::wstring_view nameLc);
+  void removeDirectoryFromList(DirectoryEntry* e);
 
-  void addFileToList(std::wstring fileNameLower, FileIndex index);
+  void addFileToList(std::wstring_view fileNameLower, FileIndex index);
   void removeFileFromList(FileIndex index);
   void removeFilesFromList(const std::set<FileIndex>& indices);
 
+  // sorts the index if it hasn't been frozen since the last change, iteration
+  // must go through these
+  //
+  void sortFiles() const;
+  void sortSubDirectories() const;
+
   struct Context;
   static void onDirectoryStart(Context* cx, std::wstring_view path);
   static void onDirectoryEnd(Context* cx, std::wstring_view path);
-  static void onFile(Context* cx, std::wstring_view path, FILETIME ft);
+  static void onFile(
+    Context* cx, std::wstring_view path, FILETIME ft, uint64_t size);
 
   void dump(std::FILE* f, const std::wstring& parentPath) const;
 };
 
 } // namespace MOShared
 
-
-namespace std
-{
-  hash<MOShared::DirectoryEntryFileKey>::result_type
-  hash<MOShared::DirectoryEntryFileKey>::operator()(
-    const argument_type& key) const
-  {
-    return key.hash;
-  }
-}
-
 #endif // MO_REGISTER_DIRECTORYENTRY_INCLUDED
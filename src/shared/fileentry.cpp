@@ -1,26 +1,68 @@
 #include "fileentry.h"
 #include "directoryentry.h"
 #include "filesorigin.h"
+#include "originconnection.h"
 
 namespace MOShared
 {
 
+static std::array<std::mutex, 256> g_OriginsMutexes;
+
+
+OriginPriorities::OriginPriorities(OriginConnection& connection)
+  : m_connection(connection)
+{
+}
+
+int OriginPriorities::get(OriginID id) const
+{
+  if (!m_table) {
+    m_table = m_connection.priorities();
+  }
+
+  if (id >= 0 && static_cast<std::size_t>(id) < m_table->size()) {
+    return (*m_table)[static_cast<std::size_t>(id)];
+  }
+
+  // created after the table was built
+  return m_connection.getByID(id).getPriority();
+}
+
+bool OriginPriorities::less(
+  const FileAlternative& a, const FileAlternative& b) const
+{
+  return key(a) < key(b);
+}
+
+std::pair<int, int> OriginPriorities::key(const FileAlternative& a) const
+{
+  if (a.isFromArchive()) {
+    const int order = a.archive().order();
+    return {0, order < 0 ? INT_MAX : order};
+  } else {
+    const int priority = get(a.originID());
+    return {1, priority < 0 ? INT_MAX : priority};
+  }
+}
+
+
 FileEntry::FileEntry() :
   m_Index(InvalidFileIndex), m_Name(), m_Origin(-1), m_Parent(nullptr),
   m_FileSize(NoFileSize), m_CompressedFileSize(NoFileSize)
 {
 }
 
-FileEntry::FileEntry(FileIndex index, std::wstring name, DirectoryEntry *parent) :
-  m_Index(index), m_Name(std::move(name)), m_Origin(-1), m_Archive(L"", -1), m_Parent(parent),
+FileEntry::FileEntry(FileIndex index, std::wstring_view name, DirectoryEntry *parent) :
+  m_Index(index), m_Name(name), m_Origin(-1), m_Archive(), m_Parent(parent),
   m_FileSize(NoFileSize), m_CompressedFileSize(NoFileSize)
 {
 }
 
 void FileEntry::addOrigin(
-  OriginID origin, FILETIME fileTime, std::wstring_view archive, int order)
+  OriginID origin, FILETIME fileTime, DataArchiveOrigin archive,
+  const OriginPriorities& priorities)
 {
-  std::scoped_lock lock(m_OriginsMutex);
+  std::scoped_lock lock(originsMutex());
 
   if (m_Parent != nullptr) {
     m_Parent->propagateOrigin(origin);
@@ -31,147 +73,109 @@ void FileEntry::addOrigin(
     // alternatives
     m_Origin = origin;
     m_FileTime = fileTime;
-    m_Archive = DataArchiveOrigin(std::wstring(archive.begin(), archive.end()), order);
-  }
-  else if (
-    (m_Parent != nullptr) && (
-    (m_Parent->getOriginByID(origin).getPriority() > m_Parent->getOriginByID(m_Origin).getPriority()) ||
-      (archive.size() == 0 && m_Archive.isValid()))
-    ) {
-    // If this mod has a higher priority than the origin mod OR
-    // this mod has a loose file and the origin mod has an archived file,
-    // this mod is now the origin and the previous origin is the first alternative
-
-    auto itor = std::find_if(
-      m_Alternatives.begin(), m_Alternatives.end(),
-      [&](auto&& i) { return i.originID() == m_Origin; });
+    m_Archive = archive;
+    return;
+  }
 
-    if (itor == m_Alternatives.end()) {
-      m_Alternatives.push_back({m_Origin, m_Archive});
-    }
+  if (hasEntry(origin, archive.isValid())) {
+    return;
+  }
 
-    m_Origin = origin;
+  if (m_Parent == nullptr) {
+    m_Alternatives.push_back({origin, archive});
+    return;
+  }
+
+  // the primary origin is put back at the end of the alternatives so the new
+  // one can be inserted in the whole sorted list; the last one is the primary
+  const FileAlternative added(origin, archive);
+
+  m_Alternatives.push_back({m_Origin, m_Archive});
+
+  const auto itor = std::upper_bound(
+    m_Alternatives.begin(), m_Alternatives.end(), added,
+    [&](auto&& a, auto&& b) { return priorities.less(a, b); });
+
+  const bool primary = (itor == m_Alternatives.end());
+  m_Alternatives.insert(itor, added);
+
+  m_Origin = m_Alternatives.back().originID();
+  m_Archive = m_Alternatives.back().archive();
+  m_Alternatives.pop_back();
+
+  if (primary) {
     m_FileTime = fileTime;
-    m_Archive = DataArchiveOrigin(std::wstring(archive.begin(), archive.end()), order);
   }
-  else {
-    // This mod is just an alternative
-    bool found = false;
+}
 
-    if (m_Origin == origin) {
-      // already an origin
-      return;
-    }
+void FileEntry::appendOrigin(
+  OriginID origin, FILETIME fileTime, DataArchiveOrigin archive)
+{
+  std::scoped_lock lock(originsMutex());
 
-    for (auto iter = m_Alternatives.begin(); iter != m_Alternatives.end(); ++iter) {
-      if (iter->originID() == origin) {
-        // already an origin
-        return;
-      }
-
-      if ((m_Parent != nullptr) &&
-        (m_Parent->getOriginByID(iter->originID()).getPriority() < m_Parent->getOriginByID(origin).getPriority())) {
-        m_Alternatives.insert(iter, {origin, {std::wstring(archive.begin(), archive.end()), order}});
-        found = true;
-        break;
-      }
-    }
+  if (m_Parent != nullptr) {
+    m_Parent->propagateOrigin(origin);
+  }
 
-    if (!found) {
-      m_Alternatives.push_back({origin, {std::wstring(archive.begin(), archive.end()), order}});
+  if (m_Origin != -1) {
+    // same rule as addOrigin()
+    if (hasEntry(origin, archive.isValid())) {
+      return;
     }
+
+    m_Alternatives.push_back({m_Origin, m_Archive});
   }
+
+  m_Origin = origin;
+  m_FileTime = fileTime;
+  m_Archive = archive;
 }
 
-bool FileEntry::removeOrigin(OriginID origin)
-{
-  std::scoped_lock lock(m_OriginsMutex);
-
-  if (m_Origin == origin) {
-    if (!m_Alternatives.empty()) {
-      // find alternative with the highest priority
-      auto currentIter = m_Alternatives.begin();
-      for (auto iter = m_Alternatives.begin(); iter != m_Alternatives.end(); ++iter) {
-        if (iter->originID() != origin) {
-          //Both files are not from archives.
-          if (!iter->isFromArchive() && !currentIter->isFromArchive()) {
-            if ((m_Parent->getOriginByID(iter->originID()).getPriority() > m_Parent->getOriginByID(currentIter->originID()).getPriority())) {
-              currentIter = iter;
-            }
-          }
-          else {
-            //Both files are from archives
-            if (iter->isFromArchive() && currentIter->isFromArchive()) {
-              if (iter->archive().order() > currentIter->archive().order()) {
-                currentIter = iter;
-              }
-            }
-            else {
-              //Only one of the two is an archive, so we change currentIter only if he is the archive one.
-              if (currentIter->isFromArchive()) {
-                currentIter = iter;
-              }
-            }
-          }
-        }
-      }
-
-      OriginID currentID = currentIter->originID();
-      m_Archive = currentIter->archive();
-      m_Alternatives.erase(currentIter);
-
-      m_Origin = currentID;
-    } else {
-      m_Origin = -1;
-      m_Archive = DataArchiveOrigin(L"", -1);
-      return true;
-    }
-  } else {
-    auto newEnd = std::remove_if(
+bool FileEntry::removeOrigin(
+  OriginID origin, const OriginPriorities& priorities)
+{
+  std::scoped_lock lock(originsMutex());
+
+  // an origin can have both a loose and an archived file
+  m_Alternatives.erase(
+    std::remove_if(
       m_Alternatives.begin(), m_Alternatives.end(),
-      [&](auto &i) { return i.originID() == origin; });
+      [&](auto &i) { return i.originID() == origin; }),
+    m_Alternatives.end());
 
-    if (newEnd != m_Alternatives.end()) {
-      m_Alternatives.erase(newEnd, m_Alternatives.end());
-    }
+  if (m_Origin != origin) {
+    return false;
   }
+
+  if (m_Alternatives.empty()) {
+    m_Origin = -1;
+    m_Archive = DataArchiveOrigin();
+    return true;
+  }
+
+  // the alternative that wins over all the others becomes the primary origin;
+  // the alternatives are usually sorted, but not after priorities have changed
+  // and before sortOrigins() has been called
+  auto best = std::max_element(
+    m_Alternatives.begin(), m_Alternatives.end(),
+    [&](auto&& a, auto&& b) { return priorities.less(a, b); });
+
+  m_Origin = best->originID();
+  m_Archive = best->archive();
+  m_Alternatives.erase(best);
+
   return false;
 }
 
-void FileEntry::sortOrigins()
+void FileEntry::sortOrigins(const OriginPriorities& priorities)
 {
-  std::scoped_lock lock(m_OriginsMutex);
+  std::scoped_lock lock(originsMutex());
 
   m_Alternatives.push_back({m_Origin, m_Archive});
 
   std::sort(m_Alternatives.begin(), m_Alternatives.end(), [&](auto&& LHS, auto&& RHS) {
-    if (!LHS.isFromArchive() && !RHS.isFromArchive()) {
-      int l = m_Parent->getOriginByID(LHS.originID()).getPriority();
-      if (l < 0) {
-        l = INT_MAX;
-      }
-
-      int r = m_Parent->getOriginByID(RHS.originID()).getPriority();
-      if (r < 0) {
-        r = INT_MAX;
-      }
-
-      return l < r;
-    }
-
-    if (LHS.isFromArchive() && RHS.isFromArchive()) {
-      int l = LHS.archive().order(); if (l < 0) l = INT_MAX;
-      int r = RHS.archive().order(); if (r < 0) r = INT_MAX;
-
-      return l < r;
-    }
-
-    if (RHS.isFromArchive()) {
-      return false;
-    }
-
-    return true;
-    });
+    return priorities.less(LHS, RHS);
+  });
 
   if (!m_Alternatives.empty()) {
     m_Origin = m_Alternatives.back().originID();
@@ -180,20 +184,48 @@ void FileEntry::sortOrigins()
   }
 }
 
+void FileEntry::setOrigins(
+  OriginID origin, DataArchiveOrigin archive, AlternativesVector alternatives)
+{
+  std::scoped_lock lock(originsMutex());
+
+  if (m_Parent != nullptr) {
+    m_Parent->propagateOrigin(origin);
+
+    for (const auto& alt : alternatives) {
+      m_Parent->propagateOrigin(alt.originID());
+    }
+  }
+
+  m_Origin = origin;
+  m_Archive = archive;
+  m_Alternatives = std::move(alternatives);
+}
+
 bool FileEntry::isFromArchive(std::wstring archiveName) const
 {
-  std::scoped_lock lock(m_OriginsMutex);
+  std::scoped_lock lock(originsMutex());
 
   if (archiveName.length() == 0) {
     return m_Archive.isValid();
   }
 
-  if (m_Archive.name().compare(archiveName) == 0) {
+  if (m_Parent == nullptr) {
+    return false;
+  }
+
+  const auto id = m_Parent->getFileRegister()->archives().find(archiveName);
+  if (id == InvalidArchiveID) {
+    // no file comes from this archive
+    return false;
+  }
+
+  if (m_Archive.id() == id) {
     return true;
   }
 
   for (const auto& alternative : m_Alternatives) {
-    if (alternative.archive().name().compare(archiveName) == 0) {
+    if (alternative.archive().id() == id) {
       return true;
     }
   }
@@ -201,11 +233,39 @@ bool FileEntry::isFromArchive(std::wstring archiveName) const
   return false;
 }
 
+std::wstring_view FileEntry::getArchiveName() const
+{
+  std::scoped_lock lock(originsMutex());
+  return getArchiveName(m_Archive);
+}
+
+std::wstring_view FileEntry::getArchiveName(const DataArchiveOrigin& archive) const
+{
+  if (!archive.isValid() || m_Parent == nullptr) {
+    return {};
+  }
+
+  return m_Parent->getFileRegister()->archives().name(archive.id());
+}
+
 std::wstring FileEntry::getFullPath(OriginID originID) const
 {
-  std::scoped_lock lock(m_OriginsMutex);
+  std::wstring result;
+  appendFullPath(result, originID);
+  return result;
+}
 
+std::wstring FileEntry::getRelativePath() const
+{
+  std::wstring result;
+  appendRelativePath(result);
+  return result;
+}
+
+bool FileEntry::appendFullPath(std::wstring& out, OriginID originID) const
+{
   if (originID == InvalidOriginID) {
+    std::scoped_lock lock(originsMutex());
     bool ignore = false;
     originID = getOrigin(ignore);
   }
@@ -213,39 +273,44 @@ std::wstring FileEntry::getFullPath(OriginID originID) const
   // base directory for origin
   const auto* o = m_Parent->findOriginByID(originID);
   if (!o) {
-    return {};
+    return false;
   }
 
-  std::wstring result = o->getPath();
+  const auto& base = o->getPath();
+  const auto dir = m_Parent->getRelativePath();
 
-  // all intermediate directories
-  recurseParents(result, m_Parent);
+  out.reserve(out.size() + base.size() + dir.size() + 1 + m_Name.size());
+  out.append(base).append(dir).append(L"\\").append(m_Name);
 
-  return result + L"\\" + m_Name;
+  return true;
 }
 
-std::wstring FileEntry::getRelativePath() const
+void FileEntry::appendRelativePath(std::wstring& out) const
 {
-  std::wstring result;
+  const auto dir = m_Parent->getRelativePath();
 
-  // all intermediate directories
-  recurseParents(result, m_Parent);
-
-  return result + L"\\" + m_Name;
+  out.reserve(out.size() + dir.size() + 1 + m_Name.size());
+  out.append(dir).append(L"\\").append(m_Name);
 }
 
-bool FileEntry::recurseParents(std::wstring &path, const DirectoryEntry *parent) const
+bool FileEntry::hasEntry(OriginID origin, bool fromArchive) const
 {
-  if (parent == nullptr) {
-    return false;
-  } else {
-    // don't append the topmost parent because it is the virtual data-root
-    if (recurseParents(path, parent->getParent())) {
-      path.append(L"\\").append(parent->getName());
-    }
-
+  if (m_Origin == origin && m_Archive.isValid() == fromArchive) {
     return true;
   }
+
+  for (const auto& alt : m_Alternatives) {
+    if (alt.originID() == origin && alt.isFromArchive() == fromArchive) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
+std::mutex& FileEntry::originsMutex() const
+{
+  return g_OriginsMutexes[m_Index % g_OriginsMutexes.size()];
 }
 
 } // namespace
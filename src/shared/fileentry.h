@@ -6,6 +6,33 @@
 namespace MOShared
 {
 
+// priorities of the origins, used by files to sort their origins without
+// locking the OriginConnection for every comparison
+//
+// the table is taken from the connection the first time it's needed, so an
+// instance is cheap to create when it ends up unused; it is meant to be created
+// once for an operation on many files and passed down, and is not thread-safe
+//
+class OriginPriorities
+{
+public:
+  explicit OriginPriorities(OriginConnection& connection);
+
+  int get(OriginID id) const;
+
+  // the order used by FileEntry::sortOrigins(): archives by load order first,
+  // then loose files by priority; origins without a priority or order go last
+  //
+  bool less(const FileAlternative& a, const FileAlternative& b) const;
+
+private:
+  OriginConnection& m_connection;
+  mutable std::shared_ptr<const std::vector<int>> m_table;
+
+  std::pair<int, int> key(const FileAlternative& a) const;
+};
+
+
 class FileEntry
 {
 public:
@@ -13,7 +40,8 @@ public:
     std::numeric_limits<uint64_t>::max();
 
   FileEntry();
-  FileEntry(FileIndex index, std::wstring name, DirectoryEntry *parent);
+  // the name is a view into the string pool of the structure
+  FileEntry(FileIndex index, std::wstring_view name, DirectoryEntry *parent);
 
   // noncopyable
   FileEntry(const FileEntry&) = delete;
@@ -24,15 +52,32 @@ public:
     return m_Index;
   }
 
+  // an origin can have one entry for a loose copy and one for an archive,
+  // adding another one of the same kind is ignored, see hasEntry()
+  //
   void addOrigin(
-    OriginID origin, FILETIME fileTime, std::wstring_view archive, int order);
+    OriginID origin, FILETIME fileTime, DataArchiveOrigin archive,
+    const OriginPriorities& priorities);
+
+  // adds an origin that is known to win over all the ones already added, the
+  // previous primary origin becomes the last alternative; used when the
+  // origins are added in sorted order so sortOrigins() is not needed
+  //
+  // entries are deduplicated like addOrigin()
+  void appendOrigin(
+    OriginID origin, FILETIME fileTime, DataArchiveOrigin archive);
 
   // remove the specified origin from the list of origins that contain this
   // file. if no origin is left, the file is effectively deleted and true is
   // returned. otherwise, false is returned
-  bool removeOrigin(OriginID origin);
+  bool removeOrigin(OriginID origin, const OriginPriorities& priorities);
+
+  void sortOrigins(const OriginPriorities& priorities);
 
-  void sortOrigins();
+  // replaces all the origins of this file, the alternatives must already be
+  // sorted
+  void setOrigins(
+    OriginID origin, DataArchiveOrigin archive, AlternativesVector alternatives);
 
   // gets the list of alternative origins (origins with lower priority than
   // the primary one). if sortOrigins has been called, it is sorted by priority
@@ -42,7 +87,7 @@ public:
     return m_Alternatives;
   }
 
-  const std::wstring &getName() const
+  std::wstring_view getName() const
   {
     return m_Name;
   }
@@ -65,13 +110,32 @@ public:
 
   bool isFromArchive(std::wstring archiveName = L"") const;
 
+  // name of the archive the primary origin comes from, empty if it's a loose
+  // file
+  //
+  std::wstring_view getArchiveName() const;
+
+  // name of the given archive, which must be the archive of this file or one
+  // of its alternatives
+  //
+  std::wstring_view getArchiveName(const DataArchiveOrigin& archive) const;
+
   // if originID is -1, uses the main origin; if this file doesn't exist in the
   // given origin, returns an empty string
   //
   std::wstring getFullPath(OriginID originID=InvalidOriginID) const;
 
+  // relative to the data directory, starts with a backslash
+  //
   std::wstring getRelativePath() const;
 
+  // same as above, but appended to `out` so callers that build many paths can
+  // reuse the same buffer; appendFullPath() returns false and leaves `out`
+  // unchanged if the file doesn't exist in the given origin
+  //
+  bool appendFullPath(std::wstring& out, OriginID originID=InvalidOriginID) const;
+  void appendRelativePath(std::wstring& out) const;
+
   DirectoryEntry *getParent()
   {
     return m_Parent;
@@ -105,16 +169,22 @@ public:
 
 private:
   FileIndex m_Index;
-  std::wstring m_Name;
+  std::wstring_view m_Name;
   OriginID m_Origin;
   DataArchiveOrigin m_Archive;
   AlternativesVector m_Alternatives;
   DirectoryEntry *m_Parent;
   mutable FILETIME m_FileTime;
   uint64_t m_FileSize, m_CompressedFileSize;
-  mutable std::mutex m_OriginsMutex;
 
-  bool recurseParents(std::wstring &path, const DirectoryEntry *parent) const;
+  // files don't have their own mutex, it would be larger than the rest of
+  // the entry; this returns one from a fixed set shared by all files
+  std::mutex& originsMutex() const;
+
+  // a file has at most one entry per origin for a loose copy and one for
+  // archives, whichever was added first; returns whether the given one exists
+  //
+  bool hasEntry(OriginID origin, bool fromArchive) const;
 };
 
 } // namespace
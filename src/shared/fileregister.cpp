@@ -10,66 +10,174 @@ namespace MOShared
 
 using namespace MOBase;
 
+enum class SlotState : uint8_t
+{
+  // nothing was constructed in this slot
+  Empty = 0,
+
+  // the file is in the structure
+  Alive,
+
+  // the file has been removed, but is still constructed until
+  // recycleRemoved() is called
+  Removed
+};
+
+struct FileRegister::Chunk
+{
+  alignas(FileEntry) std::byte storage[ChunkSize * sizeof(FileEntry)];
+  std::array<std::atomic<SlotState>, ChunkSize> states = {};
+
+  FileEntry* entry(std::size_t i)
+  {
+    return reinterpret_cast<FileEntry*>(storage) + i;
+  }
+
+  ~Chunk()
+  {
+    for (std::size_t i=0; i<ChunkSize; ++i) {
+      if (states[i] != SlotState::Empty) {
+        entry(i)->~FileEntry();
+      }
+    }
+  }
+};
+
+
 FileRegister::FileRegister(boost::shared_ptr<OriginConnection> originConnection)
-  : m_OriginConnection(originConnection), m_NextIndex(0)
+  : m_Chunks{}, m_OriginConnection(originConnection), m_NextIndex(0),
+    m_HasFree(false)
 {
 }
 
-bool FileRegister::indexValid(FileIndex index) const
+FileRegister::~FileRegister()
 {
-  std::scoped_lock lock(m_Mutex);
-
-  if (index < m_Files.size()) {
-    return (m_Files[index].get() != nullptr);
+  for (auto& c : m_Chunks) {
+    delete c.load();
   }
+}
 
-  return false;
+bool FileRegister::indexValid(FileIndex index) const
+{
+  return (getFile(index) != nullptr);
 }
 
 FileEntryPtr FileRegister::createFile(
-  std::wstring name, DirectoryEntry *parent, DirectoryStats& stats)
+  std::wstring_view name, DirectoryEntry *parent, DirectoryStats& stats)
 {
   const auto index = generateIndex();
-  auto p = FileEntryPtr(new FileEntry(index, std::move(name), parent));
+  auto& chunk = chunkFor(index);
+  const auto i = index % ChunkSize;
 
-  {
+  auto* p = new (chunk.entry(i)) FileEntry(index, name, parent);
+  chunk.states[i].store(SlotState::Alive, std::memory_order_release);
+
+  return p;
+}
+
+FileIndex FileRegister::generateIndex()
+{
+  if (m_HasFree.load(std::memory_order_acquire)) {
     std::scoped_lock lock(m_Mutex);
 
-    if (index >= m_Files.size()) {
-      m_Files.resize(index + 1);
+    if (!m_Free.empty()) {
+      const auto index = m_Free.back();
+      m_Free.pop_back();
+      m_HasFree = !m_Free.empty();
+
+      return index;
     }
+  }
+
+  const auto index = m_NextIndex++;
 
-    m_Files[index] = p;
+  if (index >= ChunkSize * MaxChunks) {
+    throw std::runtime_error(fmt::format(
+      "too many files in the directory structure, the maximum is {}",
+      ChunkSize * MaxChunks));
   }
 
-  return p;
+  return index;
 }
 
-FileIndex FileRegister::generateIndex()
+FileRegister::Chunk& FileRegister::chunkFor(FileIndex index)
 {
-  return m_NextIndex++;
+  auto& slot = m_Chunks[index / ChunkSize];
+
+  if (auto* c=slot.load(std::memory_order_acquire)) {
+    return *c;
+  }
+
+  std::scoped_lock lock(m_Mutex);
+
+  // another thread might have allocated it in the meantime
+  if (auto* c=slot.load(std::memory_order_relaxed)) {
+    return *c;
+  }
+
+  auto* c = new Chunk;
+  slot.store(c, std::memory_order_release);
+
+  return *c;
 }
 
 FileEntryPtr FileRegister::getFile(FileIndex index) const
 {
-  std::scoped_lock lock(m_Mutex);
+  if (index >= ChunkSize * MaxChunks) {
+    return nullptr;
+  }
+
+  auto* c = m_Chunks[index / ChunkSize].load(std::memory_order_acquire);
+  if (!c) {
+    return nullptr;
+  }
 
-  if (index < m_Files.size()) {
-    return m_Files[index];
-  } else {
-    return {};
+  const auto i = index % ChunkSize;
+  if (c->states[i].load(std::memory_order_acquire) != SlotState::Alive) {
+    return nullptr;
   }
+
+  return c->entry(i);
 }
 
-bool FileRegister::removeFile(FileIndex index)
+bool FileRegister::markRemoved(FileIndex index)
+{
+  auto* c = m_Chunks[index / ChunkSize].load(std::memory_order_acquire);
+  auto expected = SlotState::Alive;
+
+  if (!c->states[index % ChunkSize].compare_exchange_strong(
+    expected, SlotState::Removed)) {
+    return false;
+  }
+
+  std::scoped_lock lock(m_Mutex);
+  m_Removed.push_back(index);
+
+  return true;
+}
+
+void FileRegister::recycleRemoved()
 {
   std::scoped_lock lock(m_Mutex);
 
-  if (index < m_Files.size()) {
-    FileEntryPtr p;
-    m_Files[index].swap(p);
+  for (const auto index : m_Removed) {
+    auto* c = m_Chunks[index / ChunkSize].load(std::memory_order_acquire);
+    const auto i = index % ChunkSize;
+
+    c->entry(i)->~FileEntry();
+    c->states[i].store(SlotState::Empty, std::memory_order_release);
 
-    if (p) {
+    m_Free.push_back(index);
+  }
+
+  m_Removed.clear();
+  m_HasFree = !m_Free.empty();
+}
+
+bool FileRegister::removeFile(FileIndex index)
+{
+  if (auto* p=getFile(index)) {
+    if (markRemoved(index)) {
       unregisterFile(p);
       return true;
     }
@@ -79,21 +187,17 @@ bool FileRegister::removeFile(FileIndex index)
   return false;
 }
 
-void FileRegister::removeOrigin(FileIndex index, OriginID originID)
+void FileRegister::removeOrigin(
+  FileIndex index, OriginID originID, const OriginPriorities& priorities)
 {
-  std::unique_lock lock(m_Mutex);
-
-  if (index < m_Files.size()) {
-    FileEntryPtr& p = m_Files[index];
-
-    if (p) {
-      if (p->removeOrigin(originID)) {
-        m_Files[index] = {};
-        lock.unlock();
+  if (auto* p=getFile(index)) {
+    if (p->removeOrigin(originID, priorities)) {
+      if (markRemoved(index)) {
         unregisterFile(p);
-        return;
       }
     }
+
+    return;
   }
 
   log::error(QObject::tr("invalid file index for remove (for origin): {}").toStdString(), index);
@@ -102,27 +206,21 @@ void FileRegister::removeOrigin(FileIndex index, OriginID originID)
 void FileRegister::removeOriginMulti(
   std::set<FileIndex> indices, OriginID originID)
 {
+  const OriginPriorities priorities(*m_OriginConnection);
   std::vector<FileEntryPtr> removedFiles;
 
-  {
-    std::scoped_lock lock(m_Mutex);
-
-    for (auto iter = indices.begin(); iter != indices.end(); ) {
-      const auto index = *iter;
-
-      if (index < m_Files.size()) {
-        const auto& p = m_Files[index];
+  for (auto iter = indices.begin(); iter != indices.end(); ) {
+    const auto index = *iter;
 
-        if (p && p->removeOrigin(originID)) {
-          removedFiles.push_back(p);
-          m_Files[index] = {};
-          ++iter;
-          continue;
-        }
+    if (auto* p=getFile(index)) {
+      if (p->removeOrigin(originID, priorities) && markRemoved(index)) {
+        removedFiles.push_back(p);
+        ++iter;
+        continue;
       }
-
-      iter = indices.erase(iter);
     }
+
+    iter = indices.erase(iter);
   }
 
   // optimization: this is only called when disabling an origin and in this case
@@ -153,11 +251,23 @@ void FileRegister::removeOriginMulti(
 
 void FileRegister::sortOrigins()
 {
-  std::scoped_lock lock(m_Mutex);
+  const OriginPriorities priorities(*m_OriginConnection);
+  const FileIndex count = m_NextIndex;
+
+  for (FileIndex i=0; i<count; ++i) {
+    if (auto* p=getFile(i)) {
+      p->sortOrigins(priorities);
+    }
+  }
+}
+
+void FileRegister::sortOrigins(const std::vector<FileIndex>& indices)
+{
+  const OriginPriorities priorities(*m_OriginConnection);
 
-  for (auto&& p : m_Files) {
-    if (p) {
-      p->sortOrigins();
+  for (const auto index : indices) {
+    if (auto* p=getFile(index)) {
+      p->sortOrigins(priorities);
     }
   }
 }
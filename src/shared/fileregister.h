@@ -2,16 +2,33 @@
 #define MO_REGISTER_FILESREGISTER_INCLUDED
 
 #include "fileregisterfwd.h"
+#include "archiveregistry.h"
+#include "stringpool.h"
+#include <array>
+#include <atomic>
 #include <mutex>
+#include <vector>
 #include <boost/shared_ptr.hpp>
 
 namespace MOShared
 {
 
+// owns all the files of a structure
+//
+// files are constructed in place in large chunks that are never moved or freed
+// until the register is destroyed, so a FileEntryPtr is a plain pointer; a
+// removed file stays constructed until recycleRemoved() is called, its slot is
+// then reused by the next files that are created
+//
+// getFile() doesn't lock: the chunk table has a fixed size, chunks are
+// published atomically and each slot has an atomic state; the mutex is only
+// taken to allocate a new chunk
+//
 class FileRegister
 {
 public:
   FileRegister(boost::shared_ptr<OriginConnection> originConnection);
+  ~FileRegister();
 
   // noncopyable
   FileRegister(const FileRegister&) = delete;
@@ -19,33 +36,81 @@ public:
 
   bool indexValid(FileIndex index) const;
 
+  // the name must have been interned in strings()
   FileEntryPtr createFile(
-    std::wstring name, DirectoryEntry *parent, DirectoryStats& stats);
+    std::wstring_view name, DirectoryEntry *parent, DirectoryStats& stats);
 
   FileEntryPtr getFile(FileIndex index) const;
 
   size_t highestCount() const
   {
-    std::scoped_lock lock(m_Mutex);
-    return m_Files.size();
+    return m_NextIndex;
   }
 
   bool removeFile(FileIndex index);
-  void removeOrigin(FileIndex index, OriginID originID);
+  void removeOrigin(
+    FileIndex index, OriginID originID, const OriginPriorities& priorities);
   void removeOriginMulti(std::set<FileIndex> indices, OriginID originID);
 
+  // destroys the files that were removed since the last call and lets new
+  // files reuse their slots; nothing may still use a pointer to a removed file,
+  // so this is only called when the structure is being patched
+  //
+  void recycleRemoved();
+
   void sortOrigins();
 
+  // only sorts the origins of the given files
+  void sortOrigins(const std::vector<FileIndex>& indices);
+
+  // names of all the files and directories in the structure
+  StringPool& strings()
+  {
+    return m_Strings;
+  }
+
+  // names of all the archives that have files in the structure
+  ArchiveRegistry& archives()
+  {
+    return m_Archives;
+  }
+
+  const ArchiveRegistry& archives() const
+  {
+    return m_Archives;
+  }
+
 private:
-  using FileMap = std::deque<FileEntryPtr>;
+  struct Chunk;
+
+  // number of files in a chunk
+  static constexpr std::size_t ChunkSize = 4096;
+
+  // maximum number of chunks, for a bit more than 67 million files
+  static constexpr std::size_t MaxChunks = 16384;
 
   mutable std::mutex m_Mutex;
-  FileMap m_Files;
+  std::array<std::atomic<Chunk*>, MaxChunks> m_Chunks;
   boost::shared_ptr<OriginConnection> m_OriginConnection;
   std::atomic<FileIndex> m_NextIndex;
 
+  // files removed since the last recycleRemoved(), and slots that can be
+  // reused; both are protected by m_Mutex, m_HasFree avoids locking it for
+  // every file when there's nothing to reuse
+  std::vector<FileIndex> m_Removed;
+  std::vector<FileIndex> m_Free;
+  std::atomic<bool> m_HasFree;
+  StringPool m_Strings;
+  ArchiveRegistry m_Archives;
+
   void unregisterFile(FileEntryPtr file);
   FileIndex generateIndex();
+
+  // returns the chunk for the given index, allocates it if needed
+  Chunk& chunkFor(FileIndex index);
+
+  // marks the file as removed, returns false if it was already removed
+  bool markRemoved(FileIndex index);
 };
 
 } // namespace
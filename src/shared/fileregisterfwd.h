@@ -2,6 +2,7 @@
 #define MO_REGISTER_FILEREGISTERFWD_INCLUDED
 
 class DirectoryRefreshProgress;
+class QJsonObject;
 
 namespace MOShared
 {
@@ -31,37 +32,45 @@ struct DirectoryEntryFileKey
 class DirectoryEntry;
 class OriginConnection;
 class FileRegister;
+class ArchiveRegistry;
 class FilesOrigin;
 class FileEntry;
+class OriginPriorities;
 struct DirectoryStats;
 
-using FileEntryPtr = boost::shared_ptr<FileEntry>;
+// files are owned by the FileRegister, see FileRegister
+using FileEntryPtr = FileEntry*;
 using FileIndex = unsigned int;
 using OriginID = int;
 
+// archive names are stored once per structure, see ArchiveRegistry
+using ArchiveID = uint32_t;
+
 constexpr FileIndex InvalidFileIndex = UINT_MAX;
 constexpr OriginID InvalidOriginID = -1;
+constexpr ArchiveID InvalidArchiveID = 0;
 
-// if a file is in an archive, name is the name of the bsa and order
-// is the order of the associated plugin in the plugins list
-// is a file is not in an archive, archiveName is empty and order is usually
+// if a file is in an archive, id is the id of the bsa in the ArchiveRegistry
+// of the structure and order is the order of the associated plugin in the
+// plugins list
+// is a file is not in an archive, id is InvalidArchiveID and order is usually
 // -1
 class DataArchiveOrigin
 {
-  std::wstring name_ = L"";
+  ArchiveID id_ = InvalidArchiveID;
   int order_ = -1;
-  
+
 public:
 
   int order() const { return order_; }
-  const std::wstring& name() const { return name_; }
-  
+  ArchiveID id() const { return id_; }
+
   bool isValid() const {
-    return name_.size() > 0;
+    return id_ != InvalidArchiveID;
   }
 
-  DataArchiveOrigin(std::wstring name, int order)
-    : name_(std::move(name)), order_(order) {}
+  DataArchiveOrigin(ArchiveID id, int order)
+    : id_(id), order_(order) {}
 
   DataArchiveOrigin() = default;
 };
@@ -82,18 +91,155 @@ public:
 
   FileAlternative() = default;
 
-  FileAlternative(OriginID originID, DataArchiveOrigin archive) 
-    : originID_(originID), archive_(std::move(archive)) {}
+  FileAlternative(OriginID originID, DataArchiveOrigin archive)
+    : originID_(originID), archive_(archive) {}
 };
 
+// files can have many alternatives, they're kept small and trivially copyable
+// so vectors of them can be moved around with memcpy()
+static_assert(std::is_trivially_copyable_v<FileAlternative>);
+static_assert(sizeof(FileAlternative) == 12);
+
 using AlternativesVector = std::vector<FileAlternative>;
 
+
+// summary of what an origin had on disk the last time it was walked: the
+// number of directories and files, and a hash of every relative path with its
+// last write time and size
+//
+// the hash is order-independent so the same directory gives the same
+// fingerprint regardless of how it was walked; this is used by incremental
+// refreshes to figure out which origins need to be scanned again
+//
+struct OriginFingerprint
+{
+  std::size_t dirs = 0;
+  std::size_t files = 0;
+  std::size_t hash = 0;
+
+  bool operator==(const OriginFingerprint& o) const
+  {
+    return (dirs == o.dirs && files == o.files && hash == o.hash);
+  }
+
+  bool operator!=(const OriginFingerprint& o) const
+  {
+    return !(*this == o);
+  }
+
+  // adds the result of walking another part of the same origin
+  OriginFingerprint& operator+=(const OriginFingerprint& o)
+  {
+    dirs += o.dirs;
+    files += o.files;
+    hash += o.hash;
+    return *this;
+  }
+
+  // computes a fingerprint while walking a directory, keeps track of the
+  // hash of the current path
+  //
+  class Builder
+  {
+  public:
+    Builder()
+      : Builder(0)
+    {
+    }
+
+    // starts in a directory with the given path hash, used when an origin is
+    // walked one directory at a time; the results can be summed
+    explicit Builder(std::size_t pathHash)
+    {
+      m_path.push_back(pathHash);
+    }
+
+    // hash of the current path
+    std::size_t pathHash() const
+    {
+      return m_path.back();
+    }
+
+    void enterDirectory(std::wstring_view name)
+    {
+      const auto h = combine(m_path.back(), std::hash<std::wstring_view>()(name));
+      m_path.push_back(h);
+
+      ++m_fp.dirs;
+      m_fp.hash += mix(h);
+    }
+
+    void leaveDirectory()
+    {
+      m_path.pop_back();
+    }
+
+    void addFile(std::wstring_view name, FILETIME ft, uint64_t size)
+    {
+      auto h = combine(m_path.back(), std::hash<std::wstring_view>()(name));
+      h = combine(h, (uint64_t(ft.dwHighDateTime) << 32) | ft.dwLowDateTime);
+      h = combine(h, size);
+
+      ++m_fp.files;
+      m_fp.hash += mix(h);
+    }
+
+    const OriginFingerprint& result() const
+    {
+      return m_fp;
+    }
+
+  private:
+    OriginFingerprint m_fp;
+    std::vector<std::size_t> m_path;
+
+    static std::size_t combine(std::size_t seed, uint64_t v)
+    {
+      return seed ^ (std::size_t(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+    }
+
+    static std::size_t mix(std::size_t h)
+    {
+      // spreads bits so that summing the hashes of similar paths doesn't
+      // cancel out
+      h ^= h >> 33;
+      h *= 0xff51afd7ed558ccdULL;
+      h ^= h >> 33;
+      return h;
+    }
+  };
+};
+
+// counters and timings collected while building the directory structure,
+// usually for one origin
+//
+// the counters are always updated, but timings are only taken when
+// instrumentation has been enabled, see setEnabled(); tasks fill their own
+// DirectoryStats and merge them in the one for the origin when they're done
+//
 struct DirectoryStats
 {
-  static constexpr bool EnableInstrumentation = false;
+  // whether timings are taken, can be changed at any time
+  //
+  static bool enabled()
+  {
+    return s_enabled.load(std::memory_order_relaxed);
+  }
+
+  static void setEnabled(bool b)
+  {
+    s_enabled = b;
+  }
 
   std::string mod;
 
+  // time spent walking the directory of the origin, getting the listing of
+  // its archives and merging both into the structure, summed over all the
+  // tasks
+  std::chrono::nanoseconds walkTimes;
+  std::chrono::nanoseconds archiveTimes;
+  std::chrono::nanoseconds mergeTimes;
+
   std::chrono::nanoseconds dirTimes;
   std::chrono::nanoseconds fileTimes;
   std::chrono::nanoseconds sortTimes;
@@ -123,8 +269,13 @@ struct DirectoryStats
 
   DirectoryStats& operator+=(const DirectoryStats& o);
 
-  static std::string csvHeader();
-  std::string toCsv() const;
+  // total of the walk, archive and merge times
+  std::chrono::nanoseconds totalTimes() const;
+
+  QJsonObject toJson() const;
+
+private:
+  static inline std::atomic<bool> s_enabled = false;
 };
 
 } // namespace
@@ -33,7 +33,15 @@ FilesOrigin::FilesOrigin(
 
 void FilesOrigin::setPriority(int priority)
 {
+  if (m_Priority == priority) {
+    return;
+  }
+
   m_Priority = priority;
+
+  if (auto c=m_OriginConnection.lock()) {
+    c->resetPriorities();
+  }
 }
 
 void FilesOrigin::setName(const std::wstring &name)
@@ -51,12 +59,14 @@ void FilesOrigin::setName(const std::wstring &name)
 std::vector<FileEntryPtr> FilesOrigin::getFiles() const
 {
   std::vector<FileEntryPtr> result;
+  const auto fileRegister = m_FileRegister.lock();
 
   {
     std::scoped_lock lock(m_Mutex);
+    result.reserve(m_Files.size());
 
     for (FileIndex fileIdx : m_Files) {
-      if (FileEntryPtr p = m_FileRegister.lock()->getFile(fileIdx)) {
+      if (FileEntryPtr p = fileRegister->getFile(fileIdx)) {
         result.push_back(p);
       }
     }
@@ -108,10 +118,17 @@ void FilesOrigin::removeFile(FileIndex index)
 
 bool FilesOrigin::containsArchive(std::wstring archiveName)
 {
+  const auto fileRegister = m_FileRegister.lock();
+
+  if (fileRegister->archives().find(archiveName) == InvalidArchiveID) {
+    // no file in the structure comes from this archive
+    return false;
+  }
+
   std::scoped_lock lock(m_Mutex);
 
   for (FileIndex fileIdx : m_Files) {
-    if (FileEntryPtr p = m_FileRegister.lock()->getFile(fileIdx)) {
+    if (FileEntryPtr p = fileRegister->getFile(fileIdx)) {
       if (p->isFromArchive(archiveName)) {
         return true;
       }
@@ -68,9 +68,23 @@ public:
 
   bool containsArchive(std::wstring archiveName);
 
+  // fingerprint of the loose files of this origin as they were when the
+  // origin was last walked, see OriginFingerprint
+  //
+  const OriginFingerprint& fingerprint() const
+  {
+    return m_Fingerprint;
+  }
+
+  void setFingerprint(const OriginFingerprint& fp)
+  {
+    m_Fingerprint = fp;
+  }
+
 private:
   OriginID m_ID;
   bool m_Disabled;
+  OriginFingerprint m_Fingerprint;
   std::set<FileIndex> m_Files;
   std::wstring m_Name;
   std::wstring m_Path;
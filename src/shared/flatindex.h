@@ -0,0 +1,302 @@
+#ifndef MO_REGISTER_FLATINDEX_INCLUDED
+#define MO_REGISTER_FLATINDEX_INCLUDED
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <string_view>
+#include <vector>
+
+namespace MOShared
+{
+
+// maps names to values, used by DirectoryEntry for its files and
+// subdirectories instead of a map for ordered iteration and a hash map for
+// lookups
+//
+// entries are stored in a single vector and found through an open-addressing
+// table of their positions; new entries are appended, so the vector is only
+// ordered by name after sort()
+//
+// freeze() is called once the structure has been built, it sorts the entries
+// and trims the memory that was reserved for insertions
+//
+// names are views, typically into the string pool of the structure, and must
+// outlive the index; the index is not thread-safe
+//
+template <class Value>
+class FlatIndex
+{
+public:
+  struct Entry
+  {
+    std::size_t hash;
+    std::wstring_view name;
+    Value value;
+  };
+
+  // iterates over the values
+  //
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Value;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Value*;
+    using reference = const Value&;
+
+    const_iterator() = default;
+
+    explicit const_iterator(typename std::vector<Entry>::const_iterator itor)
+      : m_itor(itor)
+    {
+    }
+
+    reference operator*() const { return m_itor->value; }
+    pointer operator->() const { return &m_itor->value; }
+
+    const_iterator& operator++()
+    {
+      ++m_itor;
+      return *this;
+    }
+
+    const_iterator operator++(int)
+    {
+      auto copy = *this;
+      ++m_itor;
+      return copy;
+    }
+
+    bool operator==(const const_iterator& o) const { return m_itor == o.m_itor; }
+    bool operator!=(const const_iterator& o) const { return m_itor != o.m_itor; }
+
+  private:
+    typename std::vector<Entry>::const_iterator m_itor;
+  };
+
+  static std::size_t hashOf(std::wstring_view name)
+  {
+    return std::hash<std::wstring_view>()(name);
+  }
+
+  bool empty() const
+  {
+    return m_entries.empty();
+  }
+
+  std::size_t size() const
+  {
+    return m_entries.size();
+  }
+
+  const_iterator begin() const
+  {
+    return const_iterator(m_entries.begin());
+  }
+
+  const_iterator end() const
+  {
+    return const_iterator(m_entries.end());
+  }
+
+  const std::vector<Entry>& entries() const
+  {
+    return m_entries;
+  }
+
+  // returns null if the name is not in the index
+  //
+  const Value* find(std::wstring_view name) const
+  {
+    return find(name, hashOf(name));
+  }
+
+  // `hash` must be hashOf(name)
+  //
+  const Value* find(std::wstring_view name, std::size_t hash) const
+  {
+    if (m_slots.empty()) {
+      return nullptr;
+    }
+
+    const auto slot = m_slots[findSlot(name, hash)];
+    if (slot == 0) {
+      return nullptr;
+    }
+
+    return &m_entries[slot - 1].value;
+  }
+
+  // adds the given value, returns false and does nothing if the name is
+  // already in the index
+  //
+  bool insert(std::wstring_view name, Value value)
+  {
+    return insert(name, hashOf(name), std::move(value));
+  }
+
+  bool insert(std::wstring_view name, std::size_t hash, Value value)
+  {
+    // the table is kept at most half full
+    if (m_slots.empty()) {
+      m_slots.assign(16, 0);
+    } else if ((m_entries.size() + 1) * 2 > m_slots.size()) {
+      rebuildSlots(m_slots.size() * 2);
+    }
+
+    auto& slot = m_slots[findSlot(name, hash)];
+    if (slot != 0) {
+      return false;
+    }
+
+    if (m_sorted && !m_entries.empty() && name < m_entries.back().name) {
+      m_sorted = false;
+    }
+
+    m_frozen = false;
+
+    m_entries.push_back({hash, name, std::move(value)});
+    slot = static_cast<std::uint32_t>(m_entries.size());
+
+    return true;
+  }
+
+  // removes all the entries for which `f(value)` returns true, keeps the
+  // others in the same order; returns the number of entries removed
+  //
+  template <class F>
+  std::size_t removeIf(F&& f)
+  {
+    auto newEnd = std::remove_if(
+      m_entries.begin(), m_entries.end(),
+      [&](auto&& e) { return f(e.value); });
+
+    const auto removed = static_cast<std::size_t>(m_entries.end() - newEnd);
+
+    if (removed > 0) {
+      m_entries.erase(newEnd, m_entries.end());
+      rebuildSlots(m_slots.size());
+      m_frozen = false;
+    }
+
+    return removed;
+  }
+
+  void clear()
+  {
+    m_entries.clear();
+    m_slots.clear();
+    m_sorted = true;
+    m_frozen = false;
+  }
+
+  // whether entries are ordered by name
+  //
+  bool sorted() const
+  {
+    return m_sorted;
+  }
+
+  // orders entries by name
+  //
+  void sort()
+  {
+    if (m_sorted) {
+      return;
+    }
+
+    std::sort(m_entries.begin(), m_entries.end(), [](auto&& a, auto&& b) {
+      return (a.name < b.name);
+    });
+
+    m_sorted = true;
+    rebuildSlots(m_slots.size());
+  }
+
+  // sorts the entries and releases the memory that's not needed for lookups;
+  // does nothing if nothing changed since the last call
+  //
+  void freeze()
+  {
+    if (m_frozen) {
+      return;
+    }
+
+    sort();
+
+    m_entries.shrink_to_fit();
+
+    std::size_t capacity = 16;
+    while (capacity < m_entries.size() * 2) {
+      capacity *= 2;
+    }
+
+    rebuildSlots(capacity);
+
+    m_frozen = true;
+  }
+
+private:
+  std::vector<Entry> m_entries;
+
+  // position in m_entries plus one for every slot, 0 for empty slots; the size
+  // is a power of two
+  std::vector<std::uint32_t> m_slots;
+
+  bool m_sorted = true;
+
+  // whether freeze() was called after the last change
+  bool m_frozen = false;
+
+  // returns the slot that has the given name, or the empty slot where it
+  // would go
+  //
+  std::size_t findSlot(std::wstring_view name, std::size_t hash) const
+  {
+    const std::size_t mask = m_slots.size() - 1;
+
+    for (std::size_t i=hash & mask; ; i=(i + 1) & mask) {
+      const auto slot = m_slots[i];
+
+      if (slot == 0) {
+        return i;
+      }
+
+      const auto& e = m_entries[slot - 1];
+      if (e.hash == hash && e.name == name) {
+        return i;
+      }
+    }
+  }
+
+  void rebuildSlots(std::size_t capacity)
+  {
+    if (m_entries.empty()) {
+      // empty directories are common, don't keep a table for them
+      m_slots.clear();
+      m_slots.shrink_to_fit();
+      return;
+    }
+
+    m_slots.assign(capacity, 0);
+
+    const std::size_t mask = capacity - 1;
+
+    for (std::size_t e=0; e<m_entries.size(); ++e) {
+      std::size_t i = m_entries[e].hash & mask;
+
+      while (m_slots[i] != 0) {
+        i = (i + 1) & mask;
+      }
+
+      m_slots[i] = static_cast<std::uint32_t>(e + 1);
+    }
+  }
+};
+
+} // namespace
+
+#endif // MO_REGISTER_FLATINDEX_INCLUDED
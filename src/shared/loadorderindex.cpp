@@ -0,0 +1,50 @@
+#include "loadorderindex.h"
+#include "util.h"
+
+namespace MOShared
+{
+
+LoadOrderIndex::LoadOrderIndex(const std::vector<std::wstring>& loadOrder)
+{
+  m_Stems.reserve(loadOrder.size());
+
+  for (std::size_t i=0; i<loadOrder.size(); ++i) {
+    const auto stem = std::filesystem::path(loadOrder[i]).stem().native();
+
+    // later plugins replace earlier ones with the same stem
+    m_Stems[ToLowerCopy(stem)] = static_cast<int>(i);
+  }
+}
+
+int LoadOrderIndex::archiveOrder(std::wstring_view archiveName) const
+{
+  if (m_Stems.empty()) {
+    return -1;
+  }
+
+  const auto nameLc = ToLowerCopy(archiveName);
+  const std::wstring_view sv(nameLc);
+
+  int order = -1;
+
+  // the only stems that can match are the prefixes that end right before a
+  // "." or a " - "
+  auto check = [&](std::size_t length) {
+    auto itor = m_Stems.find(std::wstring(sv.substr(0, length)));
+    if (itor != m_Stems.end()) {
+      order = std::max(order, itor->second);
+    }
+  };
+
+  for (std::size_t i=0; i<sv.size(); ++i) {
+    if (sv[i] == L'.') {
+      check(i);
+    } else if (sv.substr(i, 3) == L" - ") {
+      check(i);
+    }
+  }
+
+  return order;
+}
+
+} // namespace
@@ -0,0 +1,36 @@
+#ifndef MO_REGISTER_LOADORDERINDEX_INCLUDED
+#define MO_REGISTER_LOADORDERINDEX_INCLUDED
+
+#include <unordered_map>
+
+namespace MOShared
+{
+
+// maps the lowercase stem of every plugin in the load order to its index,
+// used to find the plugin that loads an archive without going through the
+// whole load order every time
+//
+// built once per refresh, it's read-only afterwards and can be shared by all
+// the threads
+//
+class LoadOrderIndex
+{
+public:
+  LoadOrderIndex() = default;
+  explicit LoadOrderIndex(const std::vector<std::wstring>& loadOrder);
+
+  // returns the index in the load order of the plugin that loads the given
+  // archive, or -1; an archive is loaded by a plugin if its name is the stem
+  // of the plugin followed by either "." or " - "
+  //
+  // if multiple plugins match, the last one in the load order wins
+  //
+  int archiveOrder(std::wstring_view archiveName) const;
+
+private:
+  std::unordered_map<std::wstring, int> m_Stems;
+};
+
+} // namespace
+
+#endif // MO_REGISTER_LOADORDERINDEX_INCLUDED
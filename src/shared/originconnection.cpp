@@ -13,6 +13,117 @@ OriginConnection::OriginConnection()
 {
 }
 
+void OriginConnection::setModIndexResolver(const ModIndexResolver* r)
+{
+  s_Resolver = r;
+}
+
+unsigned int OriginConnection::modIndex(OriginID id) const
+{
+  const auto t = modIndices();
+
+  if (id < 0 || static_cast<std::size_t>(id) >= t->size()) {
+    return UINT_MAX;
+  }
+
+  return (*t)[static_cast<std::size_t>(id)];
+}
+
+std::shared_ptr<const std::vector<unsigned int>> OriginConnection::modIndices() const
+{
+  static const auto empty = std::make_shared<const std::vector<unsigned int>>();
+
+  const auto* r = s_Resolver.load();
+  if (!r) {
+    return empty;
+  }
+
+  std::vector<std::pair<OriginID, std::wstring>> names;
+  unsigned int generation = 0;
+  std::size_t version = 0;
+  OriginID maxID = -1;
+
+  {
+    std::scoped_lock lock(m_Mutex);
+
+    // taken before resolving the names, so indices changing in the meantime
+    // will build the table again on the next call
+    generation = r->generation();
+
+    if (m_ModIndices && m_ModIndicesGeneration == generation) {
+      return m_ModIndices;
+    }
+
+    version = m_OriginsVersion;
+
+    for (auto&& [id, o] : m_Origins) {
+      if (id < 0) {
+        continue;
+      }
+
+      names.push_back({id, o.getName()});
+      maxID = std::max(maxID, id);
+    }
+  }
+
+  // the resolver has its own lock, it's not called with m_Mutex held
+  auto t = std::make_shared<std::vector<unsigned int>>(
+    static_cast<std::size_t>(maxID + 1), UINT_MAX);
+
+  for (const auto& [id, name] : names) {
+    (*t)[static_cast<std::size_t>(id)] = r->modIndex(name);
+  }
+
+  std::scoped_lock lock(m_Mutex);
+
+  if (m_OriginsVersion == version) {
+    m_ModIndices = t;
+    m_ModIndicesGeneration = generation;
+  }
+
+  return t;
+}
+
+void OriginConnection::resetModIndices()
+{
+  m_ModIndices.reset();
+  m_Priorities.reset();
+  ++m_OriginsVersion;
+}
+
+std::shared_ptr<const std::vector<int>> OriginConnection::priorities() const
+{
+  std::scoped_lock lock(m_Mutex);
+
+  if (m_Priorities) {
+    return m_Priorities;
+  }
+
+  OriginID maxID = -1;
+  for (auto&& [id, o] : m_Origins) {
+    maxID = std::max(maxID, id);
+  }
+
+  auto t = std::make_shared<std::vector<int>>(
+    static_cast<std::size_t>(maxID + 1), 0);
+
+  for (auto&& [id, o] : m_Origins) {
+    if (id >= 0) {
+      (*t)[static_cast<std::size_t>(id)] = o.getPriority();
+    }
+  }
+
+  m_Priorities = t;
+
+  return t;
+}
+
+void OriginConnection::resetPriorities()
+{
+  std::scoped_lock lock(m_Mutex);
+  m_Priorities.reset();
+}
+
 std::pair<FilesOrigin&, bool> OriginConnection::getOrCreate(
   const std::wstring &originName, const std::wstring &directory, int priority,
   const boost::shared_ptr<FileRegister>& fileRegister,
@@ -57,7 +168,15 @@ bool OriginConnection::exists(const std::wstring &name)
 FilesOrigin& OriginConnection::getByID(OriginID ID)
 {
   std::scoped_lock lock(m_Mutex);
-  return m_Origins[ID];
+
+  auto itor = m_Origins.find(ID);
+
+  if (itor == m_Origins.end()) {
+    // operator[] would silently create an empty origin
+    throw std::runtime_error(fmt::format("invalid origin id: {}", ID));
+  }
+
+  return itor->second;
 }
 
 const FilesOrigin* OriginConnection::findByID(OriginID ID) const
@@ -98,6 +217,7 @@ void OriginConnection::changeNameLookup(const std::wstring &oldName, const std::
     OriginID idx = iter->second;
     m_OriginsNameMap.erase(iter);
     m_OriginsNameMap[newName] = idx;
+    resetModIndices();
   } else {
     log::error(QObject::tr("failed to change name lookup from {} to {}").toStdString(), oldName, newName);
   }
@@ -124,6 +244,7 @@ FilesOrigin& OriginConnection::createOriginNoLock(
     .first;
 
   m_OriginsNameMap.insert({originName, newID});
+  resetModIndices();
 
   return itor->second;
 }
@@ -6,9 +6,28 @@
 namespace MOShared
 {
 
+// maps origin names to mod indices, implemented by the mod list; the
+// generation must change every time mod indices change
+//
+class ModIndexResolver
+{
+public:
+  virtual ~ModIndexResolver() = default;
+
+  virtual unsigned int generation() const = 0;
+
+  // UINT_MAX if there is no mod with that name
+  virtual unsigned int modIndex(const std::wstring& originName) const = 0;
+};
+
+
 class OriginConnection
 {
 public:
+  // sets the resolver used by all connections to map origins to mods
+  //
+  static void setModIndexResolver(const ModIndexResolver* r);
+
   OriginConnection();
 
   // noncopyable
@@ -36,12 +55,66 @@ public:
 
   void changeNameLookup(const std::wstring &oldName, const std::wstring &newName);
 
+  // mod index of the given origin, UINT_MAX if it's not a mod, such as the
+  // data directory
+  //
+  unsigned int modIndex(OriginID id) const;
+
+  // mod index of every origin, indexed by origin id; origins created after
+  // this was called are not in it
+  //
+  // the table is built again when origins are created or renamed, or when
+  // mod indices change, and is otherwise shared; loops should get it once
+  // instead of calling modIndex() for every origin
+  //
+  std::shared_ptr<const std::vector<unsigned int>> modIndices() const;
+
+  // priority of every origin, indexed by origin id; origins created after
+  // this was called are not in it
+  //
+  // the table is built again when origins are created or when the priority
+  // of an origin changes, and is otherwise shared; this is what files use to
+  // sort their origins without locking the connection for every comparison
+  //
+  std::shared_ptr<const std::vector<int>> priorities() const;
+
+  // forgets the priority table, called by FilesOrigin::setPriority()
+  //
+  void resetPriorities();
+
+  // calls f() for every origin, in order of IDs
+  //
+  template <class F>
+  void forEachOrigin(F&& f) const
+  {
+    std::scoped_lock lock(m_Mutex);
+
+    for (auto&& p : m_Origins) {
+      f(p.second);
+    }
+  }
+
 private:
   std::atomic<OriginID> m_NextID;
   std::map<OriginID, FilesOrigin> m_Origins;
   std::map<std::wstring, OriginID> m_OriginsNameMap;
   mutable std::mutex m_Mutex;
 
+  static inline std::atomic<const ModIndexResolver*> s_Resolver = nullptr;
+
+  // null when origins changed since it was built
+  mutable std::shared_ptr<const std::vector<unsigned int>> m_ModIndices;
+  mutable unsigned int m_ModIndicesGeneration = 0;
+
+  // incremented every time m_ModIndices is reset, so a table built while
+  // origins were changing is not kept
+  mutable std::size_t m_OriginsVersion = 0;
+
+  // null when origins or priorities changed since it was built
+  mutable std::shared_ptr<const std::vector<int>> m_Priorities;
+
+  void resetModIndices();
+
   OriginID createID();
 
   FilesOrigin& createOriginNoLock(
@@ -0,0 +1,176 @@
+#ifndef MO_REGISTER_SNAPSHOTIO_INCLUDED
+#define MO_REGISTER_SNAPSHOTIO_INCLUDED
+
+#include <QSaveFile>
+
+// helpers to write and read the binary files saved in the instance
+// directory, such as the directory snapshot and the archive cache
+
+namespace MOShared
+{
+
+struct SnapshotError : public std::runtime_error
+{
+  using runtime_error::runtime_error;
+};
+
+
+// buffers writes to the file, everything is written in native byte order
+//
+class SnapshotWriter
+{
+public:
+  SnapshotWriter(QSaveFile& f)
+    : m_file(f)
+  {
+    m_buffer.reserve(BufferSize);
+  }
+
+  template <class T>
+  void write(T v)
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+    writeRaw(&v, sizeof(v));
+  }
+
+  void write(std::wstring_view s)
+  {
+    write(static_cast<uint32_t>(s.size()));
+    writeRaw(s.data(), s.size() * sizeof(wchar_t));
+  }
+
+  void write(const QString& s)
+  {
+    write(std::wstring_view(
+      reinterpret_cast<const wchar_t*>(s.utf16()), s.size()));
+  }
+
+  void write(const QStringList& list)
+  {
+    write(static_cast<uint32_t>(list.size()));
+    for (auto&& s : list) {
+      write(s);
+    }
+  }
+
+  void flush()
+  {
+    if (m_buffer.empty()) {
+      return;
+    }
+
+    const auto r = m_file.write(m_buffer.data(), m_buffer.size());
+    if (r != static_cast<qint64>(m_buffer.size())) {
+      throw SnapshotError(m_file.errorString().toStdString());
+    }
+
+    m_buffer.clear();
+  }
+
+private:
+  static constexpr std::size_t BufferSize = 1024 * 1024;
+
+  QSaveFile& m_file;
+  std::vector<char> m_buffer;
+
+  void writeRaw(const void* p, std::size_t size)
+  {
+    if (m_buffer.size() + size > BufferSize) {
+      flush();
+    }
+
+    const auto* c = static_cast<const char*>(p);
+    m_buffer.insert(m_buffer.end(), c, c + size);
+  }
+};
+
+
+// reads from the memory mapped file, throws SnapshotError when trying to read
+// past the end
+//
+class SnapshotReader
+{
+public:
+  SnapshotReader(const uchar* begin, const uchar* end)
+    : m_p(begin), m_end(end)
+  {
+  }
+
+  template <class T>
+  T read()
+  {
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    check(sizeof(T));
+
+    T v;
+    std::memcpy(&v, m_p, sizeof(T));
+    m_p += sizeof(T);
+
+    return v;
+  }
+
+  std::wstring_view readStringView()
+  {
+    const auto size = read<uint32_t>();
+    const auto bytes = static_cast<std::size_t>(size) * sizeof(wchar_t);
+
+    check(bytes);
+
+    // the data might not be aligned, but wchar_t accesses on x86 don't care
+    const auto* s = reinterpret_cast<const wchar_t*>(m_p);
+    m_p += bytes;
+
+    return {s, size};
+  }
+
+  std::wstring readString()
+  {
+    const auto sv = readStringView();
+    return {sv.begin(), sv.end()};
+  }
+
+  QString readQString()
+  {
+    const auto sv = readStringView();
+    return QString::fromWCharArray(sv.data(), static_cast<int>(sv.size()));
+  }
+
+  // skips the given number of bytes, returns a pointer to the first one
+  const uchar* skip(std::size_t size)
+  {
+    check(size);
+
+    const auto* p = m_p;
+    m_p += size;
+
+    return p;
+  }
+
+  QStringList readQStringList()
+  {
+    QStringList list;
+
+    const auto count = read<uint32_t>();
+    for (uint32_t i=0; i<count; ++i) {
+      list.push_back(readQString());
+    }
+
+    return list;
+  }
+
+private:
+  const uchar* m_p;
+  const uchar* m_end;
+
+  void check(std::size_t size) const
+  {
+    if (static_cast<std::size_t>(m_end - m_p) < size) {
+      throw SnapshotError("unexpected end of file");
+    }
+  }
+};
+
+} // namespace
+
+#endif // MO_REGISTER_SNAPSHOTIO_INCLUDED
@@ -0,0 +1,67 @@
+#include "stringpool.h"
+
+namespace MOShared
+{
+
+std::wstring_view StringPool::intern(std::wstring_view s)
+{
+  const auto h = std::hash<std::wstring_view>()(s);
+  auto& shard = m_Shards[h % ShardCount];
+
+  std::scoped_lock lock(shard.mutex);
+
+  auto itor = shard.strings.find(s);
+  if (itor != shard.strings.end()) {
+    return *itor;
+  }
+
+  const auto stored = shard.copy(s);
+  shard.strings.insert(stored);
+
+  return stored;
+}
+
+std::size_t StringPool::size() const
+{
+  std::size_t n = 0;
+
+  for (auto&& shard : m_Shards) {
+    std::scoped_lock lock(shard.mutex);
+    n += shard.used;
+  }
+
+  return n;
+}
+
+std::wstring_view StringPool::Shard::copy(std::wstring_view s)
+{
+  if (s.empty()) {
+    return {};
+  }
+
+  if (s.size() > BlockSize) {
+    // too large to share a block, the current block is left as is
+    auto& b = blocks.emplace_back(new wchar_t[s.size()]);
+    std::copy(s.begin(), s.end(), b.get());
+    used += s.size();
+
+    return {b.get(), s.size()};
+  }
+
+  if (s.size() > left) {
+    blocks.emplace_back(new wchar_t[BlockSize]);
+    next = blocks.back().get();
+    left = BlockSize;
+  }
+
+  std::copy(s.begin(), s.end(), next);
+  const std::wstring_view stored(next, s.size());
+
+  next += s.size();
+  left -= s.size();
+  used += s.size();
+
+  return stored;
+}
+
+} // namespace
@@ -0,0 +1,64 @@
+#ifndef MO_REGISTER_STRINGPOOL_INCLUDED
+#define MO_REGISTER_STRINGPOOL_INCLUDED
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_set>
+#include <vector>
+
+namespace MOShared
+{
+
+// stores the names of all the files and directories of a structure
+//
+// strings are interned: each distinct string is only stored once and the
+// returned views stay valid for the lifetime of the pool; they are copied into
+// large blocks that are never freed individually, so destroying the pool
+// releases everything at once instead of one allocation per name
+//
+// interning is thread-safe, the pool is split in shards that are locked
+// independently so mod threads don't contend on a single mutex
+//
+class StringPool
+{
+public:
+  StringPool() = default;
+
+  // noncopyable
+  StringPool(const StringPool&) = delete;
+  StringPool& operator=(const StringPool&) = delete;
+
+  // returns a view of a string equal to `s` that lives as long as the pool
+  //
+  std::wstring_view intern(std::wstring_view s);
+
+  // number of characters stored in the pool
+  //
+  std::size_t size() const;
+
+private:
+  static constexpr std::size_t ShardCount = 32;
+
+  // number of characters in a block, longer strings get their own block
+  static constexpr std::size_t BlockSize = 32 * 1024;
+
+  struct Shard
+  {
+    mutable std::mutex mutex;
+    std::unordered_set<std::wstring_view> strings;
+    std::vector<std::unique_ptr<wchar_t[]>> blocks;
+    wchar_t* next = nullptr;
+    std::size_t left = 0;
+    std::size_t used = 0;
+
+    std::wstring_view copy(std::wstring_view s);
+  };
+
+  std::array<Shard, ShardCount> m_Shards;
+};
+
+} // namespace
+
+#endif // MO_REGISTER_STRINGPOOL_INCLUDED
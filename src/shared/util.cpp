@@ -95,6 +95,11 @@ std::wstring ToWString(const std::string &source, bool utf8)
   return result;
 }
 
+QString ToQString(std::wstring_view source)
+{
+  return QString::fromWCharArray(source.data(), static_cast<int>(source.size()));
+}
+
 static std::locale loc("");
 static auto locToLowerW = [] (wchar_t in) -> wchar_t {
   return std::tolower(in, loc);
@@ -142,7 +147,7 @@ bool CaseInsenstiveComparePred(wchar_t lhs, wchar_t rhs)
   return std::tolower(lhs, loc) == std::tolower(rhs, loc);
 }
 
-bool CaseInsensitiveEqual(const std::wstring &lhs, const std::wstring &rhs)
+bool CaseInsensitiveEqual(std::wstring_view lhs, std::wstring_view rhs)
 {
   return (lhs.length() == rhs.length())
       && std::equal(lhs.begin(), lhs.end(),
@@ -38,6 +38,10 @@ bool FileExists(const std::wstring &searchPath, const std::wstring &filename);
 std::string ToString(const std::wstring &source, bool utf8);
 std::wstring ToWString(const std::string &source, bool utf8);
 
+// names in the directory structure are views, this avoids a temporary
+// std::wstring for MOBase::ToQString()
+QString ToQString(std::wstring_view source);
+
 std::string& ToLowerInPlace(std::string& text);
 std::string ToLowerCopy(const std::string& text);
 
@@ -45,7 +49,7 @@ std::wstring& ToLowerInPlace(std::wstring& text);
 std::wstring ToLowerCopy(const std::wstring& text);
 std::wstring ToLowerCopy(std::wstring_view text);
 
-bool CaseInsensitiveEqual(const std::wstring &lhs, const std::wstring &rhs);
+bool CaseInsensitiveEqual(std::wstring_view lhs, std::wstring_view rhs);
 
 MOBase::VersionInfo createVersionInfo();
 QString getUsvfsVersionString();
@@ -98,7 +98,7 @@ void SyncOverwriteDialog::readTree(const QString &path, DirectoryEntry *director
       const FileEntryPtr entry = directoryStructure->findFile(ToWString(file));
       QComboBox* combo = new QComboBox(ui->syncTree);
       combo->addItem(tr("<don't sync>"), -1);
-      if (entry.get() != nullptr) {
+      if (entry != nullptr) {
         bool ignore;
         int origin = entry->getOrigin(ignore);
         addToComboBox(combo, ToQString(m_DirectoryStructure->getOriginByID(origin).getName()), origin);
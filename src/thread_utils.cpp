@@ -0,0 +1,184 @@
+#include "thread_utils.h"
+#include "shared/util.h"
+
+namespace MOShared
+{
+
+using namespace MOBase;
+
+// the pool and index of the worker running on this thread, if any
+static thread_local WorkStealingPool* t_pool = nullptr;
+static thread_local std::size_t t_worker = 0;
+
+
+WorkStealingPool::WorkStealingPool(std::size_t threadCount)
+  : m_pending(0), m_queued(0), m_next(0), m_stop(false)
+{
+  start(threadCount);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+  stop();
+}
+
+void WorkStealingPool::setThreadCount(std::size_t n)
+{
+  if (n == m_workers.size()) {
+    return;
+  }
+
+  stop();
+  start(n);
+}
+
+std::size_t WorkStealingPool::threadCount() const
+{
+  return m_workers.size();
+}
+
+void WorkStealingPool::start(std::size_t n)
+{
+  m_stop = false;
+
+  for (std::size_t i=0; i<std::max<std::size_t>(n, 1); ++i) {
+    m_workers.push_back(std::make_unique<Worker>());
+  }
+
+  // threads are started once all the workers exist because they steal from
+  // each other
+  for (std::size_t i=0; i<m_workers.size(); ++i) {
+    m_workers[i]->thread = startSafeThread([this, i]{ run(i); });
+  }
+}
+
+void WorkStealingPool::stop()
+{
+  {
+    std::scoped_lock lock(m_mutex);
+    m_stop = true;
+  }
+
+  m_wakeup.notify_all();
+
+  for (auto& w : m_workers) {
+    if (w->thread.joinable()) {
+      w->thread.join();
+    }
+  }
+
+  m_workers.clear();
+}
+
+void WorkStealingPool::submit(Task t)
+{
+  ++m_pending;
+
+  Worker* w = nullptr;
+
+  if (t_pool == this) {
+    // submitted from a task, keep it on this thread
+    w = m_workers[t_worker].get();
+  } else {
+    w = m_workers[m_next++ % m_workers.size()].get();
+  }
+
+  {
+    std::scoped_lock lock(w->mutex);
+    w->tasks.push_back(std::move(t));
+  }
+
+  {
+    // the lock makes sure a worker that's about to sleep either sees the new
+    // count or is already waiting for the notification
+    std::scoped_lock lock(m_mutex);
+    ++m_queued;
+  }
+
+  m_wakeup.notify_one();
+}
+
+void WorkStealingPool::waitForAll()
+{
+  std::unique_lock lock(m_mutex);
+  m_done.wait(lock, [&]{ return (m_pending == 0); });
+}
+
+void WorkStealingPool::run(std::size_t i)
+{
+  SetThisThreadName("WorkStealingPool worker");
+
+  t_pool = this;
+  t_worker = i;
+
+  for (;;) {
+    Task t;
+
+    if (pop(i, t) || steal(i, t)) {
+      --m_queued;
+      execute(t);
+      continue;
+    }
+
+    std::unique_lock lock(m_mutex);
+    m_wakeup.wait(lock, [&]{ return (m_stop || m_queued > 0); });
+
+    if (m_stop) {
+      break;
+    }
+  }
+
+  t_pool = nullptr;
+}
+
+bool WorkStealingPool::pop(std::size_t i, Task& t)
+{
+  auto& w = *m_workers[i];
+  std::scoped_lock lock(w.mutex);
+
+  if (w.tasks.empty()) {
+    return false;
+  }
+
+  t = std::move(w.tasks.back());
+  w.tasks.pop_back();
+
+  return true;
+}
+
+bool WorkStealingPool::steal(std::size_t i, Task& t)
+{
+  const auto count = m_workers.size();
+
+  for (std::size_t n=1; n<count; ++n) {
+    auto& w = *m_workers[(i + n) % count];
+    std::scoped_lock lock(w.mutex);
+
+    if (!w.tasks.empty()) {
+      t = std::move(w.tasks.front());
+      w.tasks.pop_front();
+      return true;
+    }
+  }
+
+  return false;
+}
+
+void WorkStealingPool::execute(Task& t)
+{
+  try
+  {
+    t();
+  }
+  catch(std::exception& e)
+  {
+    log::error("unhandled exception in task: {}", e.what());
+  }
+
+  if (--m_pending == 0) {
+    std::scoped_lock lock(m_mutex);
+    m_done.notify_all();
+  }
+}
+
+}
@@ -2,6 +2,9 @@
 #define MO2_THREAD_UTILS_H
 
 #include <log.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <functional>
 #include <mutex>
 #include <thread>
@@ -71,6 +74,79 @@ void parallelMap(It begin, It end, Callable callable, std::size_t nThreads)
   }
 }
 
+
+// runs tasks on a fixed set of threads
+//
+// each thread has its own queue of tasks; tasks submitted from a worker thread
+// go in that worker's queue and are picked from the back, so a task that
+// splits its work keeps it local, while idle workers steal from the front of
+// the other queues
+//
+// idle workers sleep on a condition variable until a task is submitted
+//
+class WorkStealingPool
+{
+public:
+  using Task = std::function<void ()>;
+
+  WorkStealingPool(std::size_t threadCount=1);
+  ~WorkStealingPool();
+
+  // noncopyable
+  WorkStealingPool(const WorkStealingPool&) = delete;
+  WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+  // stops all the threads and starts `n` new ones, must not be called while
+  // tasks are running
+  //
+  void setThreadCount(std::size_t n);
+
+  std::size_t threadCount() const;
+
+  // queues the given task, can be called from within a task
+  //
+  void submit(Task t);
+
+  // blocks until all the tasks have run, including the ones submitted by
+  // other tasks in the meantime
+  //
+  void waitForAll();
+
+private:
+  struct Worker
+  {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    std::thread thread;
+  };
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+
+  // used for sleeping and waking up
+  std::mutex m_mutex;
+  std::condition_variable m_wakeup;
+  std::condition_variable m_done;
+
+  // number of tasks submitted that haven't finished yet
+  std::atomic<std::size_t> m_pending;
+
+  // number of tasks sitting in queues
+  std::atomic<std::size_t> m_queued;
+
+  // used to spread tasks submitted from outside the pool
+  std::atomic<std::size_t> m_next;
+
+  std::atomic<bool> m_stop;
+
+  void start(std::size_t n);
+  void stop();
+
+  void run(std::size_t i);
+  bool pop(std::size_t i, Task& t);
+  bool steal(std::size_t i, Task& t);
+  void execute(Task& t);
+};
+
 }
 
 #endif